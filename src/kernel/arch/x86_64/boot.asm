@@ -105,6 +105,11 @@ setup_page_tables:
     mov eax, page_table_l3
     or eax, 0b11
     mov [page_table_l4 + 511 * 8], eax
+
+    ; Direct Physical Map (PML4 slot 256 = 0xFFFF800000000000)
+    ; Reuses the same L3, so the first 1GB is also visible there
+    ; until vmm_init() builds the full map.
+    mov [page_table_l4 + 256 * 8], eax
     ret
 
 enable_paging:
@@ -142,6 +147,10 @@ long_mode_start:
     mov fs, ax
     mov gs, ax
 
+    ; Move the stack to its higher-half alias.
+    ; vmm_init() drops the identity map, so kmain must not run on a low stack.
+    mov rsp, stack_top + KERNEL_VIRTUAL_BASE
+
     ; PREPARE ARGUMENTS FOR KMAIN
     ; In 64-bit System V ABI, the first argument goes into RDI.
     ; Load the saved physical pointer into RDI.
@@ -0,0 +1,60 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gdt.h"
+
+// Upper bound on CPUs the kernel keeps per-CPU state for
+#define MAX_CPUS 16
+
+typedef void (*cpu_call_fn)(void* arg);
+
+struct thread;
+
+// --- Per-CPU Area ---
+// One per CPU, reached through the GS base register (set by gdt_init_cpu),
+// so finding "our" data is a single GS-relative load.
+struct cpu {
+    struct cpu* self;               // %gs:0, for this_cpu()
+    uint32_t id;                    // Index 0 .. MAX_CPUS - 1
+    uint32_t apic_id;               // Local APIC ID (from the MADT)
+    uint64_t stack_top;             // Kernel stack the CPU started on
+    volatile int online;            // Set by the CPU once it is running
+
+    // Scheduler state (see core/sched.c)
+    struct thread* volatile current;    // Thread running on this CPU
+    volatile int preempt_count;         // Non-zero: no involuntary switch
+    volatile int need_resched;          // Switch at the next preemption point
+
+    // RCU quiescent states (see core/rcu.c)
+    volatile uint64_t rcu_qs;           // Context switches so far
+    volatile uint64_t rcu_idle;         // Odd while halted in the idle loop
+
+    // Cross-CPU call mailbox (smp_call)
+    volatile cpu_call_fn call_fn;
+    void* call_arg;
+    volatile int call_done;
+
+    // Descriptor tables of this CPU
+    struct gdt_entry gdt[GDT_ENTRIES];
+    struct tss tss;
+} __attribute__((aligned(64)));
+
+extern struct cpu cpus[MAX_CPUS];
+
+// Per-CPU area of the CPU running this code
+static inline struct cpu* this_cpu(void) {
+    struct cpu* cpu;
+    __asm__ volatile("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// Index of the CPU running this code (0 .. MAX_CPUS - 1)
+static inline uint32_t cpu_id(void) {
+    uint32_t id;
+    __asm__ volatile("movl %%gs:%c1, %0" : "=r"(id) : "i"(offsetof(struct cpu, id)));
+    return id;
+}
+
+#endif
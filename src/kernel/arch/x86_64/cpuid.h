@@ -11,4 +11,12 @@ static inline void cpuid(int code, uint32_t *a, uint32_t *d, uint32_t *c, uint32
     );
 }
 
+// Same, for leaves that take a sub-leaf in ECX (e.g., 0x7, 0xD)
+static inline void cpuid_count(int code, int subleaf, uint32_t *a, uint32_t *d, uint32_t *c, uint32_t *b) {
+    __asm__ volatile("cpuid"
+        : "=a"(*a), "=d"(*d), "=c"(*c), "=b"(*b)
+        : "a"(code), "c"(subleaf)
+    );
+}
+
 #endif
@@ -0,0 +1,289 @@
+#include "fpu.h"
+#include "cpu.h"
+#include "cpuid.h"
+#include "../../core/sched.h"
+#include "../../drivers/vga.h"
+#include "../../memory/heap.h"
+
+// --- Control Bits ---
+#define CR0_MP          (1ULL << 1)     // WAIT/FWAIT honours TS
+#define CR0_EM          (1ULL << 2)     // x87 emulation (must be off)
+#define CR0_TS          (1ULL << 3)     // Task switched: next FPU use raises #NM
+#define CR0_NE          (1ULL << 5)     // Native x87 error reporting
+#define CR4_OSFXSR      (1ULL << 9)     // FXSAVE/FXRSTOR and SSE
+#define CR4_OSXMMEXCPT  (1ULL << 10)    // SIMD exceptions as #XM
+#define CR4_OSXSAVE     (1ULL << 18)    // XSAVE family and XCR0
+
+#define CPUID_ECX_XSAVE         (1 << 26)
+#define CPUID_ECX_AVX           (1 << 28)
+#define CPUID_D1_EAX_XSAVEOPT   (1 << 0)
+#define CPUID_D1_EAX_XSAVES     (1 << 3)
+
+// XCR0 components the kernel switches
+#define XCR0_X87        (1ULL << 0)
+#define XCR0_SSE        (1ULL << 1)
+#define XCR0_AVX        (1ULL << 2)
+#define XCR0_AVX512     (7ULL << 5)     // Opmask, ZMM_Hi256, Hi16_ZMM: all or none
+
+// Save area layout (legacy region, then the XSAVE header)
+#define FPU_FCW_OFFSET      0
+#define FPU_MXCSR_OFFSET    24
+#define FPU_XCOMP_BV        520
+#define FPU_LEGACY_SIZE     512
+#define FPU_XCOMP_COMPACT   (1ULL << 63)
+
+// --- Per-CPU State ---
+struct fpu_cpu {
+    struct thread* owner;   // Whose state the registers hold
+    int active;             // TS clear: owner is using the FPU right now
+    uint64_t traps;
+    uint64_t saves;
+    uint64_t restores;
+    uint64_t reuses;
+} __attribute__((aligned(64)));
+
+static struct fpu_cpu fpu_cpus[MAX_CPUS];
+
+static enum fpu_mode mode = FPU_MODE_FXSAVE;
+static uint64_t xcr0 = 0;
+static uint32_t state_size = FPU_LEGACY_SIZE;
+static struct kmem_cache* state_cache = NULL;
+static void* init_state = NULL;     // Template copied into new areas
+
+const char* const fpu_mode_names[] = { "FXSAVE", "XSAVE", "XSAVEOPT", "XSAVES" };
+
+// 1. Register Helpers
+static uint64_t read_cr0(void) {
+    uint64_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static void write_cr0(uint64_t cr0) {
+    __asm__ volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
+}
+
+static uint64_t read_cr4(void) {
+    uint64_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static void write_cr4(uint64_t cr4) {
+    __asm__ volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+}
+
+static void xsetbv(uint32_t reg, uint64_t value) {
+    __asm__ volatile("xsetbv" :: "c"(reg), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+// 2. Save / Restore
+// The requested-feature bitmap is "everything": the CPU masks it with XCR0.
+static void fpu_save(void* area) {
+    switch (mode) {
+    case FPU_MODE_XSAVES:
+        __asm__ volatile("xsaves64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_MODE_XSAVEOPT:
+        __asm__ volatile("xsaveopt64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_MODE_XSAVE:
+        __asm__ volatile("xsave64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    default:
+        __asm__ volatile("fxsave64 (%0)" :: "r"(area) : "memory");
+        break;
+    }
+}
+
+static void fpu_restore(void* area) {
+    switch (mode) {
+    case FPU_MODE_XSAVES:
+        __asm__ volatile("xrstors64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    case FPU_MODE_XSAVEOPT:
+    case FPU_MODE_XSAVE:
+        __asm__ volatile("xrstor64 (%0)" :: "r"(area), "a"(-1), "d"(-1) : "memory");
+        break;
+    default:
+        __asm__ volatile("fxrstor64 (%0)" :: "r"(area) : "memory");
+        break;
+    }
+}
+
+// 3. Lazy Switching
+/**
+ * @brief Save the state of a thread that is leaving the CPU.
+ *
+ * Threads that never touched the FPU since they got the CPU still have
+ * TS set: nothing to save, not even a CR0 write. Otherwise the state is
+ * saved (XSAVEOPT/XSAVES only write what changed) and TS is set again so
+ * the next thread traps on its first FPU instruction.
+ *
+ * @param[in] prev Thread being switched out (interrupts disabled)
+ */
+void fpu_switch_out(struct thread* prev) {
+    struct fpu_cpu* fc = &fpu_cpus[cpu_id()];
+    if (!fc->active) return;
+
+    if (prev->state == THREAD_DEAD) {
+        fc->owner = NULL;
+    } else {
+        fpu_save(prev->fpu_state);
+        fc->saves++;
+    }
+    fc->active = 0;
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+/**
+ * @brief Handle #NM (Device Not Available): first FPU use since switch-in.
+ *
+ * The registers may still hold this thread's state: it was the last
+ * FPU user on this CPU and has not loaded it anywhere else since. Then
+ * clearing TS is enough. Otherwise its save area is loaded.
+ *
+ * @return int 0 when handled, -1 if the thread has no save area
+ */
+int fpu_handle_trap(void) {
+    uint32_t cpu = cpu_id();
+    struct fpu_cpu* fc = &fpu_cpus[cpu];
+    struct thread* current = this_cpu()->current;
+
+    if (!current || !current->fpu_state) return -1;
+
+    __asm__ volatile("clts");
+    fc->active = 1;
+    fc->traps++;
+
+    if (fc->owner == current && current->fpu_cpu == cpu) {
+        fc->reuses++;
+        return 0;
+    }
+    fpu_restore(current->fpu_state);
+    fc->owner = current;
+    current->fpu_cpu = cpu;
+    fc->restores++;
+    return 0;
+}
+
+// 4. Save Areas
+void* fpu_alloc_state(void) {
+    if (!state_cache) return NULL;
+    uint64_t* state = kmem_cache_alloc(state_cache);
+    if (!state) return NULL;
+
+    const uint64_t* src = init_state;
+    for (uint32_t i = 0; i < state_size / 8; i++) state[i] = src[i];
+    return state;
+}
+
+void fpu_free_state(void* state) {
+    if (state) kmem_cache_free(state_cache, state);
+}
+
+// 5. Initialization
+void fpu_init_cpu(void) {
+    // A. x87 native, SSE through FXSAVE, SIMD exceptions
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE);
+    uint64_t cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+    if (xcr0) cr4 |= CR4_OSXSAVE;
+    write_cr4(cr4);
+
+    // B. Components XSAVE manages, then a clean x87 state
+    if (xcr0) xsetbv(0, xcr0);
+    __asm__ volatile("clts; fninit");
+
+    // C. Nobody owns the FPU: the first use traps
+    fpu_cpus[cpu_id()].owner = NULL;
+    fpu_cpus[cpu_id()].active = 0;
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+/**
+ * @brief Enable the FPU and pick how thread state is saved.
+ *
+ * XCR0 gets x87, SSE, AVX and AVX-512 when present. The save area size
+ * comes from CPUID leaf 0xD once XCR0 is set: EBX of sub-leaf 0 for the
+ * standard layout, of sub-leaf 1 for the compacted one (XSAVES).
+ */
+void fpu_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    // 1. What the CPU supports
+    cpuid(1, &eax, &edx, &ecx, &ebx);
+    if (ecx & CPUID_ECX_XSAVE) {
+        uint32_t sub_eax, sub_ebx, sub_ecx, sub_edx;
+        cpuid_count(0xD, 0, &sub_eax, &sub_edx, &sub_ecx, &sub_ebx);
+        uint64_t supported = ((uint64_t)sub_edx << 32) | sub_eax;
+
+        xcr0 = XCR0_X87 | XCR0_SSE;
+        if ((ecx & CPUID_ECX_AVX) && (supported & XCR0_AVX)) xcr0 |= XCR0_AVX;
+        if ((xcr0 & XCR0_AVX) && (supported & XCR0_AVX512) == XCR0_AVX512) xcr0 |= XCR0_AVX512;
+    }
+
+    // 2. Enable it here (XCR0 must be set before the sizes are valid)
+    fpu_init_cpu();
+
+    // 3. Save instruction and area size
+    if (xcr0) {
+        uint32_t sub_eax, sub_ebx, sub_ecx, sub_edx;
+        cpuid_count(0xD, 1, &sub_eax, &sub_edx, &sub_ecx, &sub_ebx);
+        if (sub_eax & CPUID_D1_EAX_XSAVES) {
+            mode = FPU_MODE_XSAVES;
+            state_size = sub_ebx;
+        } else {
+            mode = (sub_eax & CPUID_D1_EAX_XSAVEOPT) ? FPU_MODE_XSAVEOPT : FPU_MODE_XSAVE;
+            cpuid_count(0xD, 0, &sub_eax, &sub_edx, &sub_ecx, &sub_ebx);
+            state_size = sub_ebx;
+        }
+    }
+    state_size = (state_size + 63) & ~63u;
+
+    // 4. Areas are 64-byte aligned (XSAVE requires it, FXSAVE needs 16).
+    // The template is the initial state: default control words and an
+    // empty XSAVE header, so restoring it resets every component.
+    state_cache = kmem_cache_create("fpu", state_size, 64);
+    init_state = state_cache ? kmem_cache_alloc(state_cache) : NULL;
+    if (!init_state) {
+        state_cache = NULL;
+        terminal_writestring("[FPU] No memory for save areas, threads get no FPU.\n");
+        return;
+    }
+    uint8_t* area = init_state;
+    for (uint32_t i = 0; i < state_size; i++) area[i] = 0;
+    *(uint16_t*)(area + FPU_FCW_OFFSET) = 0x37F;
+    *(uint32_t*)(area + FPU_MXCSR_OFFSET) = 0x1F80;
+    if (mode == FPU_MODE_XSAVES) {
+        *(uint64_t*)(area + FPU_XCOMP_BV) = FPU_XCOMP_COMPACT | xcr0;
+    }
+
+    terminal_writestring("[FPU] Lazy switching with ");
+    terminal_writestring(fpu_mode_names[mode]);
+    terminal_writestring(", ");
+    terminal_writedec(state_size);
+    terminal_writestring(" byte save areas.\n");
+}
+
+// 6. Statistics
+enum fpu_mode fpu_get_mode(void) {
+    return mode;
+}
+
+uint32_t fpu_state_size(void) {
+    return state_size;
+}
+
+uint64_t fpu_get_xcr0(void) {
+    return xcr0;
+}
+
+void fpu_get_stats(struct fpu_stats* stats) {
+    stats->traps = stats->saves = stats->restores = stats->reuses = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        stats->traps += fpu_cpus[i].traps;
+        stats->saves += fpu_cpus[i].saves;
+        stats->restores += fpu_cpus[i].restores;
+        stats->reuses += fpu_cpus[i].reuses;
+    }
+}
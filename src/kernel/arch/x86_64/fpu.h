@@ -0,0 +1,58 @@
+#ifndef FPU_H
+#define FPU_H
+
+#include <stdint.h>
+
+struct thread;
+
+// --- Save Instructions ---
+// Best one the CPU has, picked by fpu_init
+enum fpu_mode {
+    FPU_MODE_FXSAVE,        // x87 + SSE only, 512 bytes
+    FPU_MODE_XSAVE,         // Every component enabled in XCR0
+    FPU_MODE_XSAVEOPT,      // Skips components not modified since XRSTOR
+    FPU_MODE_XSAVES         // Same, plus compacted layout (no holes)
+};
+
+extern const char* const fpu_mode_names[];
+
+// A thread whose state is in no CPU's registers
+#define FPU_CPU_NONE 0xFFFFFFFF
+
+// --- Statistics (all CPUs) ---
+struct fpu_stats {
+    uint64_t traps;         // #NM: first FPU use of a thread since its switch-in
+    uint64_t saves;         // Switch-outs of a thread that used the FPU
+    uint64_t restores;      // State loaded from a save area
+    uint64_t reuses;        // State still in the registers: restore skipped
+};
+
+// --- Function Prototypes ---
+
+// Enable SSE/AVX (CR0, CR4.OSFXSR/OSXSAVE, XCR0) on the boot CPU, pick
+// the save instruction and size the save areas from CPUID leaf 0xD
+// (after heap_init). The FPU starts "not available" (CR0.TS).
+void fpu_init(void);
+
+// Same setup on an application processor
+void fpu_init_cpu(void);
+
+// Save area of a new thread, in the initial state (NULL when out of memory)
+void* fpu_alloc_state(void);
+void fpu_free_state(void* state);
+
+// Called by the scheduler before switching away from prev: saves its
+// state only if it touched the FPU since it got the CPU
+void fpu_switch_out(struct thread* prev);
+
+// #NM handler: give the FPU to the current thread
+// Returns 0 when handled, -1 if the thread has no save area.
+int fpu_handle_trap(void);
+
+// Current configuration, for the shell
+enum fpu_mode fpu_get_mode(void);
+uint32_t fpu_state_size(void);
+uint64_t fpu_get_xcr0(void);
+void fpu_get_stats(struct fpu_stats* stats);
+
+#endif
@@ -1,11 +1,8 @@
 #include "gdt.h"
+#include "cpu.h"
+#include "msr.h"
 
-// Need 3 entries: Null, Code, Data
-// TODO: Add User Code/Data and TSS here in future iterations.
-#define GDT_ENTRIES 3
-
-struct gdt_entry gdt[GDT_ENTRIES];
-struct gdt_ptr gdt_pointer;
+#define MSR_GS_BASE 0xC0000101
 
 // External assembly function to actually load the register
 extern void gdt_load(struct gdt_ptr* gdt_ptr);
@@ -13,14 +10,15 @@ extern void gdt_load(struct gdt_ptr* gdt_ptr);
 /**
  * @brief Set a GDT entry with the given parameters.
  *
+ * @param[in] gdt    The GDT to edit
  * @param[in] num    GDT entry index
  * @param[in] base   Base address of the segment
  * @param[in] limit  Size limit of the segment
  * @param[in] access Access flags (Present, Ring, Code/Data)
  * @param[in] gran   Granularity flags
  */
-static void gdt_set_gate(int32_t num, uint32_t base, uint32_t limit,
-                         uint8_t access, uint8_t gran) {
+static void gdt_set_gate(struct gdt_entry* gdt, int32_t num, uint32_t base,
+                         uint32_t limit, uint8_t access, uint8_t gran) {
     gdt[num].base_low    = (base & 0xFFFF);
     gdt[num].base_middle = (base >> 16) & 0xFF;
     gdt[num].base_high   = (base >> 24) & 0xFF;
@@ -32,24 +30,47 @@ static void gdt_set_gate(int32_t num, uint32_t base, uint32_t limit,
     gdt[num].access      = access;
 }
 
-void gdt_init(void) {
+void gdt_init_cpu(struct cpu* cpu) {
+    struct gdt_entry* gdt = cpu->gdt;
+    struct gdt_ptr gdt_pointer;
+
     // 1. Setup the GDT Pointer
     gdt_pointer.limit = (sizeof(struct gdt_entry) * GDT_ENTRIES) - 1;
-    gdt_pointer.base  = (uint64_t)&gdt;
+    gdt_pointer.base  = (uint64_t)gdt;
 
     // 2. Null Descriptor (Index 0) - MUST BE ZERO
-    gdt_set_gate(0, 0, 0, 0, 0);
+    gdt_set_gate(gdt, 0, 0, 0, 0, 0);
 
     // 3. Kernel Code Segment (Index 1)
     // Access: 0x9A = 10011010b (Present, Ring 0, Code, Exec/Read)
     // Granularity: 0xA0 = 10100000b (Long Mode, 4KB pages)
-    gdt_set_gate(1, 0, 0, 0x9A, 0xA0);
+    gdt_set_gate(gdt, 1, 0, 0, 0x9A, 0xA0);
 
     // 4. Kernel Data Segment (Index 2)
     // Access: 0x92 = 10010010b (Present, Ring 0, Data, Read/Write)
     // Granularity: 0x00
-    gdt_set_gate(2, 0, 0, 0x92, 0x00);
+    gdt_set_gate(gdt, 2, 0, 0, 0x92, 0x00);
 
-    // 5. Load it
+    // 5. TSS (Index 3-4): 0x89 = Present, 64-bit available TSS.
+    // The second slot holds bits 32-63 of the base.
+    uint64_t tss_base = (uint64_t)&cpu->tss;
+    cpu->tss.rsp[0] = cpu->stack_top;
+    cpu->tss.iomap_base = sizeof(struct tss);
+    gdt_set_gate(gdt, 3, (uint32_t)tss_base, sizeof(struct tss) - 1, 0x89, 0x00);
+    *(uint64_t*)&gdt[4] = tss_base >> 32;
+
+    // 6. Load it, then the TSS
     gdt_load(&gdt_pointer);
-}
\ No newline at end of file
+    __asm__ volatile("ltr %0" :: "r"((uint16_t)GDT_TSS));
+
+    // 7. Per-CPU area. Must come after gdt_load: reloading GS clears its base.
+    cpu->self = cpu;
+    wrmsr(MSR_GS_BASE, (uint64_t)cpu);
+}
+
+void gdt_init(void) {
+    // The boot CPU is always index 0. Its APIC ID is filled in by smp_init.
+    cpus[0].id = 0;
+    cpus[0].online = 1;
+    gdt_init_cpu(&cpus[0]);
+}
@@ -3,6 +3,14 @@
 
 #include <stdint.h>
 
+// Null, Kernel Code, Kernel Data, TSS (a 64-bit TSS descriptor takes two)
+#define GDT_ENTRIES 5
+
+// --- Selectors ---
+#define GDT_KERNEL_CODE 0x08
+#define GDT_KERNEL_DATA 0x10
+#define GDT_TSS         0x18
+
 // A single GDT entry (Segment Descriptor)
 struct gdt_entry {
     uint16_t limit_low;     // Lower 16 bits of the limit
@@ -19,14 +27,38 @@ struct gdt_ptr {
     uint64_t base;          // Address of the GDT
 } __attribute__((packed));
 
+// 64-bit Task State Segment: no task switching, only the stacks the CPU
+// loads on privilege changes (rsp0) and for IST interrupt gates.
+struct tss {
+    uint32_t reserved0;
+    uint64_t rsp[3];        // Stack for entering ring 0-2
+    uint64_t reserved1;
+    uint64_t ist[7];        // Interrupt Stack Table
+    uint64_t reserved2;
+    uint16_t reserved3;
+    uint16_t iomap_base;    // Past the limit: no I/O permission bitmap
+} __attribute__((packed));
+
+struct cpu;
+
 /**
- * @brief Initialize the Global Descriptor Table (GDT).
+ * @brief Initialize the Global Descriptor Table (GDT) of the boot CPU.
  *
- * Sets up the GDT with null, kernel code, and kernel data segments.
- * Loads the GDT pointer into the GDTR register.
+ * Sets up the boot CPU's per-CPU area (cpus[0]) and calls gdt_init_cpu.
  *
  * @return void
  */
 void gdt_init(void);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Load a CPU's own GDT and TSS, and point GS at its per-CPU area.
+ *
+ * Sets up the GDT with null, kernel code, kernel data and TSS descriptors,
+ * loads it into GDTR and the TSS into TR, then writes the GS base.
+ *
+ * @param[in] cpu Per-CPU area of the calling CPU
+ * @return void
+ */
+void gdt_init_cpu(struct cpu* cpu);
+
+#endif
@@ -48,4 +48,9 @@ void idt_init(void) {
 
     // 3. Load the IDT
     idt_load(&idtr);
-}
\ No newline at end of file
+}
+
+void idt_load_cpu(void) {
+    // All CPUs share one IDT: the gates are the same everywhere
+    idt_load(&idtr);
+}
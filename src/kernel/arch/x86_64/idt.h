@@ -30,6 +30,15 @@ struct idt_ptr {
  */
 void idt_init(void);
 
+/**
+ * @brief Load the (already built) IDT on the calling CPU.
+ *
+ * Used by application processors during SMP bring-up.
+ *
+ * @return void
+ */
+void idt_load_cpu(void);
+
 /**
  * @brief Set an IDT gate (entry) for an interrupt handler.
  *
@@ -0,0 +1,104 @@
+#include "irq.h"
+#include "irqflags.h"
+#include "../../drivers/irqchip.h"
+#include "../../memory/heap.h"
+#include "../../core/softirq.h"
+#include "../../core/irqstat.h"
+#include "../../core/preempt.h"
+#include "../../core/spinlock.h"
+
+// Handlers per vector: dispatch is one table lookup, whatever the number
+// of devices in the system. The lists are RCU-protected: every CPU walks
+// them without a lock, writers serialise on irq_actions_lock and free
+// removed actions after a grace period.
+static struct irq_action* irq_actions[256];
+static struct spinlock irq_actions_lock = SPINLOCK_INIT("irq_actions");
+
+/**
+ * @brief Register an interrupt handler.
+ *
+ * The handler is appended to the vector's list, so devices sharing a
+ * line run in registration order.
+ *
+ * @param[in] vector  IDT vector (32-255)
+ * @param[in] handler Called with interrupts disabled
+ * @param[in] ctx     Passed to handler (usually the device)
+ * @return int 0 on success, -1 on a bad vector or no memory
+ */
+int irq_register(uint8_t vector, irq_fn handler, void* ctx) {
+    if (vector < IRQ_VECTOR_BASE || !handler) return -1;
+
+    struct irq_action* action = kmalloc(sizeof(struct irq_action));
+    if (!action) return -1;
+    action->handler = handler;
+    action->ctx = ctx;
+    action->next = NULL;
+
+    // Published complete: a handler walking the list sees all of it or
+    // nothing
+    spin_lock(&irq_actions_lock);
+    struct irq_action** link = &irq_actions[vector];
+    while (*link) link = &(*link)->next;
+    rcu_assign_pointer(*link, action);
+    spin_unlock(&irq_actions_lock);
+    return 0;
+}
+
+static void irq_action_free(struct rcu_head* head) {
+    kfree((struct irq_action*)((char*)head - offsetof(struct irq_action, rcu)));
+}
+
+int irq_unregister(uint8_t vector, irq_fn handler, void* ctx) {
+    spin_lock(&irq_actions_lock);
+    struct irq_action** link = &irq_actions[vector];
+
+    while (*link && ((*link)->handler != handler || (*link)->ctx != ctx)) {
+        link = &(*link)->next;
+    }
+    struct irq_action* action = *link;
+    if (action) rcu_assign_pointer(*link, action->next);
+    spin_unlock(&irq_actions_lock);
+
+    if (!action) return -1;
+
+    // Handlers running on other CPUs may still hold it (and its next).
+    // The callback frees it on this CPU, whichever one that is.
+    call_rcu(&action->rcu, irq_action_free);
+    return 0;
+}
+
+void irq_handler(struct irq_frame* frame) {
+    uint8_t vector = frame->vector;
+    int handled = 0;
+
+    // 1. Interrupts are off from here on (the gate cleared IF). No switch
+    // until the handler is done, even from a nested interrupt: this is
+    // also the RCU read-side section for the action list. A CPU woken
+    // from the idle halt stops counting as quiescent first.
+    uint64_t start = rdtsc();
+    irqoff_start[cpu_id()] = start;
+    rcu_idle_exit();
+    preempt_disable();
+
+    // 2. Every handler of the line: shared devices each check their own
+    for (struct irq_action* action = rcu_dereference(irq_actions[vector]); action;
+         action = rcu_dereference(action->next)) {
+        handled |= action->handler(action->ctx);
+    }
+
+    // 3. Tell the interrupt controller the process is done, or it will never
+    // send another interrupt (the EOI table picks the controller).
+    irq_eoi(vector);
+    irqstat_record(vector, start, handled);
+
+    // 4. Bottom halves queued by the handlers, with interrupts enabled again
+    if (softirq_pending()) softirq_run();
+
+    // 5. Time slice over or a thread woke up: the interrupted thread
+    // switches out here and resumes on this same path later
+    preempt_enable_no_resched();
+    preempt_schedule_irq();
+
+    // iretq turns interrupts back on
+    irqoff_end();
+}
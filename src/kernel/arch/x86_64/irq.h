@@ -0,0 +1,55 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdint.h>
+#include "../../core/rcu.h"
+
+// Stack layout built by irq_common_stub (isr_asm.asm). Only caller-saved
+// registers are here: the C handlers preserve the others themselves.
+struct irq_frame {
+    // 1. Pushed by irq_common_stub
+    uint64_t r11, r10, r9, r8;
+    uint64_t rdi, rsi, rdx, rcx, rax;
+
+    // 2. Pushed by the per-vector stub
+    uint64_t vector;
+
+    // 3. Pushed automatically by the CPU
+    uint64_t rip;
+    uint64_t cs;
+    uint64_t rflags;
+    uint64_t rsp;
+    uint64_t ss;
+} __attribute__((packed));
+
+// --- Handler Results ---
+#define IRQ_NONE     0              // Not our device (shared line)
+#define IRQ_HANDLED  1
+
+typedef int (*irq_fn)(void* ctx);
+
+// --- Action ---
+// One registered handler. A vector shared by several devices has a list
+// of actions, and every one of them runs on each interrupt.
+struct irq_action {
+    irq_fn handler;
+    void* ctx;
+    struct irq_action* next;
+    struct rcu_head rcu;        // Deferred free once no handler walks it
+};
+
+// --- Function Prototypes ---
+
+// Add a handler for a vector (32-255). Several handlers may share one.
+// Returns 0 on success, -1 on a bad vector or no memory.
+int irq_register(uint8_t vector, irq_fn handler, void* ctx);
+
+// Remove a handler added with the same vector, handler and ctx
+// Returns 0 on success, -1 if it was not registered. The handler may
+// still run on other CPUs until the next RCU grace period.
+int irq_unregister(uint8_t vector, irq_fn handler, void* ctx);
+
+// Called by irq_common_stub: run the vector's handlers, EOI, then softirqs
+void irq_handler(struct irq_frame* frame);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef IRQFLAGS_H
+#define IRQFLAGS_H
+
+#include <stdint.h>
+#include "cpu.h"
+#include "tsc.h"
+
+// --- Interrupts-Off Tracking ---
+// Every transition from enabled to disabled stamps the TSC; going back to
+// enabled reports the elapsed time to irqstat (longest section + caller).
+extern uint64_t irqoff_start[MAX_CPUS];
+void irqoff_end(void);
+
+static inline void irqoff_begin(void) {
+    irqoff_start[cpu_id()] = rdtsc();
+}
+
+// Save RFLAGS and disable interrupts.
+// Pair with irq_restore() so nested sections do not re-enable too early.
+static inline uint64_t irq_save(void) {
+    uint64_t flags;
+    __asm__ volatile("pushfq; pop %0; cli" : "=r"(flags) :: "memory");
+    if (flags & (1 << 9)) irqoff_begin();
+    return flags;
+}
+
+// Restore the interrupt flag saved by irq_save()
+static inline void irq_restore(uint64_t flags) {
+    if (flags & (1 << 9)) {  // RFLAGS.IF
+        irqoff_end();
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
+// Unconditionally enable / disable interrupts
+static inline void irq_enable(void) {
+    irqoff_end();
+    __asm__ volatile("sti" ::: "memory");
+}
+
+static inline void irq_disable(void) {
+    __asm__ volatile("cli" ::: "memory");
+    irqoff_begin();
+}
+
+#endif
@@ -1,38 +1,14 @@
 #include "isr.h"
 #include "idt.h"
 #include "../../drivers/vga.h"
-#include "../../drivers/pic.h"
-#include "../../drivers/keyboard.h"
+#include "../../memory/vmm.h"
+#include "../../core/irqstat.h"
+#include "fpu.h"
+#include "tsc.h"
 
-// Import the array of pointers from assembly
+// Import the arrays of pointers from assembly
 extern void* isr_stub_table[];
-
-/**
- * @brief Print an unsigned 64-bit integer to the terminal.
- *
- * @param[in] num The number to print
- */
-static void terminal_putint(uint64_t num) {
-    if (num == 0) {
-        terminal_putchar('0');
-        return;
-    }
-
-    char buffer[20];
-    int idx = 0;
-    uint64_t temp = num;
-
-    // Extract digits in reverse
-    while (temp > 0) {
-        buffer[idx++] = '0' + (temp % 10);
-        temp /= 10;
-    }
-
-    // Print in correct order
-    while (idx > 0) {
-        terminal_putchar(buffer[--idx]);
-    }
-}
+extern void* irq_stub_table[];
 
 // Messages for the first 32 exceptions (Intel Defined)
 const char* exception_messages[] = {
@@ -70,58 +46,67 @@ const char* exception_messages[] = {
     "Reserved"
 };
 
-// Simple handler for IRQs
-void irq_handler(struct interrupt_frame* frame) {
-    // IRQ 1 = Keyboard (Vector 33)
-    if (frame->int_no == 33) {
-        keyboard_handler();
-    }
-
-    // IMPORTANT: Tell PIC the process is done, or it will never send another interrupt.
-    // IRQ number = Interrupt Number - 32
-    pic_send_eoi(frame->int_no - 32);
-}
-
 /**
  * @brief Handle CPU exceptions and display error information.
  *
  * @param[in] frame Pointer to the interrupt frame with exception details
  */
 void isr_handler(struct interrupt_frame* frame) {
-    // 1. Exceptions (0-31)
-    if (frame->int_no < 32) {
-        terminal_setcolor(VGA_COLOR_LIGHT_RED);
-        terminal_writestring("\n=== INTERRUPT EXCEPTION ===\n");
-        
-        terminal_writestring("Type: ");
-        terminal_writestring(exception_messages[frame->int_no]);
-        
-        terminal_writestring("\nNumber: ");
-        terminal_writehex(frame->int_no);
-        
-        terminal_writestring("\nError:  ");
-        terminal_writehex(frame->err_code);
-        
-        terminal_writestring("\nRIP:    ");
-        terminal_writehex(frame->rip);
-        
-        terminal_writestring("\n\nSYSTEM HALTED.");
-        while(1) { __asm__("hlt"); }
-    } 
-    // 2. Hardware Interrupts
-    else if (frame->int_no >= 32 && frame->int_no < 48) {
-        irq_handler(frame);
+    // Exceptions only (0-31): interrupts enter through irq_common_stub.
+    // Page faults inside a reserved region are demand-zero pages:
+    // back them with a frame and retry the instruction.
+    uint64_t start = rdtsc();
+    uint64_t cr2 = 0;
+
+    // #NM: a thread's first FPU instruction since it got the CPU
+    if (frame->int_no == 7 && fpu_handle_trap() == 0) {
+        irqstat_record(7, start, 1);
+        return;
     }
+    if (frame->int_no == 14) {
+        __asm__ volatile("mov %%cr2, %0" : "=r"(cr2));
+        if (vmm_handle_page_fault(cr2, frame->err_code) == 0) {
+            irqstat_record(14, start, 1);
+            return;
+        }
+    }
+
+    terminal_setcolor(VGA_COLOR_LIGHT_RED);
+    terminal_writestring("\n=== INTERRUPT EXCEPTION ===\n");
+    
+    terminal_writestring("Type: ");
+    terminal_writestring(exception_messages[frame->int_no]);
+    
+    terminal_writestring("\nNumber: ");
+    terminal_writehex(frame->int_no);
+    
+    terminal_writestring("\nError:  ");
+    terminal_writehex(frame->err_code);
+    
+    terminal_writestring("\nRIP:    ");
+    terminal_writehex(frame->rip);
+
+    if (frame->int_no == 14) {
+        terminal_writestring("\nCR2:    ");
+        terminal_writehex(cr2);
+    }
+    
+    terminal_writestring("\n\nSYSTEM HALTED.");
+    while(1) { __asm__("hlt"); }
 }
 
 /**
- * @brief Initialize interrupt service routines for exceptions.
+ * @brief Initialize interrupt service routines.
  *
- * Sets up IDT gates for the first 32 CPU exceptions (Intel defined).
+ * Sets up IDT gates for the 32 CPU exceptions (Intel defined, full frame)
+ * and the 224 interrupt vectors (lean IRQ entry), so anything the APICs
+ * deliver has a handler.
  */
 void isr_init(void) {
-    // Change loop limit from 32 to 48!
-    for (int i = 0; i < 48; i++) {
+    for (int i = 0; i < 32; i++) {
         idt_set_gate(i, (uint64_t)isr_stub_table[i], 0x08, 0x8E);
     }
-}
\ No newline at end of file
+    for (int i = 32; i < 256; i++) {
+        idt_set_gate(i, (uint64_t)irq_stub_table[i - 32], 0x08, 0x8E);
+    }
+}
@@ -30,9 +30,9 @@ struct interrupt_frame {
 void isr_handler(struct interrupt_frame* frame);
 
 /**
- * @brief Initialize interrupt service routines for exceptions.
+ * @brief Initialize interrupt service routines.
  *
- * Sets up IDT gates for the first 32 CPU exceptions (Intel defined).
+ * Sets up IDT gates for the 32 CPU exceptions and the 224 interrupt vectors.
  */
 void isr_init(void);
 
@@ -1,4 +1,5 @@
-global isr_stub_table ; Export the array so C can see it
+global isr_stub_table ; Export the arrays so C can see them
+global irq_stub_table
 
 ; --- MACROS ---
 ; Macro for exceptions that DO NOT push an error code
@@ -24,6 +25,7 @@ global isr_stub_table ; Export the array so C can see it
 
 section .text
 extern isr_handler
+extern irq_handler
 
 ; --- THE COMMON STUB ---
 ; All ISRs jump here to save state and call C
@@ -110,33 +112,73 @@ ISR_NOERRCODE 29 ; Reserved
 ISR_ERRCODE   30 ; Security Exception
 ISR_NOERRCODE 31 ; Reserved
 
-; --- IRQ HANDLERS (Hardware Interrupts) ---
-; IRQ 0 = IDT 32, IRQ 1 = IDT 33, etc.
-ISR_NOERRCODE 32 ; Timer
-ISR_NOERRCODE 33 ; Keyboard
-ISR_NOERRCODE 34 ; Cascade
-ISR_NOERRCODE 35 ; COM2
-ISR_NOERRCODE 36 ; COM1
-ISR_NOERRCODE 37 ; LPT2
-ISR_NOERRCODE 38 ; Floppy
-ISR_NOERRCODE 39 ; LPT1
-ISR_NOERRCODE 40 ; CMOS
-ISR_NOERRCODE 41 ; Free
-ISR_NOERRCODE 42 ; Free
-ISR_NOERRCODE 43 ; Free
-ISR_NOERRCODE 44 ; Mouse
-ISR_NOERRCODE 45 ; FPU
-ISR_NOERRCODE 46 ; ATA Primary
-ISR_NOERRCODE 47 ; ATA Secondary
+; --- THE IRQ STUB ---
+; Interrupts run C code that preserves the callee-saved registers itself,
+; so only the caller-saved ones (rax, rcx, rdx, rsi, rdi, r8-r11) are
+; saved here. Exceptions keep the full frame above (page faults, dumps).
+irq_common_stub:
+    ; 1. Save caller-saved registers
+    push rax
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push r8
+    push r9
+    push r10
+    push r11
+
+    ; 2. Call the C Handler with the frame in RDI
+    ; CPU frame (5) + vector (1) + 9 registers = 15 qwords: pad to keep
+    ; the stack 16-byte aligned at the call, as the ABI requires.
+    mov rdi, rsp
+    sub rsp, 8
+    call irq_handler
+    add rsp, 8
+
+    ; 3. Restore and return
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rax
+    add rsp, 8          ; Drop the vector
+    iretq
+
+; --- IRQ HANDLERS (Hardware Interrupts, IPIs, APIC timer, spurious) ---
+; ISA IRQ n = IDT 32 + n: 32 Timer, 33 Keyboard, 34 Cascade, 35 COM2,
+; 36 COM1, 37 LPT2, 38 Floppy, 39 LPT1, 40 CMOS, 44 Mouse, 45 FPU,
+; 46 ATA Primary, 47 ATA Secondary. The rest are free for the APICs.
+; Interrupt gates already clear IF, and there is no error code: only the
+; vector is pushed.
+%assign vec 32
+%rep 224
+    global irq%+vec
+    irq%+vec:
+        push vec        ; Push vector number
+        jmp irq_common_stub
+%assign vec vec + 1
+%endrep
 
-; --- THE TABLE OF POINTERS ---
-; This allows C to just loop through 'isr_stub_table'
+; --- THE TABLES OF POINTERS ---
+; This allows C to just loop through 'isr_stub_table' (vectors 0-31)
+; and 'irq_stub_table' (vectors 32-255)
 section .data
 align 8
 isr_stub_table:
-    dq isr0, isr1, isr2, isr3, isr4, isr5, isr6, isr7
-    dq isr8, isr9, isr10, isr11, isr12, isr13, isr14, isr15
-    dq isr16, isr17, isr18, isr19, isr20, isr21, isr22, isr23
-    dq isr24, isr25, isr26, isr27, isr28, isr29, isr30, isr31
-    dq isr32, isr33, isr34, isr35, isr36, isr37, isr38, isr39
-    dq isr40, isr41, isr42, isr43, isr44, isr45, isr46, isr47
\ No newline at end of file
+%assign vec 0
+%rep 32
+    dq isr%+vec
+%assign vec vec + 1
+%endrep
+
+irq_stub_table:
+%assign vec 32
+%rep 224
+    dq irq%+vec
+%assign vec vec + 1
+%endrep
@@ -0,0 +1,21 @@
+#ifndef MSR_H
+#define MSR_H
+
+#include <stdint.h>
+
+// Read a Model Specific Register
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Write a Model Specific Register
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr"
+        :
+        : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32))
+        : "memory");
+}
+
+#endif
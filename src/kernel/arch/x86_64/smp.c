@@ -0,0 +1,267 @@
+#include "smp.h"
+#include "gdt.h"
+#include "idt.h"
+#include "irq.h"
+#include "irqflags.h"
+#include "fpu.h"
+#include "../../drivers/acpi.h"
+#include "../../drivers/apic.h"
+#include "../../drivers/irqchip.h"
+#include "../../drivers/vga.h"
+#include "../../memory/vmm.h"
+#include "../../memory/heap.h"
+#include "../../memory/physmap.h"
+#include "../../time/ktime.h"
+#include "../../time/timer.h"
+#include "../../core/softirq.h"
+#include "../../core/sched.h"
+#include "../../core/spinlock.h"
+
+// Per-CPU areas, indexed by cpu_id()
+struct cpu cpus[MAX_CPUS];
+
+static uint32_t cpu_count = 1;
+
+// Per-CPU areas handed out so far: also counts APs that never came up
+static uint32_t cpu_slots = 1;
+
+// One caller at a time per target mailbox
+static struct spinlock call_locks[MAX_CPUS];
+
+// Defined in trampoline.asm: the blob copied to TRAMPOLINE_BASE, and the
+// parameter block at its end
+extern char trampoline_start[];
+extern char trampoline_end[];
+extern char trampoline_params[];
+
+struct trampoline_params {
+    uint64_t cr3;       // Trampoline space: kernel half + identity-mapped page
+    uint64_t stack;
+    uint64_t cpu;       // struct cpu* handed to the entry point
+    uint64_t entry;
+} __attribute__((packed));
+
+// 1. Cross-CPU Calls
+static int smp_call_interrupt(void* ctx) {
+    (void)ctx;
+    struct cpu* cpu = this_cpu();
+    cpu_call_fn fn = cpu->call_fn;
+    if (!fn) return IRQ_NONE;
+
+    cpu->call_fn = NULL;
+    fn(cpu->call_arg);
+    cpu->call_done = 1;
+    return IRQ_HANDLED;
+}
+
+/**
+ * @brief Run a function on another CPU and wait for it to finish.
+ *
+ * The target has a one-entry mailbox in its per-CPU area: the caller
+ * fills it and sends SMP_CALL_VECTOR, the target runs the function from
+ * its IPI handler and raises call_done. Concurrent callers of the same
+ * target queue up on its mailbox lock (which also keeps the caller on
+ * its CPU).
+ *
+ * @param[in] cpu Target CPU index
+ * @param[in] fn  Function to run (interrupts disabled on the target)
+ * @param[in] arg Passed to fn
+ * @return int 0 when fn ran, -1 if the CPU is offline or timed out
+ */
+int smp_call(uint32_t cpu, cpu_call_fn fn, void* arg) {
+    if (cpu >= MAX_CPUS || !cpus[cpu].online || !fn) return -1;
+
+    // A. Ourselves: just call it
+    spin_lock(&call_locks[cpu]);
+    if (cpu == cpu_id()) {
+        uint64_t flags = irq_save();
+        fn(arg);
+        irq_restore(flags);
+        spin_unlock(&call_locks[cpu]);
+        return 0;
+    }
+
+    // B. Fill the mailbox (function last: it is what the target checks)
+    struct cpu* target = &cpus[cpu];
+    target->call_arg = arg;
+    target->call_done = 0;
+    __asm__ volatile("" ::: "memory");
+    target->call_fn = fn;
+
+    lapic_send_ipi(target->apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | SMP_CALL_VECTOR);
+
+    // C. Wait for the answer (serving TLB shootdowns meanwhile: the
+    // target may be waiting on us for one with interrupts disabled)
+    uint64_t deadline = ktime_get_ns() + 100 * NSEC_PER_MSEC;
+    while (!target->call_done) {
+        if (ktime_get_ns() > deadline) {
+            target->call_fn = NULL;
+            spin_unlock(&call_locks[cpu]);
+            return -1;
+        }
+        vmm_tlb_sync();
+        __asm__ volatile("pause");
+    }
+    spin_unlock(&call_locks[cpu]);
+    return 0;
+}
+
+uint32_t smp_cpu_count(void) {
+    return cpu_count;
+}
+
+uint32_t smp_cpu_slots(void) {
+    return cpu_slots;
+}
+
+// 2. Application Processor Entry
+// Called by the trampoline, on the CPU's own stack, in the trampoline space.
+static void ap_main(struct cpu* cpu) {
+    // A. Descriptor tables and GS (per-CPU area) first: everything else uses them
+    gdt_init_cpu(cpu);
+    idt_load_cpu();
+
+    // B. Kernel address space, FPU, Local APIC and its timer
+    vmm_init_cpu();
+    fpu_init_cpu();
+    apic_init_cpu();
+    timer_init_cpu();
+
+    // C. This context becomes the CPU's idle thread
+    sched_init_cpu();
+
+    // D. Online: from here on the CPU takes IPIs, timer interrupts and threads.
+    // TLB shootdowns sent before others saw us online are caught up here.
+    irqoff_begin();
+    __atomic_store_n(&cpu->online, 1, __ATOMIC_SEQ_CST);
+    vmm_tlb_sync();
+    irq_enable();
+
+    for (;;) {
+        softirq_run();
+        sched_idle();
+    }
+}
+
+// 3. Bring-up
+// Create the space the APs switch paging on in: the kernel half, plus the
+// trampoline page identity-mapped so the jump to long mode keeps running.
+// A fresh space rather than a clone, so the kernel space's user half is
+// neither copied nor write-protected.
+// Kept for good: destroying it would hand TRAMPOLINE_BASE to the PMM.
+static struct vmm_space* smp_trampoline_space(void) {
+    struct vmm_space* space = vmm_create_address_space();
+    if (!space) return NULL;
+
+    // The APs load CR3 while still in 32-bit mode
+    if (space->pml4_phys >= 0x100000000ULL) return NULL;
+
+    if (vmm_map_range_space(space, TRAMPOLINE_BASE, TRAMPOLINE_BASE, PAGE_SIZE,
+                            PTE_PRESENT | PTE_WRITE) != 0) {
+        return NULL;
+    }
+    return space;
+}
+
+/**
+ * @brief Start one application processor with INIT-SIPI-SIPI.
+ *
+ * @param[in] cpu   Per-CPU area (id and apic_id filled in)
+ * @param[in] space Trampoline space (CR3 of the AP until vmm_init_cpu)
+ * A CPU that misses the deadline may still be on its way through the
+ * trampoline, so it is sent INIT to park it, and its stack and per-CPU
+ * area are never reused.
+ *
+ * @return int 0 once the CPU is online, -1 if it never showed up
+ */
+static int smp_start_cpu(struct cpu* cpu, struct vmm_space* space) {
+    // A. Stack and trampoline parameters
+    uint8_t* stack = kmalloc(SMP_AP_STACK_SIZE);
+    if (!stack) return -1;
+    cpu->stack_top = (uint64_t)(stack + SMP_AP_STACK_SIZE);
+
+    struct trampoline_params* params = (struct trampoline_params*)
+        ((uint8_t*)phys_to_virt(TRAMPOLINE_BASE) + (trampoline_params - trampoline_start));
+    params->cr3 = space->pml4_phys;
+    params->stack = cpu->stack_top;
+    params->cpu = (uint64_t)cpu;
+    params->entry = (uint64_t)ap_main;
+
+    // B. INIT, then up to two Startup IPIs (vector = start page)
+    lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+    ktime_delay_ns(10 * NSEC_PER_MSEC);
+
+    for (int sipi = 0; sipi < 2 && !cpu->online; sipi++) {
+        lapic_send_ipi(cpu->apic_id, LAPIC_ICR_STARTUP | LAPIC_ICR_ASSERT |
+                                     (TRAMPOLINE_BASE >> 12));
+        ktime_delay_ns(200 * NSEC_PER_USEC);
+    }
+
+    // C. Wait for ap_main to report in
+    uint64_t deadline = ktime_get_ns() + 100 * NSEC_PER_MSEC;
+    while (!cpu->online) {
+        if (ktime_get_ns() > deadline) {
+            lapic_send_ipi(cpu->apic_id, LAPIC_ICR_INIT | LAPIC_ICR_ASSERT);
+            return -1;
+        }
+        __asm__ volatile("pause");
+    }
+    return 0;
+}
+
+/**
+ * @brief Bring every CPU of the MADT online.
+ *
+ * The trampoline is copied below 1MB, then each AP is started in turn
+ * (one parameter block, so one at a time). An AP that does not answer
+ * is skipped, but keeps its slot: a late start must not land on the
+ * per-CPU area of the next one.
+ */
+void smp_init(void) {
+    const struct acpi_madt_info* madt = acpi_get_madt();
+    cpus[0].apic_id = irqchip_uses_apic() ? lapic_id() : 0;
+    for (int i = 0; i < MAX_CPUS; i++) spin_lock_init(&call_locks[i], "smp_call");
+
+    if (!irqchip_uses_apic() || !madt || madt->cpu_count <= 1) {
+        terminal_writestring("[SMP] Running on the boot CPU only.\n");
+        irq_register(SMP_CALL_VECTOR, smp_call_interrupt, NULL);
+        return;
+    }
+
+    // 1. Trampoline code and the space it enables paging with
+    struct vmm_space* space = smp_trampoline_space();
+    if (!space) {
+        terminal_writestring("[SMP] No trampoline space, running on the boot CPU only.\n");
+        return;
+    }
+
+    uint8_t* dst = phys_to_virt(TRAMPOLINE_BASE);
+    for (char* src = trampoline_start; src < trampoline_end; src++) {
+        *dst++ = (uint8_t)*src;
+    }
+
+    irq_register(SMP_CALL_VECTOR, smp_call_interrupt, NULL);
+    irq_register(VMM_TLB_VECTOR, vmm_tlb_interrupt, NULL);
+
+    // 2. Start every other CPU
+    for (uint32_t i = 0; i < madt->cpu_count && cpu_slots < MAX_CPUS; i++) {
+        if (madt->cpu_apic_ids[i] == cpus[0].apic_id) continue;
+
+        struct cpu* cpu = &cpus[cpu_slots];
+        cpu->id = cpu_slots++;
+        cpu->apic_id = madt->cpu_apic_ids[i];
+
+        if (smp_start_cpu(cpu, space) != 0) {
+            terminal_writestring("[SMP] APIC ID ");
+            terminal_writedec(cpu->apic_id);
+            terminal_writestring(" did not start.\n");
+            continue;
+        }
+        terminal_writestring("[SMP] CPU ");
+        terminal_writedec(cpu->id);
+        terminal_writestring(" online (APIC ID ");
+        terminal_writedec(cpu->apic_id);
+        terminal_writestring(").\n");
+        cpu_count++;
+    }
+}
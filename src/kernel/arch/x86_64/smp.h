@@ -0,0 +1,29 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+#include "cpu.h"
+
+// --- Constants ---
+#define TRAMPOLINE_BASE     0x8000      // Real-mode entry page of the APs (below 1MB)
+#define SMP_AP_STACK_SIZE   16384       // Kernel stack of each application processor
+#define SMP_CALL_VECTOR     0xF0        // IPI: run the mailbox function (smp_call)
+
+// --- Function Prototypes ---
+
+// Start every CPU listed in the MADT (after timer_init)
+// Needs the APIC: with the 8259 fallback only the boot CPU runs.
+void smp_init(void);
+
+// Number of CPUs online (the boot CPU included)
+uint32_t smp_cpu_count(void);
+
+// Number of CPU indices in use: online CPUs lie below it, but an AP that
+// failed to start leaves an offline index behind
+uint32_t smp_cpu_slots(void);
+
+// Run fn(arg) on a CPU, from its interrupt context, and wait for it
+// Returns 0 when fn ran, -1 if the CPU is offline or did not answer.
+int smp_call(uint32_t cpu, cpu_call_fn fn, void* arg);
+
+#endif
@@ -0,0 +1,44 @@
+global switch_context
+global thread_start
+
+extern sched_thread_start
+
+section .text
+bits 64
+
+; struct thread* switch_context(struct thread* prev, struct thread* next)
+; Saves the callee-saved registers on prev's stack, stores the stack
+; pointer in prev->rsp (offset 0), then resumes next the same way.
+; Returns prev to the code that runs on next's stack (rax), so it can
+; finish the switch. The caller-saved registers are already saved by the
+; C caller, and the interrupt frame (if any) stays on the stack.
+switch_context:
+    ; 1. Save prev
+    push rbp
+    push rbx
+    push r12
+    push r13
+    push r14
+    push r15
+    mov [rdi], rsp
+
+    ; 2. Load next
+    mov rsp, [rsi]
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop rbx
+    pop rbp
+
+    ; 3. prev for whoever resumes here
+    mov rax, rdi
+    ret
+
+; First "return" of a new thread (frame built by thread_create):
+; RBX holds the thread, RAX the one switched away from.
+thread_start:
+    mov rdi, rax
+    mov rsi, rbx
+    call sched_thread_start
+    ud2                 ; sched_thread_start never returns
@@ -0,0 +1,91 @@
+; --- AP STARTUP TRAMPOLINE ---
+; Application processors wake up in 16-bit real mode at the page given by
+; the Startup IPI. smp_init copies this blob to TRAMPOLINE_BASE, fills in
+; the parameters at its end, and sends INIT-SIPI-SIPI. The code walks the
+; same path as boot.asm (real -> protected -> long mode), then calls the
+; C entry point on its own stack with the per-CPU area in RDI.
+
+global trampoline_start
+global trampoline_params
+global trampoline_end
+
+%define TRAMPOLINE_BASE 0x8000
+%define REL(label) (TRAMPOLINE_BASE + (label) - trampoline_start)
+
+; Copied at runtime, never executed in place
+section .rodata
+
+bits 16
+trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+
+    ; 1. Temporary GDT, then protected mode
+    lgdt [REL(tramp_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1
+    mov cr0, eax
+    jmp dword 0x08:REL(tramp_protected)
+
+bits 32
+tramp_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; 2. PAE, the trampoline page tables (below 4GB), Long Mode, Paging
+    mov eax, cr4
+    or eax, 1 << 5
+    mov cr4, eax
+
+    mov eax, [REL(tramp_cr3)]
+    mov cr3, eax
+
+    mov ecx, 0xC0000080
+    rdmsr
+    or eax, 1 << 8
+    wrmsr
+
+    mov eax, cr0
+    or eax, 1 << 31
+    mov cr0, eax
+    jmp 0x18:REL(tramp_long)
+
+bits 64
+tramp_long:
+    xor ax, ax
+    mov ds, ax
+    mov es, ax
+    mov ss, ax
+
+    ; 3. Own stack, then into the higher-half kernel: entry(cpu)
+    mov rsp, [REL(tramp_stack)]
+    mov rdi, [REL(tramp_cpu)]
+    mov rax, [REL(tramp_entry)]
+    call rax
+.hang:
+    hlt
+    jmp .hang
+
+; --- TEMPORARY GDT ---
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF   ; 0x08: 32-bit code
+    dq 0x00CF92000000FFFF   ; 0x10: data
+    dq 0x00AF9A000000FFFF   ; 0x18: 64-bit code
+tramp_gdt_ptr:
+    dw tramp_gdt_ptr - tramp_gdt - 1
+    dd REL(tramp_gdt)
+
+; --- PARAMETERS (struct trampoline_params in smp.c) ---
+align 8
+trampoline_params:
+tramp_cr3:   dq 0       ; Physical PML4 (identity maps this page)
+tramp_stack: dq 0       ; Stack top
+tramp_cpu:   dq 0       ; struct cpu*
+tramp_entry: dq 0       ; void entry(struct cpu*)
+trampoline_end:
@@ -0,0 +1,13 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+
+// Read the Time Stamp Counter
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "irqstat.h"
+#include "../arch/x86_64/irqflags.h"
+#include "../time/ktime.h"
+
+// Shared by every CPU: updated with atomics (a per-CPU copy would take
+// MAX_CPUS times 32KB)
+static struct irqstat_vector vectors[256];
+
+// Interrupts-off tracking (see irqflags.h). The maximum is kept per CPU
+// so its cycles and rip always belong together.
+struct irqoff_max {
+    uint64_t cycles;
+    uint64_t rip;
+} __attribute__((aligned(64)));
+
+uint64_t irqoff_start[MAX_CPUS];
+static struct irqoff_max irqoff_max[MAX_CPUS];
+
+// 1. Per-Vector Accounting
+static uint32_t irqstat_bucket(uint64_t ns) {
+    uint32_t bucket = 63 - __builtin_clzll(ns | 1);
+    return bucket < IRQSTAT_BUCKETS ? bucket : IRQSTAT_BUCKETS - 1;
+}
+
+void irqstat_record(uint8_t vector, uint64_t start_tsc, int handled) {
+    struct irqstat_vector* stat = &vectors[vector];
+    uint64_t ns = ktime_cycles_to_ns(rdtsc() - start_tsc);
+
+    __atomic_fetch_add(&stat->count, 1, __ATOMIC_RELAXED);
+    if (!handled) __atomic_fetch_add(&stat->unhandled, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->hist[irqstat_bucket(ns)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&stat->max_ns, __ATOMIC_RELAXED);
+    while (ns > max &&
+           !__atomic_compare_exchange_n(&stat->max_ns, &max, ns, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+const struct irqstat_vector* irqstat_get(uint8_t vector) {
+    return &vectors[vector];
+}
+
+// 2. Interrupts-Off Sections
+// Out of line on purpose: the return address is the code that turns
+// interrupts back on (irq_restore / irq_enable are inlined into it).
+__attribute__((noinline))
+void irqoff_end(void) {
+    uint32_t cpu = cpu_id();
+    uint64_t cycles = rdtsc() - irqoff_start[cpu];
+    if (cycles > irqoff_max[cpu].cycles) {
+        irqoff_max[cpu].cycles = cycles;
+        irqoff_max[cpu].rip = (uint64_t)__builtin_return_address(0);
+    }
+}
+
+void irqstat_get_irqoff(struct irqstat_irqoff* out) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        if (irqoff_max[i].cycles > irqoff_max[best].cycles) best = i;
+    }
+    out->max_ns = ktime_cycles_to_ns(irqoff_max[best].cycles);
+    out->max_rip = irqoff_max[best].rip;
+}
+
+void irqstat_reset(void) {
+    uint64_t flags = irq_save();
+    for (int v = 0; v < 256; v++) {
+        struct irqstat_vector* stat = &vectors[v];
+        stat->count = 0;
+        stat->unhandled = 0;
+        stat->total_ns = 0;
+        stat->max_ns = 0;
+        for (int b = 0; b < IRQSTAT_BUCKETS; b++) stat->hist[b] = 0;
+    }
+    for (int i = 0; i < MAX_CPUS; i++) {
+        irqoff_max[i].cycles = 0;
+        irqoff_max[i].rip = 0;
+    }
+    irq_restore(flags);
+}
@@ -0,0 +1,38 @@
+#ifndef IRQSTAT_H
+#define IRQSTAT_H
+
+#include <stdint.h>
+
+// Latency histogram: bucket b counts interrupts that took [2^b, 2^(b+1)) ns,
+// the last bucket everything slower (~16ms and up).
+#define IRQSTAT_BUCKETS 24
+
+struct irqstat_vector {
+    uint64_t count;                 // Interrupts delivered
+    uint64_t unhandled;             // No handler claimed it (IRQ_NONE / none registered)
+    uint64_t total_ns;              // Entry to EOI, summed
+    uint64_t max_ns;
+    uint32_t hist[IRQSTAT_BUCKETS];
+};
+
+struct irqstat_irqoff {
+    uint64_t max_ns;                // Longest interrupts-disabled section
+    uint64_t max_rip;               // Where interrupts were re-enabled after it
+};
+
+// --- Function Prototypes ---
+
+// Account one interrupt: start_tsc is the TSC at entry (taken before the
+// handlers, read again here after the EOI). handled: a handler claimed it.
+void irqstat_record(uint8_t vector, uint64_t start_tsc, int handled);
+
+// Statistics of one vector (read-only)
+const struct irqstat_vector* irqstat_get(uint8_t vector);
+
+// Longest interrupts-off section seen so far
+void irqstat_get_irqoff(struct irqstat_irqoff* out);
+
+// Forget everything recorded so far
+void irqstat_reset(void);
+
+#endif
@@ -2,13 +2,22 @@
 #include "../drivers/vga.h"
 #include "../drivers/pic.h"
 #include "../drivers/keyboard.h"
+#include "../drivers/irqchip.h"
 #include "shell.h"
+#include "softirq.h"
+#include "sched.h"
+#include "rcu.h"
 #include "../arch/x86_64/io.h"
 #include "../arch/x86_64/gdt.h"
 #include "../arch/x86_64/idt.h"
 #include "../arch/x86_64/isr.h"
+#include "../arch/x86_64/fpu.h"
+#include "../arch/x86_64/smp.h"
 #include "../memory/pmm.h"
 #include "../memory/vmm.h"
+#include "../memory/heap.h"
+#include "../time/ktime.h"
+#include "../time/timer.h"
 
 void kmain(uint64_t multiboot_addr) {
     // Silence compiler warning about unused parameter
@@ -35,10 +44,28 @@ void kmain(uint64_t multiboot_addr) {
     extern uint64_t kernel_physical_end;
     pmm_init(multiboot_addr, (uint64_t)&kernel_physical_end);
     vmm_init();
+    heap_init();
 
-    // 3. Enable Interrupts now that the environment is stable
-    // Unmask Keyboard (IRQ1)
-    outb(0x21, 0xFD); 
+    // 3. FPU/SSE/AVX for threads (the kernel itself never touches it)
+    fpu_init();
+
+    // 4. Pick the interrupt controller (APICs from the ACPI MADT, else the PIC)
+    irqchip_init(multiboot_addr);
+
+    // 5. Clock and one-shot event timer (no periodic tick)
+    ktime_init();
+    timer_init();
+
+    // 6. Threads and RCU, then the other CPUs (each one's boot context is
+    // its idle thread)
+    sched_init();
+    rcu_init();
+    smp_init();
+
+    // 7. Enable Interrupts now that the environment is stable
+    // Route Keyboard (IRQ1) and Primary ATA (IRQ14)
+    keyboard_install();
+    irqchip_enable_irq(14);
     
     __asm__ volatile ("sti");
     terminal_writestring("[CPU] Interrupts Enabled. Press any key!\n");
@@ -55,6 +82,14 @@ void kmain(uint64_t multiboot_addr) {
         if (command_ready) {
             shell_execute();
         }
-        __asm__ volatile("hlt"); // Wait for next interrupt (power save)
+        // Deferred interrupt work left over (e.g. after an interrupt storm)
+        softirq_run();
+        // Threads that exited: any CPU could free them, this idle loop is
+        // simply where the list gets drained
+        sched_reap();
+        // Nothing left to do: zero a few frames for later before sleeping
+        pmm_refill_zero_pool(8);
+        // Run queued threads, else wait for next interrupt (power save)
+        sched_idle();
     }
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "lockstat.h"
+
+#ifdef CONFIG_LOCKSTAT
+
+// Every lock used so far. Only ever pushed to, so readers need no lock.
+static struct lockstat* lockstat_head = NULL;
+
+const char* const lockstat_kind_names[] = { "spin", "mcs", "rw" };
+
+void lockstat_register(struct lockstat* stat) {
+    if (__atomic_exchange_n(&stat->registered, 1, __ATOMIC_ACQ_REL)) return;
+
+    struct lockstat* head = __atomic_load_n(&lockstat_head, __ATOMIC_RELAXED);
+    do {
+        stat->next = head;
+    } while (!__atomic_compare_exchange_n(&lockstat_head, &head, stat, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+struct lockstat* lockstat_list(void) {
+    return __atomic_load_n(&lockstat_head, __ATOMIC_ACQUIRE);
+}
+
+// Racy against concurrent holders: a count may survive, which is fine
+// for statistics
+void lockstat_reset(void) {
+    for (struct lockstat* stat = lockstat_list(); stat; stat = stat->next) {
+        stat->acquisitions = 0;
+        stat->contended = 0;
+        stat->spin_cycles = 0;
+        stat->max_spin_cycles = 0;
+    }
+}
+
+#endif
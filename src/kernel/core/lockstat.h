@@ -0,0 +1,86 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../arch/x86_64/tsc.h"
+
+// --- Lock Kinds ---
+#define LOCK_KIND_SPIN  0   // Ticket spinlock
+#define LOCK_KIND_MCS   1   // MCS queue lock
+#define LOCK_KIND_RW    2   // Reader-writer spinlock
+
+// --- Contention Statistics ---
+// Built with CONFIG_LOCKSTAT (make LOCKSTAT=1), every lock carries its
+// counters and joins a global list on first use; 'lockstat' prints them.
+// Without it the fields and the accounting compile away entirely.
+// A lock with statistics must outlive the list: static, or never freed.
+#ifdef CONFIG_LOCKSTAT
+
+struct lockstat {
+    const char* name;
+    uint32_t kind;              // LOCK_KIND_*
+    volatile uint32_t registered;
+    uint64_t acquisitions;
+    uint64_t contended;         // Acquisitions that had to wait
+    uint64_t spin_cycles;       // TSC cycles spent waiting, in total
+    uint64_t max_spin_cycles;   // Longest single wait
+    struct lockstat* next;      // Registry
+};
+
+#define LOCKSTAT_FIELD              struct lockstat stat;
+#define LOCKSTAT_INIT(name, kind)   { (name), (kind), 0, 0, 0, 0, 0, 0 }
+
+// Add a lock to the registry (once; lock-free, any context)
+void lockstat_register(struct lockstat* stat);
+
+// Start of a wait (0 means "did not wait")
+static inline uint64_t lockstat_clock(void) {
+    return rdtsc();
+}
+
+// Account one acquisition. Exclusive holders update the counters under
+// the lock itself; shared (reader) acquisitions use atomics.
+static inline void lockstat_account(struct lockstat* stat, uint64_t spin_start, int shared) {
+    if (!stat->registered) lockstat_register(stat);
+
+    uint64_t spin = spin_start ? rdtsc() - spin_start : 0;
+    if (shared) {
+        __atomic_fetch_add(&stat->acquisitions, 1, __ATOMIC_RELAXED);
+        if (!spin_start) return;
+        __atomic_fetch_add(&stat->contended, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stat->spin_cycles, spin, __ATOMIC_RELAXED);
+    } else {
+        stat->acquisitions++;
+        if (!spin_start) return;
+        stat->contended++;
+        stat->spin_cycles += spin;
+    }
+    if (spin > stat->max_spin_cycles) stat->max_spin_cycles = spin;
+}
+
+#define lockstat_acquired(stat, spin_start)         lockstat_account((stat), (spin_start), 0)
+#define lockstat_acquired_shared(stat, spin_start)  lockstat_account((stat), (spin_start), 1)
+#define lockstat_name(lock, lock_name, lock_kind) \
+    do { (lock)->stat = (struct lockstat)LOCKSTAT_INIT(lock_name, lock_kind); \
+         lockstat_register(&(lock)->stat); } while (0)
+
+// First registered lock (walk with ->next), and clearing the counters
+struct lockstat* lockstat_list(void);
+void lockstat_reset(void);
+
+// Printable LOCK_KIND_* names
+extern const char* const lockstat_kind_names[];
+
+#else
+
+#define LOCKSTAT_FIELD
+#define LOCKSTAT_INIT(name, kind)
+#define lockstat_clock()                            0
+#define lockstat_acquired(stat, spin_start)         ((void)(spin_start))
+#define lockstat_acquired_shared(stat, spin_start)  ((void)(spin_start))
+#define lockstat_name(lock, lock_name, lock_kind)   ((void)(lock_name))
+
+#endif
+
+#endif
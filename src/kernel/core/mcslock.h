@@ -0,0 +1,99 @@
+#ifndef MCSLOCK_H
+#define MCSLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "lockstat.h"
+#include "preempt.h"
+#include "../arch/x86_64/irqflags.h"
+
+// --- MCS Queue Lock ---
+// For locks that are often contended. Waiters form a queue of nodes
+// (one per acquisition, usually on the caller's stack) and each spins on
+// its own node, so a release touches only the next waiter's cache line
+// instead of every spinning CPU's. The node must stay valid until the
+// matching mcs_unlock.
+struct mcs_node {
+    struct mcs_node* volatile next;
+    volatile int locked;
+};
+
+struct mcs_lock {
+    struct mcs_node* volatile tail;     // Last waiter (NULL: free)
+    LOCKSTAT_FIELD
+};
+
+#define MCS_LOCK_INIT(name) { NULL, LOCKSTAT_INIT(name, LOCK_KIND_MCS) }
+
+static inline void mcs_lock_init(struct mcs_lock* lock, const char* name) {
+    lock->tail = NULL;
+    lockstat_name(lock, name, LOCK_KIND_MCS);
+}
+
+static inline void mcs_lock(struct mcs_lock* lock, struct mcs_node* node) {
+    preempt_disable();
+    node->next = NULL;
+    node->locked = 1;
+
+    // 1. Join the queue; the previous tail hands the lock over to us
+    struct mcs_node* prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    uint64_t spin_start = 0;
+    if (prev) {
+        spin_start = lockstat_clock();
+        __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+            __asm__ volatile("pause");
+        }
+    }
+    lockstat_acquired(&lock->stat, spin_start);
+}
+
+static inline int mcs_trylock(struct mcs_lock* lock, struct mcs_node* node) {
+    preempt_disable();
+    struct mcs_node* expected = NULL;
+    node->next = NULL;
+    if (__atomic_compare_exchange_n(&lock->tail, &expected, node, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        lockstat_acquired(&lock->stat, 0);
+        return 1;
+    }
+    preempt_enable();
+    return 0;
+}
+
+static inline void mcs_release(struct mcs_lock* lock, struct mcs_node* node) {
+    struct mcs_node* next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+
+    // 2. No known successor: free the lock, unless one is joining right now
+    if (!next) {
+        struct mcs_node* expected = node;
+        if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+            __asm__ volatile("pause");
+        }
+    }
+    __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline void mcs_unlock(struct mcs_lock* lock, struct mcs_node* node) {
+    mcs_release(lock, node);
+    preempt_enable();
+}
+
+static inline uint64_t mcs_lock_irqsave(struct mcs_lock* lock, struct mcs_node* node) {
+    uint64_t flags = irq_save();
+    mcs_lock(lock, node);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(struct mcs_lock* lock, struct mcs_node* node,
+                                         uint64_t flags) {
+    mcs_release(lock, node);
+    irq_restore(flags);
+    preempt_enable();
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PREEMPT_H
+#define PREEMPT_H
+
+#include <stddef.h>
+#include "../arch/x86_64/cpu.h"
+
+// --- Preemption Control ---
+// The count lives in the per-CPU area and is changed with a single
+// GS-relative instruction, so it cannot be split by a switch to another
+// CPU. Switches only happen while it is zero: interrupt handlers and
+// softirqs hold it too, so nothing switches out from under them.
+
+// Switch now if a reschedule is due (no-op with interrupts disabled)
+void preempt_schedule(void);
+
+// Same, on IRQ exit (interrupts disabled, the interrupted thread switches)
+void preempt_schedule_irq(void);
+
+static inline void preempt_disable(void) {
+    __asm__ volatile("incl %%gs:%c0" :: "i"(offsetof(struct cpu, preempt_count)) : "memory");
+}
+
+// Drop the count without checking for a pending reschedule
+static inline void preempt_enable_no_resched(void) {
+    __asm__ volatile("decl %%gs:%c0" :: "i"(offsetof(struct cpu, preempt_count)) : "memory");
+}
+
+static inline void preempt_enable(void) {
+    preempt_enable_no_resched();
+    if (this_cpu()->need_resched) preempt_schedule();
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "rcu.h"
+#include "sched.h"
+#include "softirq.h"
+#include "spinlock.h"
+#include "../arch/x86_64/irqflags.h"
+#include "../arch/x86_64/smp.h"
+#include "../drivers/vga.h"
+#include "../time/ktime.h"
+#include "../time/timer.h"
+
+// --- Grace Periods ---
+// Grace period N starts with a snapshot of every online CPU's counters
+// and ends once each of them has moved on (a context switch since) or
+// was halted at the time. Only one is in progress at a time; requests
+// that arrive meanwhile are served by the next one.
+struct rcu_gp {
+    struct spinlock lock;
+    uint64_t started;               // Last grace period started
+    uint64_t completed;             // Last grace period over
+    uint64_t needed;                // Highest one asked for
+    uint64_t start_ns;
+    uint64_t kick_ns;               // Last round of reschedule IPIs
+    uint32_t waiting;               // CPUs not quiescent yet (bitmap)
+    uint64_t snap_qs[MAX_CPUS];
+    uint64_t snap_idle[MAX_CPUS];
+    uint64_t kicks;
+};
+
+static struct rcu_gp gp;
+
+// --- Per-CPU Callbacks ---
+// Queued in order, so grace period numbers only grow along a list.
+// Only touched by the owning CPU, with interrupts disabled.
+struct rcu_cpu {
+    struct rcu_head* head;
+    struct rcu_head** tail;
+    uint64_t pending;
+    uint64_t invoked;
+    struct timer poll;              // Armed while callbacks wait
+} __attribute__((aligned(64)));
+
+static struct rcu_cpu rcu_cpus[MAX_CPUS];
+
+// 1. Grace Period Machine (gp.lock held)
+static int rcu_cpu_quiescent(uint32_t cpu) {
+    uint64_t idle = cpus[cpu].rcu_idle;
+    return cpus[cpu].rcu_qs != gp.snap_qs[cpu] ||
+           idle != gp.snap_idle[cpu] || (idle & 1);
+}
+
+static void rcu_gp_start(uint64_t now) {
+    // Removals done before the request must be visible before the
+    // snapshot: a CPU counted as quiescent cannot see the old version
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    gp.started++;
+    gp.start_ns = now;
+    gp.kick_ns = now;
+    gp.waiting = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (!cpus[i].online) continue;
+        gp.snap_qs[i] = cpus[i].rcu_qs;
+        gp.snap_idle[i] = cpus[i].rcu_idle;
+        if (!(gp.snap_idle[i] & 1)) gp.waiting |= 1u << i;
+    }
+}
+
+/**
+ * @brief Move the grace period machine forward.
+ *
+ * Drops the CPUs that went through a quiescent state from the waiting
+ * set, ends the grace period once it is empty and starts the next one if
+ * somebody asked for it. CPUs that hold a grace period up for longer
+ * than RCU_KICK_NS get a reschedule IPI: the switch on IRQ exit is their
+ * quiescent state.
+ *
+ * @return uint64_t Last completed grace period
+ */
+static uint64_t rcu_gp_poll(void) {
+    uint64_t flags = spin_lock_irqsave(&gp.lock);
+    uint64_t now = ktime_get_ns();
+
+    // A. Current grace period
+    if (gp.started != gp.completed) {
+        for (uint32_t i = 0; i < MAX_CPUS; i++) {
+            if ((gp.waiting & (1u << i)) && rcu_cpu_quiescent(i)) gp.waiting &= ~(1u << i);
+        }
+        if (!gp.waiting) {
+            gp.completed = gp.started;
+        } else if (now - gp.kick_ns > RCU_KICK_NS) {
+            gp.kick_ns = now;
+            for (uint32_t i = 0; i < MAX_CPUS; i++) {
+                if (gp.waiting & (1u << i)) {
+                    sched_kick(i);
+                    gp.kicks++;
+                }
+            }
+        }
+    }
+
+    // B. Next one
+    if (gp.started == gp.completed && gp.needed > gp.started) rcu_gp_start(now);
+
+    uint64_t completed = gp.completed;
+    spin_unlock_irqrestore(&gp.lock, flags);
+    return completed;
+}
+
+// Ask for a grace period that starts from now on, return its number
+static uint64_t rcu_gp_request(void) {
+    uint64_t flags = spin_lock_irqsave(&gp.lock);
+    uint64_t target = gp.started + 1;
+    if (gp.needed < target) gp.needed = target;
+    spin_unlock_irqrestore(&gp.lock, flags);
+    return target;
+}
+
+// 2. Waiting for Readers
+void synchronize_rcu(void) {
+    // One CPU: the caller runs, so no other section can be open
+    if (smp_cpu_count() <= 1) return;
+
+    uint64_t target = rcu_gp_request();
+    while (rcu_gp_poll() < target) {
+        // Also our own quiescent state (schedule notes it)
+        sched_yield();
+        __asm__ volatile("pause");
+    }
+}
+
+// 3. Callbacks
+static void rcu_poll_expired(void* ctx) {
+    (void)ctx;
+    softirq_raise(SOFTIRQ_RCU);
+}
+
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head)) {
+    head->func = func;
+    head->next = NULL;
+
+    uint64_t flags = irq_save();
+    struct rcu_cpu* rc = &rcu_cpus[cpu_id()];
+    head->gp = rcu_gp_request();
+
+    *rc->tail = head;
+    rc->tail = &head->next;
+    if (rc->pending++ == 0) {
+        timer_arm(&rc->poll, ktime_get_ns() + RCU_POLL_NS, rcu_poll_expired, NULL);
+    }
+    irq_restore(flags);
+}
+
+// Softirq: run the callbacks whose grace period is over, keep polling
+// while others wait
+static void rcu_softirq(void) {
+    uint64_t completed = rcu_gp_poll();
+
+    // A. Detach the finished ones
+    uint64_t flags = irq_save();
+    struct rcu_cpu* rc = &rcu_cpus[cpu_id()];
+    struct rcu_head* done = NULL;
+    struct rcu_head** done_tail = &done;
+    uint64_t count = 0;
+    while (rc->head && rc->head->gp <= completed) {
+        *done_tail = rc->head;
+        done_tail = &rc->head->next;
+        rc->head = rc->head->next;
+        count++;
+    }
+    *done_tail = NULL;
+    if (!rc->head) rc->tail = &rc->head;
+    rc->pending -= count;
+    rc->invoked += count;
+    if (rc->pending) {
+        timer_arm(&rc->poll, ktime_get_ns() + RCU_POLL_NS, rcu_poll_expired, NULL);
+    }
+    irq_restore(flags);
+
+    // B. Run them with interrupts enabled
+    while (done) {
+        struct rcu_head* next = done->next;
+        done->func(done);
+        done = next;
+    }
+}
+
+// 4. Statistics and Initialization
+void rcu_get_stats(struct rcu_stats* stats) {
+    stats->grace_periods = gp.completed;
+    stats->kicks = gp.kicks;
+    stats->cbs_pending = stats->cbs_invoked = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        stats->cbs_pending += rcu_cpus[i].pending;
+        stats->cbs_invoked += rcu_cpus[i].invoked;
+    }
+}
+
+void rcu_init(void) {
+    spin_lock_init(&gp.lock, "rcu_gp");
+    for (int i = 0; i < MAX_CPUS; i++) rcu_cpus[i].tail = &rcu_cpus[i].head;
+    softirq_register(SOFTIRQ_RCU, rcu_softirq);
+    terminal_writestring("[RCU] Grace periods from context switches and idle.\n");
+}
@@ -0,0 +1,97 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdint.h>
+#include "preempt.h"
+#include "../arch/x86_64/cpu.h"
+
+// --- Read-Copy-Update ---
+// For read-mostly data: readers take no lock and write nothing shared,
+// writers publish a new version and free the old one only after every
+// CPU has gone through a quiescent state (a context switch, or halting in
+// the idle loop). A read-side section is a preemption-disabled section,
+// so no reader can span a quiescent state.
+//
+//     rcu_read_lock();                    // writer (serialised by its own lock):
+//     p = rcu_dereference(table);         //     rcu_assign_pointer(table, new);
+//     ... use p, never block ...          //     call_rcu(&old->rcu, free_old);
+//     rcu_read_unlock();                  //     (or synchronize_rcu(); kfree(old);)
+//
+// Interrupt handlers already run with preemption disabled: they may read
+// without rcu_read_lock.
+
+// How often a CPU with callbacks waiting checks the grace period
+#define RCU_POLL_NS     1000000ULL      // 1ms
+// Grace period age after which CPUs still running are sent a reschedule IPI
+#define RCU_KICK_NS     1000000ULL      // 1ms
+
+// Deferred callback, embedded in the object it frees
+struct rcu_head {
+    struct rcu_head* next;
+    void (*func)(struct rcu_head* head);
+    uint64_t gp;                        // Grace period it waits for
+};
+
+// 1. Read Side
+static inline void rcu_read_lock(void) {
+    preempt_disable();
+}
+
+static inline void rcu_read_unlock(void) {
+    preempt_enable();
+}
+
+// Load a pointer published with rcu_assign_pointer (a plain load on x86)
+#define rcu_dereference(p)          __atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+// Publish a pointer: everything written to the object before is visible
+// to readers that see it
+#define rcu_assign_pointer(p, v)    __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+// 2. Quiescent States (scheduler and idle loop)
+// This CPU is outside any read-side section (single GS-relative add)
+static inline void rcu_note_qs(void) {
+    __asm__ volatile("incq %%gs:%c0" :: "i"(offsetof(struct cpu, rcu_qs)) : "memory");
+}
+
+// Halting with interrupts about to be enabled: rcu_idle becomes odd
+static inline void rcu_idle_enter(void) {
+    __asm__ volatile("incq %%gs:%c0" :: "i"(offsetof(struct cpu, rcu_idle)) : "memory");
+}
+
+// Woken: rcu_idle becomes even again. Called on interrupt entry and after
+// the halt, whichever comes first. The locked exchange orders it before
+// any read-side access that follows.
+static inline void rcu_idle_exit(void) {
+    volatile uint64_t* idle = &this_cpu()->rcu_idle;
+    uint64_t value = *idle;
+    if (value & 1) {
+        __atomic_compare_exchange_n(idle, &value, value + 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+}
+
+// 3. Update Side
+// Wait until every read-side section that started before the call has
+// ended (threads only: it yields the CPU while waiting)
+void synchronize_rcu(void);
+
+// Run func(head) after a grace period, on this CPU, from a softirq.
+// Safe from any context. Callbacks may kfree (the heap takes its own
+// locks on every CPU) but must not sleep.
+void call_rcu(struct rcu_head* head, void (*func)(struct rcu_head* head));
+
+// Counters for the shell
+struct rcu_stats {
+    uint64_t grace_periods;     // Completed
+    uint64_t cbs_pending;       // Queued, grace period not over yet
+    uint64_t cbs_invoked;
+    uint64_t kicks;             // Reschedule IPIs sent to end a grace period
+};
+
+void rcu_get_stats(struct rcu_stats* stats);
+
+// Install the callback softirq (after sched_init)
+void rcu_init(void);
+
+#endif
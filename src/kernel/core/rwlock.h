@@ -0,0 +1,119 @@
+#ifndef RWLOCK_H
+#define RWLOCK_H
+
+#include <stdint.h>
+#include "lockstat.h"
+#include "preempt.h"
+#include "../arch/x86_64/irqflags.h"
+
+// --- Reader-Writer Spinlock ---
+// Any number of readers, or one writer. A waiting writer sets
+// RWLOCK_WAITING, which stops new readers from entering, so a steady
+// stream of readers cannot starve it. One word: the reader count in the
+// low bits, the two flags on top.
+#define RWLOCK_WRITER   0x80000000u
+#define RWLOCK_WAITING  0x40000000u
+
+struct rwlock {
+    volatile uint32_t value;
+    LOCKSTAT_FIELD
+};
+
+#define RWLOCK_INIT(name) { 0, LOCKSTAT_INIT(name, LOCK_KIND_RW) }
+
+static inline void rwlock_init(struct rwlock* lock, const char* name) {
+    lock->value = 0;
+    lockstat_name(lock, name, LOCK_KIND_RW);
+}
+
+// 1. Readers
+static inline void read_acquire(struct rwlock* lock) {
+    uint64_t spin_start = 0;
+    for (;;) {
+        uint32_t value = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+        if (!(value & (RWLOCK_WRITER | RWLOCK_WAITING)) &&
+            __atomic_compare_exchange_n(&lock->value, &value, value + 1, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (!spin_start) spin_start = lockstat_clock();
+        __asm__ volatile("pause");
+    }
+    lockstat_acquired_shared(&lock->stat, spin_start);
+}
+
+static inline void read_release(struct rwlock* lock) {
+    __atomic_fetch_sub(&lock->value, 1, __ATOMIC_RELEASE);
+}
+
+static inline void read_lock(struct rwlock* lock) {
+    preempt_disable();
+    read_acquire(lock);
+}
+
+static inline void read_unlock(struct rwlock* lock) {
+    read_release(lock);
+    preempt_enable();
+}
+
+// 2. Writers
+static inline void write_acquire(struct rwlock* lock) {
+    uint64_t spin_start = 0;
+    for (;;) {
+        // No readers, no writer (our own WAITING bit may be set)
+        uint32_t value = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+        if ((value & ~RWLOCK_WAITING) == 0 &&
+            __atomic_compare_exchange_n(&lock->value, &value, RWLOCK_WRITER, 1,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        if (!(value & RWLOCK_WAITING)) {
+            __atomic_fetch_or(&lock->value, RWLOCK_WAITING, __ATOMIC_RELAXED);
+        }
+        if (!spin_start) spin_start = lockstat_clock();
+        __asm__ volatile("pause");
+    }
+    lockstat_acquired(&lock->stat, spin_start);
+}
+
+// Keeps a WAITING bit set meanwhile by another writer
+static inline void write_release(struct rwlock* lock) {
+    __atomic_fetch_and(&lock->value, ~RWLOCK_WRITER, __ATOMIC_RELEASE);
+}
+
+static inline void write_lock(struct rwlock* lock) {
+    preempt_disable();
+    write_acquire(lock);
+}
+
+static inline void write_unlock(struct rwlock* lock) {
+    write_release(lock);
+    preempt_enable();
+}
+
+// 3. Interrupt-saving variants
+static inline uint64_t read_lock_irqsave(struct rwlock* lock) {
+    uint64_t flags = irq_save();
+    read_lock(lock);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(struct rwlock* lock, uint64_t flags) {
+    read_release(lock);
+    irq_restore(flags);
+    preempt_enable();
+}
+
+static inline uint64_t write_lock_irqsave(struct rwlock* lock) {
+    uint64_t flags = irq_save();
+    write_lock(lock);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(struct rwlock* lock, uint64_t flags) {
+    write_release(lock);
+    irq_restore(flags);
+    preempt_enable();
+}
+
+#endif
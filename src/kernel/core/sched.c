@@ -0,0 +1,508 @@
+#include "sched.h"
+#include "spinlock.h"
+#include "rcu.h"
+#include "../arch/x86_64/cpu.h"
+#include "../arch/x86_64/fpu.h"
+#include "../arch/x86_64/irq.h"
+#include "../arch/x86_64/irqflags.h"
+#include "../drivers/apic.h"
+#include "../drivers/irqchip.h"
+#include "../drivers/vga.h"
+#include "../memory/heap.h"
+#include "../time/timer.h"
+
+// Defined in switch.asm
+extern struct thread* switch_context(struct thread* prev, struct thread* next);
+extern void thread_start(void);
+
+// --- Run Queue ---
+// One per CPU, each on its own cache lines. A CPU only takes its own lock
+// to switch; other CPUs take it to hand over a wakeup or to steal, and
+// read nr_queued without it to find the busiest queue.
+struct runqueue {
+    struct spinlock lock;
+    struct thread* head;            // FIFO: round robin
+    struct thread* tail;
+    volatile uint32_t nr_queued;
+    struct thread idle;             // The CPU's boot context
+    struct timer slice;             // Ends the running thread's time slice
+    uint64_t switches;
+    uint64_t preemptions;
+    uint64_t steals;
+} __attribute__((aligned(64)));
+
+static struct runqueue runqueues[MAX_CPUS];
+
+// Exited threads: their stacks are freed by sched_reap
+static struct thread* dead_threads = NULL;
+static struct spinlock dead_lock = SPINLOCK_INIT("sched_dead");
+
+static uint32_t next_tid = 1;
+static int sched_ready = 0;
+
+// 1. Run Queue Helpers (lock held)
+static void rq_push(struct runqueue* rq, struct thread* thread) {
+    thread->next = NULL;
+    if (rq->tail) {
+        rq->tail->next = thread;
+    } else {
+        rq->head = thread;
+    }
+    rq->tail = thread;
+    rq->nr_queued++;
+}
+
+// Unlink the first thread whose registers are saved. A thread that was
+// woken or requeued while still switching out is skipped, unless it is
+// 'self' (the owning CPU's own current thread).
+static struct thread* rq_pop(struct runqueue* rq, struct thread* self) {
+    struct thread* prev = NULL;
+    for (struct thread* thread = rq->head; thread; prev = thread, thread = thread->next) {
+        if (thread->on_cpu && thread != self) continue;
+
+        if (prev) {
+            prev->next = thread->next;
+        } else {
+            rq->head = thread->next;
+        }
+        if (rq->tail == thread) rq->tail = prev;
+        rq->nr_queued--;
+        thread->next = NULL;
+        return thread;
+    }
+    return NULL;
+}
+
+static int cpu_is_idle(uint32_t cpu) {
+    return cpus[cpu].online && cpus[cpu].current == &runqueues[cpu].idle;
+}
+
+// Make a CPU go through the scheduler soon
+void sched_kick(uint32_t cpu) {
+    if (cpu == cpu_id()) {
+        this_cpu()->need_resched = 1;
+    } else if (irqchip_uses_apic()) {
+        lapic_send_ipi(cpus[cpu].apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | SCHED_IPI_VECTOR);
+    }
+}
+
+/**
+ * @brief Queue a runnable thread on its CPU and get it running soon.
+ *
+ * An idle owner is kicked directly. A busy owner keeps the thread until
+ * its time slice ends, unless another CPU is idle: that one is kicked and
+ * steals it.
+ *
+ * @param[in] thread Thread to queue (state already THREAD_RUNNABLE)
+ * @param[in] rq     Run queue of thread->cpu, locked by the caller
+ */
+static void rq_activate(struct thread* thread, struct runqueue* rq) {
+    uint32_t cpu = thread->cpu;
+    rq_push(rq, thread);
+    spin_unlock(&rq->lock);
+
+    if (cpu_is_idle(cpu)) {
+        sched_kick(cpu);
+        return;
+    }
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (i != cpu && cpu_is_idle(i)) {
+            sched_kick(i);
+            return;
+        }
+    }
+}
+
+// Lock the run queue a thread belongs to. Stealing changes thread->cpu
+// under the old queue's lock, so re-check once it is held.
+static struct runqueue* rq_lock_thread(struct thread* thread) {
+    for (;;) {
+        uint32_t cpu = thread->cpu;
+        spin_lock(&runqueues[cpu].lock);
+        if (thread->cpu == cpu) return &runqueues[cpu];
+        spin_unlock(&runqueues[cpu].lock);
+    }
+}
+
+// 2. Work Stealing
+// Take the oldest waiting thread of the busiest other queue. Only one
+// lock is held at a time, so stealing CPUs cannot deadlock.
+static struct thread* sched_steal(uint32_t self) {
+    uint32_t victim = self;
+    uint32_t most = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (i != self && runqueues[i].nr_queued > most) {
+            most = runqueues[i].nr_queued;
+            victim = i;
+        }
+    }
+    if (victim == self) return NULL;
+
+    struct runqueue* rq = &runqueues[victim];
+    spin_lock(&rq->lock);
+    struct thread* thread = rq_pop(rq, NULL);
+    if (thread) thread->cpu = self;
+    spin_unlock(&rq->lock);
+
+    if (thread) runqueues[self].steals++;
+    return thread;
+}
+
+// Anything queued, here or stealable elsewhere
+static int sched_has_work(void) {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (runqueues[i].nr_queued) return 1;
+    }
+    return 0;
+}
+
+// 3. Switching
+static void sched_slice_expired(void* ctx) {
+    (void)ctx;
+    this_cpu()->need_resched = 1;
+}
+
+// Runs on the next thread's stack, right after switch_context
+static void sched_finish_switch(struct thread* prev) {
+    // Registers saved: other CPUs may steal it from now on
+    __atomic_store_n(&prev->on_cpu, 0, __ATOMIC_RELEASE);
+
+    if (prev->state == THREAD_DEAD) {
+        spin_lock(&dead_lock);
+        prev->next = dead_threads;
+        dead_threads = prev;
+        spin_unlock(&dead_lock);
+    }
+}
+
+/**
+ * @brief Pick the next thread of this CPU and switch to it.
+ *
+ * A running thread goes to the back of the queue (round robin); a blocked
+ * or dead one does not. A thread preempted between sched_prepare_block
+ * and sched_block is requeued too: it has not re-checked its wait
+ * condition yet. An empty queue makes the CPU steal, and failing that,
+ * run its idle thread. Either way this CPU is outside any RCU read-side
+ * section, which counts as a quiescent state.
+ *
+ * @param[in] preempted Non-zero for an involuntary switch (statistics)
+ */
+static void schedule(int preempted) {
+    struct cpu* cpu = this_cpu();
+    struct runqueue* rq = &runqueues[cpu->id];
+    struct thread* prev = cpu->current;
+
+    rcu_note_qs();
+
+    // A. Requeue prev, take the next thread from our own queue
+    spin_lock(&rq->lock);
+    cpu->need_resched = 0;
+    if (!prev->idle && (prev->state == THREAD_RUNNING ||
+                        (preempted && prev->state == THREAD_BLOCKED))) {
+        prev->state = THREAD_RUNNABLE;
+        rq_push(rq, prev);
+    }
+    struct thread* next = rq_pop(rq, prev);
+    spin_unlock(&rq->lock);
+
+    // B. Nothing here: steal, else idle
+    if (!next) next = sched_steal(cpu->id);
+    if (!next) next = &rq->idle;
+    next->state = THREAD_RUNNING;
+
+    // C. Time slice (the idle thread runs until there is work)
+    uint64_t now = ktime_get_ns();
+    if (next->idle) {
+        timer_cancel(&rq->slice);
+    } else if (next != prev || preempted) {
+        timer_arm(&rq->slice, now + SCHED_SLICE_NS, sched_slice_expired, NULL);
+    }
+    if (next == prev) return;
+
+    // D. Switch
+    prev->runtime_ns += now - prev->switched_in_ns;
+    next->switched_in_ns = now;
+    next->on_cpu = 1;
+    cpu->current = next;
+    rq->switches++;
+    if (preempted && !prev->idle) rq->preemptions++;
+
+    fpu_switch_out(prev);
+    prev = switch_context(prev, next);
+    sched_finish_switch(prev);
+}
+
+// Called from switch.asm: the first time a new thread runs
+void sched_thread_start(struct thread* prev, struct thread* self) {
+    sched_finish_switch(prev);
+    irq_enable();
+    self->entry(self->arg);
+    thread_exit();
+}
+
+// 4. Preemption
+void preempt_schedule(void) {
+    uint64_t flags = irq_save();
+    struct cpu* cpu = this_cpu();
+
+    // Never switch out of a section that disabled interrupts itself
+    if ((flags & (1 << 9)) && sched_ready && cpu->preempt_count == 0 && cpu->need_resched) {
+        schedule(1);
+    }
+    irq_restore(flags);
+}
+
+void preempt_schedule_irq(void) {
+    struct cpu* cpu = this_cpu();
+    if (sched_ready && cpu->current && cpu->preempt_count == 0 && cpu->need_resched) {
+        schedule(1);
+    }
+}
+
+static int sched_ipi_interrupt(void* ctx) {
+    (void)ctx;
+    this_cpu()->need_resched = 1;
+    return IRQ_HANDLED;
+}
+
+// 5. Threads
+/**
+ * @brief Create a kernel thread and queue it.
+ *
+ * The new stack holds a switch_context frame whose return address is
+ * thread_start, with the thread in RBX. The thread goes to the least
+ * loaded CPU, the boot CPU last since it also runs the shell.
+ *
+ * @param[in] name  Name for statistics (not copied)
+ * @param[in] entry Thread body (returning ends the thread)
+ * @param[in] arg   Passed to entry
+ * @return struct thread* The thread, or NULL when out of memory
+ */
+struct thread* thread_create(const char* name, thread_fn entry, void* arg) {
+    struct thread* thread = kmalloc(sizeof(struct thread));
+    if (!thread) return NULL;
+    thread->stack = kmalloc(SCHED_STACK_SIZE);
+    thread->fpu_state = fpu_alloc_state();
+    if (!thread->stack || !thread->fpu_state) {
+        kfree(thread->stack);
+        fpu_free_state(thread->fpu_state);
+        kfree(thread);
+        return NULL;
+    }
+
+    // A. Initial frame: r15, r14, r13, r12, rbx, rbp, return address.
+    // thread_start runs with RSP 16-byte aligned, so its call into C sees
+    // the usual ABI alignment.
+    uint64_t* frame = (uint64_t*)((uint8_t*)thread->stack + SCHED_STACK_SIZE) - 9;
+    for (int i = 0; i < 9; i++) frame[i] = 0;
+    frame[4] = (uint64_t)thread;
+    frame[6] = (uint64_t)thread_start;
+
+    thread->rsp = (uint64_t)frame;
+    thread->state = THREAD_RUNNABLE;
+    thread->on_cpu = 0;
+    thread->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    thread->idle = 0;
+    thread->name = name;
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->runtime_ns = 0;
+    thread->switched_in_ns = 0;
+    thread->sleep_timer.armed = 0;
+    thread->fpu_cpu = FPU_CPU_NONE;
+
+    // B. Least loaded CPU: queued threads, plus one if it is busy
+    uint32_t best = 0;
+    uint32_t best_load = UINT32_MAX;
+    for (uint32_t n = 1; n <= MAX_CPUS; n++) {
+        uint32_t i = n % MAX_CPUS;
+        if (!cpus[i].online) continue;
+        uint32_t load = runqueues[i].nr_queued + !cpu_is_idle(i);
+        if (load < best_load) {
+            best_load = load;
+            best = i;
+        }
+    }
+
+    // C. Queue it
+    uint64_t flags = irq_save();
+    thread->cpu = best;
+    spin_lock(&runqueues[best].lock);
+    rq_activate(thread, &runqueues[best]);
+    irq_restore(flags);
+    return thread;
+}
+
+void thread_exit(void) {
+    irq_disable();
+    this_cpu()->current->state = THREAD_DEAD;
+    schedule(0);
+    for (;;) __asm__ volatile("hlt");   // Never resumed
+}
+
+struct thread* sched_current(void) {
+    return this_cpu()->current;
+}
+
+void sched_yield(void) {
+    uint64_t flags = irq_save();
+    schedule(0);
+    irq_restore(flags);
+}
+
+// 6. Blocking
+void sched_prepare_block(void) {
+    uint64_t flags = irq_save();
+    this_cpu()->current->state = THREAD_BLOCKED;
+    irq_restore(flags);
+}
+
+void sched_block(void) {
+    uint64_t flags = irq_save();
+
+    // Blocked: sleep. Woken already: it is queued again, so go through the
+    // scheduler to be taken off the queue. Running: preempted and
+    // requeued in between, the caller re-checks its condition.
+    if (this_cpu()->current->state != THREAD_RUNNING) schedule(0);
+    irq_restore(flags);
+}
+
+void sched_end_block(void) {
+    uint64_t flags = irq_save();
+    struct thread* self = this_cpu()->current;
+    struct runqueue* rq = &runqueues[self->cpu];
+
+    // Under the queue lock: a waker checks the state holding it too
+    spin_lock(&rq->lock);
+    int woken = self->state == THREAD_RUNNABLE;
+    if (self->state == THREAD_BLOCKED) self->state = THREAD_RUNNING;
+    spin_unlock(&rq->lock);
+
+    if (woken) schedule(0);
+    irq_restore(flags);
+}
+
+int sched_wakeup(struct thread* thread) {
+    uint64_t flags = irq_save();
+    struct runqueue* rq = rq_lock_thread(thread);
+
+    if (thread->state != THREAD_BLOCKED) {
+        spin_unlock(&rq->lock);
+        irq_restore(flags);
+        return 0;
+    }
+    thread->state = THREAD_RUNNABLE;
+    rq_activate(thread, rq);
+    irq_restore(flags);
+    return 1;
+}
+
+// Sleep timer progress: the sleeper wakes on FIRED, but the callback
+// still touches it until DONE
+#define SLEEP_ARMED 0
+#define SLEEP_FIRED 1
+#define SLEEP_DONE  2
+
+static void sched_sleep_expired(void* ctx) {
+    struct thread* thread = ctx;
+    __atomic_store_n(&thread->sleep_state, SLEEP_FIRED, __ATOMIC_SEQ_CST);
+    sched_wakeup(thread);
+    __atomic_store_n(&thread->sleep_state, SLEEP_DONE, __ATOMIC_RELEASE);
+}
+
+void sched_sleep_ns(uint64_t ns) {
+    struct thread* self = sched_current();
+
+    // The timer fires on the CPU it was armed on, even if we move: wait
+    // for its callback to be done with us, not just for the deadline.
+    // 'armed' is cleared before the callback runs, so it cannot tell.
+    self->sleep_state = SLEEP_ARMED;
+    timer_arm(&self->sleep_timer, ktime_get_ns() + ns, sched_sleep_expired, self);
+    for (;;) {
+        sched_prepare_block();
+        if (__atomic_load_n(&self->sleep_state, __ATOMIC_SEQ_CST) != SLEEP_ARMED) break;
+        sched_block();
+    }
+    sched_end_block();
+
+    // Only the tail of sched_wakeup is left: the callback runs with
+    // interrupts off, so this never waits long
+    while (__atomic_load_n(&self->sleep_state, __ATOMIC_ACQUIRE) != SLEEP_DONE) {
+        __asm__ volatile("pause");
+    }
+}
+
+// 7. Idle
+void sched_idle(void) {
+    irq_disable();
+    if (sched_ready && sched_has_work()) {
+        schedule(0);
+        irq_enable();
+        return;
+    }
+
+    // "sti; hlt" is atomic: a wakeup IPI cannot slip in between.
+    // Halted, the CPU holds up no RCU grace period.
+    rcu_idle_enter();
+    irqoff_end();
+    __asm__ volatile("sti; hlt" ::: "memory");
+    rcu_idle_exit();
+}
+
+void sched_reap(void) {
+    uint64_t flags = irq_save();
+    spin_lock(&dead_lock);
+    struct thread* list = dead_threads;
+    dead_threads = NULL;
+    spin_unlock(&dead_lock);
+    irq_restore(flags);
+
+    while (list) {
+        struct thread* next = list->next;
+        kfree(list->stack);
+        fpu_free_state(list->fpu_state);
+        kfree(list);
+        list = next;
+    }
+}
+
+// 8. Initialization
+void sched_init_cpu(void) {
+    struct cpu* cpu = this_cpu();
+    struct thread* idle = &runqueues[cpu->id].idle;
+
+    idle->state = THREAD_RUNNING;
+    idle->on_cpu = 1;
+    idle->tid = 0;
+    idle->cpu = cpu->id;
+    idle->idle = 1;
+    idle->name = "idle";
+    idle->fpu_state = NULL;     // Kernel code never uses the FPU
+    idle->fpu_cpu = FPU_CPU_NONE;
+    idle->switched_in_ns = ktime_get_ns();
+    cpu->preempt_count = 0;
+    cpu->need_resched = 0;
+    cpu->rcu_qs = 0;
+    cpu->rcu_idle = 0;
+    cpu->current = idle;
+}
+
+void sched_init(void) {
+    for (int i = 0; i < MAX_CPUS; i++) spin_lock_init(&runqueues[i].lock, "runqueue");
+    irq_register(SCHED_IPI_VECTOR, sched_ipi_interrupt, NULL);
+    sched_init_cpu();
+    sched_ready = 1;
+    terminal_writestring("[SCHED] Per-CPU run queues ready.\n");
+}
+
+// 9. Statistics
+void sched_get_stats(uint32_t cpu, struct sched_stats* stats) {
+    struct runqueue* rq = &runqueues[cpu];
+    struct thread* current = cpus[cpu].current;
+
+    stats->queued = rq->nr_queued;
+    stats->switches = rq->switches;
+    stats->preemptions = rq->preemptions;
+    stats->steals = rq->steals;
+    stats->current = current ? current->name : "-";
+}
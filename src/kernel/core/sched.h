@@ -0,0 +1,107 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include "preempt.h"
+#include "../time/ktime.h"
+#include "../time/timer.h"
+
+// --- Tunables ---
+#define SCHED_SLICE_NS      (10 * NSEC_PER_MSEC)    // Time slice before preemption
+#define SCHED_STACK_SIZE    16384                   // Kernel stack of each thread
+#define SCHED_IPI_VECTOR    0xF1                    // IPI: reschedule (wake an idle CPU)
+
+// --- Thread ---
+enum thread_state {
+    THREAD_RUNNING,     // On a CPU
+    THREAD_RUNNABLE,    // In a run queue
+    THREAD_BLOCKED,     // Waiting for sched_wakeup
+    THREAD_DEAD         // Exited, waiting for sched_reap
+};
+
+typedef void (*thread_fn)(void* arg);
+
+struct thread {
+    uint64_t rsp;               // Saved stack pointer (first: switch.asm uses it)
+    volatile int state;         // enum thread_state
+    volatile int on_cpu;        // Registers still live on a CPU: not stealable yet
+    uint32_t tid;
+    uint32_t cpu;               // Run queue it belongs to (changed by stealing)
+    int idle;                   // Per-CPU idle thread (never queued)
+    const char* name;
+    thread_fn entry;
+    void* arg;
+    void* stack;                // Bottom of the kernel stack (kmalloc)
+    struct thread* next;        // Run queue / reap list link
+    uint64_t runtime_ns;        // Time spent on a CPU
+    uint64_t switched_in_ns;    // When it last got the CPU
+    struct timer sleep_timer;   // sched_sleep_ns
+    volatile int sleep_state;   // How far its callback got (SLEEP_*, sched.c)
+    void* fpu_state;            // FPU/SSE/AVX save area (NULL: idle threads)
+    uint32_t fpu_cpu;           // CPU whose registers last loaded it (lazy FPU)
+};
+
+// --- Statistics ---
+struct sched_stats {
+    uint32_t queued;            // Threads waiting in the run queue
+    uint64_t switches;          // Context switches on this CPU
+    uint64_t preemptions;       // Of which forced (time slice, wakeups)
+    uint64_t steals;            // Threads taken from other CPUs' queues
+    const char* current;        // Name of the running thread
+};
+
+// --- Function Prototypes ---
+
+// Set up the run queues and make the caller the boot CPU's idle thread
+// (after timer_init, before smp_init)
+void sched_init(void);
+
+// Make the caller this application processor's idle thread
+void sched_init_cpu(void);
+
+// Start a kernel thread on the least loaded CPU (from any CPU)
+// Returns the thread, or NULL when out of memory.
+struct thread* thread_create(const char* name, thread_fn entry, void* arg);
+
+// End the calling thread (also what returning from entry does)
+void thread_exit(void) __attribute__((noreturn));
+
+// Thread running on this CPU
+struct thread* sched_current(void);
+
+// Give the CPU to the next runnable thread, if any
+void sched_yield(void);
+
+// Make a CPU go through the scheduler soon (reschedule IPI, or just the
+// flag for this CPU)
+void sched_kick(uint32_t cpu);
+
+// Blocking, without losing a wakeup that races with the check:
+//     for (;;) {
+//         sched_prepare_block();
+//         if (condition) break;
+//         sched_block();
+//     }
+//     sched_end_block();
+void sched_prepare_block(void);
+void sched_block(void);
+void sched_end_block(void);
+
+// Make a blocked thread runnable (any CPU, interrupt context included)
+// Returns 1 if it was blocked, 0 otherwise.
+int sched_wakeup(struct thread* thread);
+
+// Block the calling thread for at least ns nanoseconds
+void sched_sleep_ns(uint64_t ns);
+
+// Body of the idle loops: run queued or stealable work, else halt until
+// the next interrupt
+void sched_idle(void);
+
+// Free the threads that exited (any CPU; the boot CPU's idle loop does it)
+void sched_reap(void);
+
+// Per-CPU counters for the shell
+void sched_get_stats(uint32_t cpu, struct sched_stats* stats);
+
+#endif
@@ -4,6 +4,21 @@
 #include "../drivers/keyboard.h"
 #include "../arch/x86_64/io.h"
 #include "../arch/x86_64/cpuid.h"
+#include "../arch/x86_64/smp.h"
+#include "../arch/x86_64/fpu.h"
+#include "../memory/pmm.h"
+#include "../memory/arena.h"
+#include "../memory/heap.h"
+#include "../memory/meminfo.h"
+#include "../time/ktime.h"
+#include "../time/timer.h"
+#include "irqstat.h"
+#include "lockstat.h"
+#include "rcu.h"
+#include "sched.h"
+
+// Scratch memory for the running command, dropped when it returns
+static struct arena scratch;
 
 // Helper: String Compare (returns 0 if equal)
 int strcmp(const char* s1, const char* s2) {
@@ -14,6 +29,44 @@ int strcmp(const char* s1, const char* s2) {
     return *(const unsigned char*)s1 - *(const unsigned char*)s2;
 }
 
+// Timer callback for 'sleep': flag the wait as over
+static void shell_wake(void* ctx) {
+    *(volatile int*)ctx = 1;
+}
+
+// Cross-CPU call for 'cpus': report which CPU actually ran it
+static void shell_ping(void* ctx) {
+    *(uint32_t*)ctx = cpu_id();
+}
+
+// 'sched bench': fixed amount of CPU work per thread
+#define SHELL_BENCH_LOOPS 200000000ULL
+static volatile uint32_t bench_done;
+
+static void shell_bench_thread(void* arg) {
+    (void)arg;
+    for (volatile uint64_t i = 0; i < SHELL_BENCH_LOOPS; i++) {
+    }
+    __atomic_fetch_add(&bench_done, 1, __ATOMIC_RELEASE);
+}
+
+// 'fpu test': each thread keeps a value in XMM0 across preemptions
+#define SHELL_FPU_ROUNDS 50
+static volatile uint32_t fpu_test_errors;
+
+static void shell_fpu_thread(void* arg) {
+    uint64_t pattern = (uint64_t)arg;
+    for (int round = 0; round < SHELL_FPU_ROUNDS; round++) {
+        uint64_t back;
+        __asm__ volatile("movq %0, %%xmm0" :: "r"(pattern));
+        for (volatile uint64_t i = 0; i < SHELL_BENCH_LOOPS / 100; i++) {
+        }
+        __asm__ volatile("movq %%xmm0, %0" : "=r"(back));
+        if (back != pattern) __atomic_fetch_add(&fpu_test_errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&bench_done, 1, __ATOMIC_RELEASE);
+}
+
 void power_reboot(void) {
     uint8_t good = 0x02;
     while (good & 0x02) {
@@ -23,12 +76,8 @@ void power_reboot(void) {
     __asm__ volatile("hlt");
 }
 
-// Execute the command in the buffer
-void shell_execute(void) {
-    terminal_writestring("Command: ");
-    terminal_writestring(keyboard_buffer);
-    terminal_writestring("\n");
-
+// Run the command in the buffer (may return early)
+static void shell_run_command(void) {
     if (strcmp(keyboard_buffer, "help") == 0) {
         terminal_writestring("--- Halo OS Help ---\n");
         terminal_writestring("  reboot      - Restart the computer\n");
@@ -36,6 +85,16 @@ void shell_execute(void) {
         terminal_writestring("  theme blue   - White on Blue\n");
         terminal_writestring("  theme error  - Red on Black\n");
         terminal_writestring("  cpu         - Show CPU Vendor\\n");
+        terminal_writestring("  cpus        - Online CPUs and IPI round trip\n");
+        terminal_writestring("  sched       - Run queues per CPU ('sched bench' runs 2 threads per CPU)\n");
+        terminal_writestring("  fpu         - Lazy FPU switching stats ('fpu test' checks XMM state)\n");
+        terminal_writestring("  zeropool    - Pre-zeroed page pool stats\n");
+        terminal_writestring("  meminfo     - Memory usage and fragmentation\n");
+        terminal_writestring("  uptime      - Time since boot\n");
+        terminal_writestring("  sleep       - Wait one second on a timer\n");
+        terminal_writestring("  irqstat     - Interrupt counts and latency ('irqstat reset')\n");
+        terminal_writestring("  lockstat    - Lock contention ('lockstat reset', needs LOCKSTAT=1)\n");
+        terminal_writestring("  rcu         - RCU grace periods and callbacks\n");
         terminal_writestring("  clear       - Clear screen\n");
     } 
     // --- REBOOT ---
@@ -76,6 +135,319 @@ void shell_execute(void) {
         terminal_writestring(vendor);
         terminal_writestring("\n");
     }
+    // --- CPUS COMMAND ---
+    else if (strcmp(keyboard_buffer, "cpus") == 0) {
+        terminal_writedec(smp_cpu_count());
+        terminal_writestring(" CPU(s) online\n");
+        for (uint32_t i = 0; i < smp_cpu_slots(); i++) {
+            uint32_t ran_on = MAX_CPUS;
+            uint64_t start = ktime_get_ns();
+            int ok = smp_call(i, shell_ping, &ran_on);
+            uint64_t elapsed = ktime_get_ns() - start;
+
+            terminal_writestring("CPU ");
+            terminal_writedec(i);
+            terminal_writestring("  APIC ID ");
+            terminal_writedec(cpus[i].apic_id);
+            if (ok != 0 || ran_on != i) {
+                terminal_writestring("  no answer\n");
+                continue;
+            }
+            terminal_writestring("  call ");
+            terminal_writedec(elapsed);
+            terminal_writestring(" ns\n");
+        }
+    }
+    // --- SCHED COMMAND ---
+    else if (strcmp(keyboard_buffer, "sched") == 0) {
+        terminal_writestring("CPU  Queued  Switches  Preempted  Stolen  Running\n");
+        for (uint32_t i = 0; i < smp_cpu_slots(); i++) {
+            struct sched_stats stats;
+            sched_get_stats(i, &stats);
+
+            terminal_writedec(i);
+            terminal_writestring("    ");
+            terminal_writedec(stats.queued);
+            terminal_writestring("  ");
+            terminal_writedec(stats.switches);
+            terminal_writestring("  ");
+            terminal_writedec(stats.preemptions);
+            terminal_writestring("  ");
+            terminal_writedec(stats.steals);
+            terminal_writestring("  ");
+            terminal_writestring(stats.current);
+            terminal_writestring("\n");
+        }
+    }
+    else if (strcmp(keyboard_buffer, "sched bench") == 0) {
+        uint32_t count = smp_cpu_count() * 2;
+        uint32_t started = 0;
+        bench_done = 0;
+
+        // The shell is this CPU's idle thread: it runs the workers too
+        uint64_t start = ktime_get_ns();
+        for (uint32_t i = 0; i < count; i++) {
+            if (thread_create("bench", shell_bench_thread, NULL)) started++;
+        }
+        while (bench_done < started) sched_idle();
+        uint64_t elapsed = ktime_get_ns() - start;
+        sched_reap();
+
+        terminal_writedec(started);
+        terminal_writestring(" threads on ");
+        terminal_writedec(smp_cpu_count());
+        terminal_writestring(" CPU(s): ");
+        terminal_writedec(elapsed / NSEC_PER_MSEC);
+        terminal_writestring(" ms\n");
+    }
+    // --- FPU COMMAND ---
+    else if (strcmp(keyboard_buffer, "fpu") == 0) {
+        struct fpu_stats stats;
+        fpu_get_stats(&stats);
+
+        terminal_writestring("Save: ");
+        terminal_writestring(fpu_mode_names[fpu_get_mode()]);
+        terminal_writestring(", ");
+        terminal_writedec(fpu_state_size());
+        terminal_writestring(" bytes, XCR0 ");
+        terminal_writehex(fpu_get_xcr0());
+        terminal_writestring("\nTraps:    ");
+        terminal_writedec(stats.traps);
+        terminal_writestring("\nSaves:    ");
+        terminal_writedec(stats.saves);
+        terminal_writestring("\nRestores: ");
+        terminal_writedec(stats.restores);
+        terminal_writestring("\nReused:   ");
+        terminal_writedec(stats.reuses);
+        terminal_writestring("\n");
+    }
+    else if (strcmp(keyboard_buffer, "fpu test") == 0) {
+        uint32_t count = smp_cpu_count() * 2;
+        uint32_t started = 0;
+        bench_done = 0;
+        fpu_test_errors = 0;
+
+        // Twice as many threads as CPUs: they get preempted mid-round
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t pattern = 0x5A5A000000000000ULL | (i + 1);
+            if (thread_create("fpu", shell_fpu_thread, (void*)pattern)) started++;
+        }
+        while (bench_done < started) sched_idle();
+        sched_reap();
+
+        terminal_writedec(started);
+        terminal_writestring(" threads, ");
+        terminal_writedec(fpu_test_errors);
+        terminal_writestring(" corrupted rounds\n");
+    }
+    // --- ZERO POOL COMMAND ---
+    else if (strcmp(keyboard_buffer, "zeropool") == 0) {
+        struct pmm_zero_pool_stats stats;
+        pmm_get_zero_pool_stats(&stats);
+
+        terminal_writestring("Zeroed frames: ");
+        terminal_writedec(stats.count);
+        terminal_writestring(" / ");
+        terminal_writedec(stats.capacity);
+        terminal_writestring("\nPool hits:     ");
+        terminal_writedec(stats.hits);
+        terminal_writestring("\nPool misses:   ");
+        terminal_writedec(stats.misses);
+        terminal_writestring("\n");
+    }
+    // --- MEMINFO COMMAND ---
+    else if (strcmp(keyboard_buffer, "meminfo") == 0) {
+        struct meminfo* info = arena_alloc(&scratch, sizeof(struct meminfo), 0);
+        if (!info) {
+            terminal_writestring("Out of memory.\n");
+            return;
+        }
+        meminfo_collect(info);
+
+        // 1. Totals
+        terminal_writestring("Frames free:  ");
+        terminal_writedec(info->free_frames);
+        terminal_writestring(" / ");
+        terminal_writedec(info->total_frames);
+        terminal_writestring(" (");
+        terminal_writedec(info->cached_frames);
+        terminal_writestring(" in magazines, ");
+        terminal_writedec(info->zeroed_frames);
+        terminal_writestring(" zeroed)\n");
+
+        // 2. Per memory map region
+        for (int i = 0; i < info->region_count; i++) {
+            terminal_writestring("  ");
+            terminal_writehex(info->regions[i].start);
+            terminal_writestring("-");
+            terminal_writehex(info->regions[i].end);
+            terminal_writestring(" free ");
+            terminal_writedec(info->regions[i].free_frames);
+            terminal_writestring(" used ");
+            terminal_writedec(info->regions[i].used_frames);
+            terminal_writestring("\n");
+        }
+
+        // 3. Fragmentation: largest run, then runs per 2^B bucket
+        terminal_writestring("Largest run:  ");
+        terminal_writedec(info->frag.largest_run);
+        terminal_writestring(" frames (");
+        terminal_writedec(info->frag.run_count);
+        terminal_writestring(" free runs)\nRun sizes:   ");
+        for (int b = 0; b < PMM_RUN_BUCKETS; b++) {
+            if (info->frag.runs[b] == 0) continue;
+            terminal_writestring(" ");
+            terminal_writedec(1ULL << b);
+            terminal_writestring(b == PMM_RUN_BUCKETS - 1 ? "+:" : ":");
+            terminal_writedec(info->frag.runs[b]);
+        }
+        terminal_writestring("\n");
+
+        // 4. Kernel consumers
+        terminal_writestring("Page tables:  ");
+        terminal_writedec(info->table_frames);
+        terminal_writestring("  Slabs: ");
+        terminal_writedec(info->slab_frames);
+        terminal_writestring("  Large: ");
+        terminal_writedec(info->large_frames);
+        terminal_writestring(" frames\n");
+
+        // 5. Heap caches in use (objects now / high water)
+        for (struct kmem_cache* cache = kmem_cache_list(); cache; cache = cache->next) {
+            if (cache->high_water == 0) continue;
+            terminal_writestring("  ");
+            terminal_writestring(cache->name);
+            terminal_writestring(" ");
+            terminal_writedec(cache->active_objs);
+            terminal_writestring(" / ");
+            terminal_writedec(cache->high_water);
+            terminal_writestring("\n");
+        }
+    }
+    // --- UPTIME COMMAND ---
+    else if (strcmp(keyboard_buffer, "uptime") == 0) {
+        uint64_t now = ktime_get_ns();
+        terminal_writestring("Up ");
+        terminal_writedec(now / NSEC_PER_SEC);
+        terminal_writestring(" s ");
+        terminal_writedec((now % NSEC_PER_SEC) / NSEC_PER_USEC);
+        terminal_writestring(" us, ");
+        terminal_writedec(timer_pending());
+        terminal_writestring(" timer(s) pending\n");
+    }
+    // --- SLEEP COMMAND ---
+    else if (strcmp(keyboard_buffer, "sleep") == 0) {
+        struct timer wake;
+        volatile int done = 0;
+        uint64_t start = ktime_get_ns();
+
+        // Nothing else is due: the CPU stays in hlt until the timer fires.
+        // "sti; hlt" is atomic, so the wakeup cannot slip in between.
+        timer_arm(&wake, start + NSEC_PER_SEC, shell_wake, (void*)&done);
+        __asm__ volatile("cli");
+        while (!done) __asm__ volatile("sti; hlt; cli");
+        __asm__ volatile("sti");
+
+        terminal_writestring("Slept ");
+        terminal_writedec((ktime_get_ns() - start) / NSEC_PER_USEC);
+        terminal_writestring(" us\n");
+    }
+    // --- IRQSTAT COMMAND ---
+    else if (strcmp(keyboard_buffer, "irqstat") == 0) {
+        // 1. One line per vector that fired, then its latency histogram
+        terminal_writestring("Vec  Count / Unhandled  Avg ns  Max ns\n");
+        for (int v = 0; v < 256; v++) {
+            const struct irqstat_vector* stat = irqstat_get(v);
+            if (stat->count == 0) continue;
+
+            terminal_writehex(v);
+            terminal_writestring("  ");
+            terminal_writedec(stat->count);
+            terminal_writestring(" / ");
+            terminal_writedec(stat->unhandled);
+            terminal_writestring("  ");
+            terminal_writedec(stat->total_ns / stat->count);
+            terminal_writestring("  ");
+            terminal_writedec(stat->max_ns);
+            terminal_writestring("\n    ns>=");
+            for (int b = 0; b < IRQSTAT_BUCKETS; b++) {
+                if (stat->hist[b] == 0) continue;
+                terminal_writestring(" ");
+                terminal_writedec(1ULL << b);
+                terminal_writestring(":");
+                terminal_writedec(stat->hist[b]);
+            }
+            terminal_writestring("\n");
+        }
+
+        // 2. Longest stretch with interrupts disabled
+        struct irqstat_irqoff irqoff;
+        irqstat_get_irqoff(&irqoff);
+        terminal_writestring("Max IRQs-off: ");
+        terminal_writedec(irqoff.max_ns);
+        terminal_writestring(" ns, ended at ");
+        terminal_writehex(irqoff.max_rip);
+        terminal_writestring("\n");
+    }
+    else if (strcmp(keyboard_buffer, "irqstat reset") == 0) {
+        irqstat_reset();
+        terminal_writestring("Interrupt statistics cleared.\n");
+    }
+    // --- LOCKSTAT COMMAND ---
+    else if (strcmp(keyboard_buffer, "lockstat") == 0) {
+#ifdef CONFIG_LOCKSTAT
+        // One line per lock taken since boot (or the last reset)
+        terminal_writestring("Lock        Kind  Acquired  Contended  Avg spin  Max spin (cycles)\n");
+        for (struct lockstat* stat = lockstat_list(); stat; stat = stat->next) {
+            if (stat->acquisitions == 0) continue;
+
+            terminal_writestring(stat->name ? stat->name : "?");
+            terminal_writestring("  ");
+            terminal_writestring(lockstat_kind_names[stat->kind]);
+            terminal_writestring("  ");
+            terminal_writedec(stat->acquisitions);
+            terminal_writestring("  ");
+            terminal_writedec(stat->contended);
+            terminal_writestring("  ");
+            terminal_writedec(stat->contended ? stat->spin_cycles / stat->contended : 0);
+            terminal_writestring("  ");
+            terminal_writedec(stat->max_spin_cycles);
+            terminal_writestring("\n");
+        }
+#else
+        terminal_writestring("Lock statistics are off: build with 'make LOCKSTAT=1'.\n");
+#endif
+    }
+    else if (strcmp(keyboard_buffer, "lockstat reset") == 0) {
+#ifdef CONFIG_LOCKSTAT
+        lockstat_reset();
+        terminal_writestring("Lock statistics cleared.\n");
+#else
+        terminal_writestring("Lock statistics are off: build with 'make LOCKSTAT=1'.\n");
+#endif
+    }
+    // --- RCU COMMAND ---
+    else if (strcmp(keyboard_buffer, "rcu") == 0) {
+        // 1. One full grace period, from here
+        uint64_t start = ktime_get_ns();
+        synchronize_rcu();
+        uint64_t elapsed = ktime_get_ns() - start;
+
+        // 2. Totals since boot
+        struct rcu_stats stats;
+        rcu_get_stats(&stats);
+        terminal_writestring("synchronize_rcu: ");
+        terminal_writedec(elapsed);
+        terminal_writestring(" ns\nGrace periods: ");
+        terminal_writedec(stats.grace_periods);
+        terminal_writestring("  Kick IPIs: ");
+        terminal_writedec(stats.kicks);
+        terminal_writestring("\nCallbacks pending: ");
+        terminal_writedec(stats.cbs_pending);
+        terminal_writestring("  invoked: ");
+        terminal_writedec(stats.cbs_invoked);
+        terminal_writestring("\n");
+    }
     // --- EXISTING COMMANDS ---
     else if (strcmp(keyboard_buffer, "clear") == 0) {
         terminal_initialize();
@@ -87,7 +459,11 @@ void shell_execute(void) {
         ata_identify_drive();
 
         // Create a buffer for 1 sector (512 bytes)
-        uint8_t sector_buf[512];
+        uint8_t* sector_buf = arena_alloc(&scratch, 512, 16);
+        if (!sector_buf) {
+            terminal_writestring("Out of memory.\n");
+            return;
+        }
         // Zero it out first to be sure
         for(int i=0; i<512; i++) sector_buf[i] = 0;
 
@@ -106,7 +482,11 @@ void shell_execute(void) {
     // --- NEW: DISK WRITE COMMAND ---
     else if (strcmp(keyboard_buffer, "disk write") == 0) {
         terminal_writestring("Writing to Sector 0...\n");
-        uint8_t sector_buf[512];
+        uint8_t* sector_buf = arena_alloc(&scratch, 512, 16);
+        if (!sector_buf) {
+            terminal_writestring("Out of memory.\n");
+            return;
+        }
         // 1. Fill buffer with a pattern
         const char* msg = "HALO OS ROCKS";
         for (int i = 0; i < 512; i++) sector_buf[i] = 0; // Clear
@@ -128,6 +508,18 @@ void shell_execute(void) {
     else {
         terminal_writestring("Unknown command. Type 'help'.\n");
     }
+}
+
+// Execute the command in the buffer
+void shell_execute(void) {
+    terminal_writestring("Command: ");
+    terminal_writestring(keyboard_buffer);
+    terminal_writestring("\n");
+
+    shell_run_command();
+
+    // Drop the command's scratch memory (the first chunk stays for the next one)
+    arena_reset(&scratch);
 
     // Reset buffer for next command
     keyboard_init();
@@ -0,0 +1,65 @@
+#include "softirq.h"
+#include "../arch/x86_64/cpu.h"
+#include "../arch/x86_64/irqflags.h"
+#include "preempt.h"
+
+static softirq_fn softirq_handlers[SOFTIRQ_COUNT];
+
+// Per-CPU state, only touched with interrupts disabled
+static volatile uint32_t pending_mask[MAX_CPUS];
+static int running[MAX_CPUS];
+
+void softirq_register(uint32_t nr, softirq_fn handler) {
+    if (nr < SOFTIRQ_COUNT) softirq_handlers[nr] = handler;
+}
+
+void softirq_raise(uint32_t nr) {
+    uint64_t flags = irq_save();
+    pending_mask[cpu_id()] |= 1u << nr;
+    irq_restore(flags);
+}
+
+int softirq_pending(void) {
+    return pending_mask[cpu_id()] != 0;
+}
+
+/**
+ * @brief Run the pending softirqs of this CPU.
+ *
+ * The pending mask is taken with interrupts disabled, then the handlers
+ * run with interrupts enabled, so devices keep interrupting (and raising
+ * more work) meanwhile. Interrupts that arrive during a handler see
+ * 'running' and leave their work to the loop below.
+ */
+void softirq_run(void) {
+    // Stay on this CPU: 'running' and the pending mask are per-CPU
+    preempt_disable();
+    uint64_t flags = irq_save();
+    uint32_t cpu = cpu_id();
+
+    if (running[cpu]) {
+        irq_restore(flags);
+        preempt_enable();
+        return;
+    }
+    running[cpu] = 1;
+
+    for (int round = 0; round < SOFTIRQ_MAX_ROUNDS && pending_mask[cpu]; round++) {
+        // 1. Claim everything raised so far
+        uint32_t pending = pending_mask[cpu];
+        pending_mask[cpu] = 0;
+
+        // 2. Run it with interrupts on
+        irq_enable();
+        while (pending) {
+            uint32_t nr = __builtin_ctz(pending);
+            pending &= pending - 1;
+            if (softirq_handlers[nr]) softirq_handlers[nr]();
+        }
+        irq_disable();
+    }
+
+    running[cpu] = 0;
+    irq_restore(flags);
+    preempt_enable();
+}
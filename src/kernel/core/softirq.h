@@ -0,0 +1,36 @@
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdint.h>
+
+// --- Softirq Numbers ---
+// Lower numbers run first. A top half (IRQ handler) only talks to the
+// hardware and raises its softirq; the slow part runs later with
+// interrupts enabled.
+#define SOFTIRQ_KEYBOARD    0       // Scancodes -> line buffer and console
+#define SOFTIRQ_RCU         1       // Callbacks whose grace period ended
+#define SOFTIRQ_COUNT       32
+
+// Rounds of newly raised softirqs handled in one go. Past this, the rest
+// waits for the idle loop, so an interrupt storm cannot starve the kernel.
+#define SOFTIRQ_MAX_ROUNDS  8
+
+typedef void (*softirq_fn)(void);
+
+// --- Function Prototypes ---
+
+// Install the handler of a softirq number
+void softirq_register(uint32_t nr, softirq_fn handler);
+
+// Mark a softirq pending on this CPU (safe from interrupt context)
+void softirq_raise(uint32_t nr);
+
+// Run this CPU's pending softirqs with interrupts enabled
+// Called on IRQ exit and from the idle loop. Does nothing when already
+// running further down the stack.
+void softirq_run(void);
+
+// Non-zero if this CPU has softirqs waiting
+int softirq_pending(void);
+
+#endif
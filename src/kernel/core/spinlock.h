@@ -0,0 +1,86 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include "lockstat.h"
+#include "preempt.h"
+#include "../arch/x86_64/irqflags.h"
+
+// --- Ticket Spinlock ---
+// Each CPU takes a ticket (one atomic add) and waits until 'owner'
+// reaches it, so the lock is granted in arrival order and no CPU starves.
+// Waiters only read 'owner', which changes once per release.
+// Holding a lock disables preemption. Use the _irqsave variants when an
+// interrupt handler on the same CPU may take the lock too.
+struct spinlock {
+    volatile uint32_t owner;    // Ticket being served
+    volatile uint32_t next;     // Next ticket handed out
+    LOCKSTAT_FIELD
+};
+
+#define SPINLOCK_INIT(name) { 0, 0, LOCKSTAT_INIT(name, LOCK_KIND_SPIN) }
+
+static inline void spin_lock_init(struct spinlock* lock, const char* name) {
+    lock->owner = 0;
+    lock->next = 0;
+    lockstat_name(lock, name, LOCK_KIND_SPIN);
+}
+
+// Acquire / release without touching preemption (callers below)
+static inline void spin_acquire(struct spinlock* lock) {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    uint64_t spin_start = 0;
+
+    if (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+        spin_start = lockstat_clock();
+        while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+            __asm__ volatile("pause");
+        }
+    }
+    lockstat_acquired(&lock->stat, spin_start);
+}
+
+static inline void spin_release(struct spinlock* lock) {
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+static inline void spin_lock(struct spinlock* lock) {
+    preempt_disable();
+    spin_acquire(lock);
+}
+
+static inline void spin_unlock(struct spinlock* lock) {
+    spin_release(lock);
+    preempt_enable();
+}
+
+// Returns 1 if the lock was taken, 0 if it is held elsewhere.
+// The lock is free when no ticket is outstanding (owner == next); then
+// only taking that ticket can change it.
+static inline int spin_trylock(struct spinlock* lock) {
+    preempt_disable();
+    uint32_t ticket = __atomic_load_n(&lock->next, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&lock->owner, __ATOMIC_RELAXED) == ticket &&
+        __atomic_compare_exchange_n(&lock->next, &ticket, ticket + 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        lockstat_acquired(&lock->stat, 0);
+        return 1;
+    }
+    preempt_enable();
+    return 0;
+}
+
+// Interrupts off on this CPU for as long as the lock is held
+static inline uint64_t spin_lock_irqsave(struct spinlock* lock) {
+    uint64_t flags = irq_save();
+    spin_lock(lock);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(struct spinlock* lock, uint64_t flags) {
+    spin_release(lock);
+    irq_restore(flags);
+    preempt_enable();
+}
+
+#endif
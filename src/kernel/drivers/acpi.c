@@ -0,0 +1,240 @@
+#include "acpi.h"
+#include <multiboot.h>
+#include "vga.h"
+#include "../memory/vmm.h"
+#include "../memory/physmap.h"
+#include "../memory/arena.h"
+
+// --- MADT Layout ---
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];          // Variable-length records: type, length, data
+} __attribute__((packed));
+
+#define MADT_PCAT_COMPAT        1   // flags: dual 8259 present
+
+#define MADT_TYPE_LAPIC         0
+#define MADT_TYPE_IOAPIC        1
+#define MADT_TYPE_OVERRIDE      2
+#define MADT_TYPE_LAPIC_ADDR    5
+#define MADT_TYPE_X2APIC        9
+
+#define MADT_LAPIC_ENABLED      1
+#define MADT_LAPIC_ONLINE_CAP   2   // Disabled, but may be brought online
+
+static const struct acpi_rsdp* rsdp = NULL;
+static struct acpi_madt_info* madt_info = NULL;  // In the boot arena
+
+// 1. Helpers
+static int acpi_checksum(const void* data, uint64_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint64_t i = 0; i < length; i++) sum += bytes[i];
+    return sum == 0;
+}
+
+static int acpi_signature_is(const char* a, const char* b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) return 0;
+    }
+    return 1;
+}
+
+// Tables may live outside RAM's direct map (e.g. above the last usable
+// frame): map the header first, then the whole table once its length is known.
+static const struct acpi_sdt_header* acpi_map_table(uint64_t phys) {
+    if (phys == 0) return NULL;
+    if (vmm_map_physical(phys, sizeof(struct acpi_sdt_header), PTE_PRESENT) != 0) return NULL;
+
+    const struct acpi_sdt_header* table = phys_to_virt(phys);
+    if (vmm_map_physical(phys, table->length, PTE_PRESENT) != 0) return NULL;
+
+    if (!acpi_checksum(table, table->length)) return NULL;
+    return table;
+}
+
+// 2. Finding the RSDP
+static const struct acpi_rsdp* acpi_check_rsdp(const void* candidate) {
+    const struct acpi_rsdp* r = (const struct acpi_rsdp*)candidate;
+    if (!acpi_signature_is(r->signature, "RSD PTR ", 8)) return NULL;
+    if (!acpi_checksum(r, 20)) return NULL;
+    if (r->revision >= 2 && !acpi_checksum(r, r->length)) return NULL;
+    return r;
+}
+
+// GRUB hands over a copy of the RSDP; prefer the 2.0+ one (XSDT)
+static const struct acpi_rsdp* acpi_rsdp_from_multiboot(uint64_t multiboot_addr) {
+    struct multiboot_tag* tag = (struct multiboot_tag*)phys_to_virt(multiboot_addr + 8);
+    const struct acpi_rsdp* found = NULL;
+
+    while (tag->type != 0) {
+        if (tag->type == MULTIBOOT_TAG_TYPE_ACPI_NEW ||
+            (tag->type == MULTIBOOT_TAG_TYPE_ACPI_OLD && !found)) {
+            const struct acpi_rsdp* r = acpi_check_rsdp((uint8_t*)tag + 8);
+            if (r) found = r;
+        }
+        tag = (struct multiboot_tag*) ((uint8_t*)tag + ((tag->size + 7) & ~7));
+    }
+    return found;
+}
+
+// Legacy BIOS: 16-byte aligned, in the first KB of the EBDA or in 0xE0000-0xFFFFF
+static const struct acpi_rsdp* acpi_rsdp_scan(uint64_t start, uint64_t end) {
+    for (uint64_t addr = start; addr + sizeof(struct acpi_rsdp) <= end; addr += 16) {
+        const struct acpi_rsdp* r = acpi_check_rsdp(phys_to_virt(addr));
+        if (r) return r;
+    }
+    return NULL;
+}
+
+static const struct acpi_rsdp* acpi_find_rsdp(uint64_t multiboot_addr) {
+    const struct acpi_rsdp* r = acpi_rsdp_from_multiboot(multiboot_addr);
+    if (r) return r;
+
+    uint64_t ebda = (uint64_t)(*(uint16_t*)phys_to_virt(0x40E)) << 4;
+    if (ebda >= 0x80000 && ebda < 0xA0000) {
+        r = acpi_rsdp_scan(ebda, ebda + 1024);
+        if (r) return r;
+    }
+    return acpi_rsdp_scan(0xE0000, 0x100000);
+}
+
+// 3. Table Lookup
+/**
+ * @brief Find an ACPI table through the XSDT (or RSDT on ACPI 1.0).
+ *
+ * @param[in] signature Four-character table signature, e.g. "APIC"
+ * @return const struct acpi_sdt_header* The table, or NULL if absent/corrupt
+ */
+const struct acpi_sdt_header* acpi_find_table(const char* signature) {
+    if (!rsdp) return NULL;
+
+    // A. Root table: 64-bit entries in the XSDT, 32-bit in the RSDT
+    int wide = rsdp->revision >= 2 && rsdp->xsdt_address != 0;
+    const struct acpi_sdt_header* root =
+        acpi_map_table(wide ? rsdp->xsdt_address : rsdp->rsdt_address);
+    if (!root) return NULL;
+
+    uint32_t entry_size = wide ? 8 : 4;
+    uint32_t count = (root->length - sizeof(struct acpi_sdt_header)) / entry_size;
+    const uint8_t* entries = (const uint8_t*)root + sizeof(struct acpi_sdt_header);
+
+    // B. Map each header until the signature matches
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t phys = wide ? *(const uint64_t*)(entries + i * 8)
+                             : *(const uint32_t*)(entries + i * 4);
+        if (phys == 0) continue;
+
+        if (vmm_map_physical(phys, sizeof(struct acpi_sdt_header), PTE_PRESENT) != 0) {
+            continue;
+        }
+        const struct acpi_sdt_header* header = phys_to_virt(phys);
+        if (acpi_signature_is(header->signature, signature, 4)) {
+            return acpi_map_table(phys);
+        }
+    }
+    return NULL;
+}
+
+// 4. MADT Parsing
+static void acpi_add_cpu(uint32_t apic_id, uint32_t flags) {
+    if (!(flags & MADT_LAPIC_ENABLED)) return;
+    if (madt_info->cpu_count >= MAX_CPUS) return;
+    madt_info->cpu_apic_ids[madt_info->cpu_count++] = apic_id;
+}
+
+static void acpi_parse_madt(const struct acpi_madt* madt) {
+    madt_info->lapic_address = madt->lapic_address;
+    madt_info->has_8259 = (madt->flags & MADT_PCAT_COMPAT) != 0;
+
+    const uint8_t* entry = madt->entries;
+    const uint8_t* end = (const uint8_t*)madt + madt->header.length;
+
+    while (entry + 2 <= end && entry[1] >= 2 && entry + entry[1] <= end) {
+        switch (entry[0]) {
+            case MADT_TYPE_LAPIC:
+                // processor uid (1), apic id (1), flags (4)
+                acpi_add_cpu(entry[3], *(const uint32_t*)(entry + 4));
+                break;
+
+            case MADT_TYPE_X2APIC:
+                // reserved (2), x2apic id (4), flags (4), processor uid (4)
+                acpi_add_cpu(*(const uint32_t*)(entry + 4), *(const uint32_t*)(entry + 8));
+                break;
+
+            case MADT_TYPE_IOAPIC:
+                // id (1), reserved (1), address (4), gsi base (4)
+                if (madt_info->ioapic_count < ACPI_MAX_IOAPICS) {
+                    struct acpi_ioapic* io = &madt_info->ioapics[madt_info->ioapic_count++];
+                    io->id = entry[2];
+                    io->address = *(const uint32_t*)(entry + 4);
+                    io->gsi_base = *(const uint32_t*)(entry + 8);
+                }
+                break;
+
+            case MADT_TYPE_OVERRIDE:
+                // bus (1, always 0 = ISA), source irq (1), gsi (4), flags (2)
+                if (madt_info->override_count < ACPI_MAX_OVERRIDES) {
+                    struct acpi_override* iso = &madt_info->overrides[madt_info->override_count++];
+                    iso->irq = entry[3];
+                    iso->gsi = *(const uint32_t*)(entry + 4);
+                    iso->flags = *(const uint16_t*)(entry + 8);
+                }
+                break;
+
+            case MADT_TYPE_LAPIC_ADDR:
+                // reserved (2), 64-bit Local APIC address
+                madt_info->lapic_address = *(const uint64_t*)(entry + 4);
+                break;
+        }
+        entry += entry[1];
+    }
+}
+
+/**
+ * @brief Locate the ACPI tables and parse the MADT.
+ *
+ * The RSDP comes from the multiboot info when GRUB provides it, otherwise
+ * from the legacy BIOS areas. Every table is checksummed before use.
+ *
+ * @param[in] multiboot_addr Address of the multiboot info structure
+ * @return int 0 on success, -1 if there is no usable MADT
+ */
+int acpi_init(uint64_t multiboot_addr) {
+    // A. Root pointer
+    rsdp = acpi_find_rsdp(multiboot_addr);
+    if (!rsdp) {
+        terminal_writestring("[ACPI] No RSDP found.\n");
+        return -1;
+    }
+
+    // B. Interrupt controller description
+    const struct acpi_sdt_header* madt = acpi_find_table("APIC");
+    if (!madt) {
+        terminal_writestring("[ACPI] No MADT found.\n");
+        return -1;
+    }
+    struct acpi_madt_info* info = arena_alloc(&boot_arena, sizeof(*info), 0);
+    if (!info) {
+        terminal_writestring("[ACPI] Out of memory for the MADT.\n");
+        return -1;
+    }
+    info->cpu_count = 0;
+    info->ioapic_count = 0;
+    info->override_count = 0;
+    madt_info = info;
+    acpi_parse_madt((const struct acpi_madt*)madt);
+
+    terminal_writestring("[ACPI] MADT: ");
+    terminal_writehex(madt_info->cpu_count);
+    terminal_writestring(" CPU(s), ");
+    terminal_writehex(madt_info->ioapic_count);
+    terminal_writestring(" I/O APIC(s).\n");
+    return 0;
+}
+
+const struct acpi_madt_info* acpi_get_madt(void) {
+    return madt_info;
+}
@@ -0,0 +1,76 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include "../arch/x86_64/cpu.h"
+
+// --- Limits ---
+#define ACPI_MAX_IOAPICS    4
+#define ACPI_MAX_OVERRIDES  16
+
+// --- Table Headers ---
+struct acpi_rsdp {
+    char signature[8];          // "RSD PTR "
+    uint8_t checksum;           // Covers the first 20 bytes
+    char oem_id[6];
+    uint8_t revision;           // 0 = ACPI 1.0 (RSDT only), 2+ = XSDT too
+    uint32_t rsdt_address;
+    uint32_t length;            // ACPI 2.0+ fields from here on
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;            // Whole table, header included
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+// --- MADT (Multiple APIC Description Table, signature "APIC") ---
+struct acpi_ioapic {
+    uint8_t id;
+    uint32_t address;           // Physical MMIO base
+    uint32_t gsi_base;          // First Global System Interrupt it handles
+};
+
+// An ISA IRQ that is not wired to the GSI of the same number
+struct acpi_override {
+    uint8_t irq;                // ISA IRQ (bus 0)
+    uint32_t gsi;
+    uint16_t flags;             // MPS INTI flags: polarity (bits 0-1), trigger (bits 2-3)
+};
+
+#define ACPI_INTI_POLARITY_LOW  0x3
+#define ACPI_INTI_TRIGGER_LEVEL 0xC
+
+struct acpi_madt_info {
+    uint64_t lapic_address;     // Physical MMIO base of the Local APICs
+    int has_8259;               // PC-AT dual 8259 also present
+    uint32_t cpu_count;
+    uint32_t cpu_apic_ids[MAX_CPUS];    // Enabled CPUs, BSP not necessarily first
+    uint32_t ioapic_count;
+    struct acpi_ioapic ioapics[ACPI_MAX_IOAPICS];
+    uint32_t override_count;
+    struct acpi_override overrides[ACPI_MAX_OVERRIDES];
+};
+
+// --- Function Prototypes ---
+
+// Find the RSDP (multiboot tag, else BIOS scan) and parse the MADT
+// Returns 0 on success, -1 if there is no usable ACPI / MADT
+int acpi_init(uint64_t multiboot_addr);
+
+// Parsed MADT (NULL if acpi_init failed or was not called)
+const struct acpi_madt_info* acpi_get_madt(void);
+
+// Find a table by signature (NULL if absent), mapped and checksummed
+const struct acpi_sdt_header* acpi_find_table(const char* signature);
+
+#endif
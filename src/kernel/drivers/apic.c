@@ -0,0 +1,283 @@
+#include "apic.h"
+#include "acpi.h"
+#include "vga.h"
+#include "../arch/x86_64/io.h"
+#include "../arch/x86_64/msr.h"
+#include "../arch/x86_64/cpuid.h"
+#include "../arch/x86_64/irqflags.h"
+#include "../memory/vmm.h"
+#include "../memory/physmap.h"
+
+// --- MSRs ---
+#define MSR_APIC_BASE           0x1B
+#define APIC_BASE_X2APIC        (1 << 10)   // x2APIC mode enable
+#define APIC_BASE_ENABLE        (1 << 11)   // Global APIC enable
+#define MSR_X2APIC_BASE         0x800       // + (xAPIC offset >> 4)
+
+// --- CPUID.1 Feature Bits ---
+#define CPUID_EDX_APIC          (1 << 9)
+#define CPUID_ECX_X2APIC        (1 << 21)
+
+// --- I/O APIC ---
+#define IOAPIC_REGSEL           0x00        // Register index
+#define IOAPIC_WINDOW           0x10        // Data of the selected register
+#define IOAPIC_REG_VERSION      0x01        // Bits 16-23: last redirection entry
+#define IOAPIC_REG_REDIR        0x10        // Entry n: 0x10 + 2n (low), +1 (high)
+
+#define IOAPIC_POLARITY_LOW     (1 << 13)
+#define IOAPIC_TRIGGER_LEVEL    (1 << 15)
+#define IOAPIC_MASKED           (1 << 16)
+
+// --- IMCR (Interrupt Mode Configuration Register) ---
+#define IMCR_SELECT             0x22
+#define IMCR_DATA               0x23
+
+struct ioapic {
+    volatile uint32_t* regs;    // MMIO window (through the direct map)
+    uint32_t gsi_base;
+    uint32_t gsi_count;
+};
+
+static int x2apic = 0;
+static volatile uint32_t* lapic_mmio = NULL;
+static struct ioapic ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+static const struct acpi_madt_info* madt = NULL;
+
+// 1. Local APIC Access
+uint32_t lapic_read(uint32_t reg) {
+    if (x2apic) return (uint32_t)rdmsr(MSR_X2APIC_BASE + (reg >> 4));
+    return lapic_mmio[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value) {
+    if (x2apic) {
+        wrmsr(MSR_X2APIC_BASE + (reg >> 4), value);
+    } else {
+        lapic_mmio[reg / 4] = value;
+    }
+}
+
+int apic_is_x2apic(void) {
+    return x2apic;
+}
+
+uint32_t lapic_id(void) {
+    uint32_t id = lapic_read(LAPIC_REG_ID);
+    return x2apic ? id : id >> 24;
+}
+
+void lapic_eoi_x2apic(uint8_t vector) {
+    (void)vector;
+    wrmsr(MSR_X2APIC_BASE + (LAPIC_REG_EOI >> 4), 0);
+}
+
+void lapic_eoi_xapic(uint8_t vector) {
+    (void)vector;
+    lapic_mmio[LAPIC_REG_EOI / 4] = 0;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+// 2. I/O APIC Access
+static uint32_t ioapic_read(struct ioapic* io, uint32_t reg) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    return io->regs[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(struct ioapic* io, uint32_t reg, uint32_t value) {
+    io->regs[IOAPIC_REGSEL / 4] = reg;
+    io->regs[IOAPIC_WINDOW / 4] = value;
+}
+
+static void ioapic_set_entry(struct ioapic* io, uint32_t pin, uint64_t entry) {
+    // Mask first, so the entry is never live half-written
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, IOAPIC_MASKED);
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2 + 1, (uint32_t)(entry >> 32));
+    ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, (uint32_t)entry);
+}
+
+// Find the I/O APIC that owns a GSI (NULL if none)
+static struct ioapic* ioapic_for_gsi(uint32_t gsi, uint32_t* pin) {
+    for (uint32_t i = 0; i < ioapic_count; i++) {
+        struct ioapic* io = &ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->gsi_count) {
+            *pin = gsi - io->gsi_base;
+            return io;
+        }
+    }
+    return NULL;
+}
+
+// ISA IRQs are identity-mapped to GSIs unless the MADT overrides them.
+// Default ISA signalling is edge-triggered, active high.
+static uint32_t ioapic_isa_to_gsi(uint8_t isa_irq, uint64_t* entry_flags) {
+    *entry_flags = 0;
+    for (uint32_t i = 0; i < madt->override_count; i++) {
+        const struct acpi_override* iso = &madt->overrides[i];
+        if (iso->irq != isa_irq) continue;
+
+        if ((iso->flags & ACPI_INTI_POLARITY_LOW) == ACPI_INTI_POLARITY_LOW) {
+            *entry_flags |= IOAPIC_POLARITY_LOW;
+        }
+        if ((iso->flags & ACPI_INTI_TRIGGER_LEVEL) == ACPI_INTI_TRIGGER_LEVEL) {
+            *entry_flags |= IOAPIC_TRIGGER_LEVEL;
+        }
+        return iso->gsi;
+    }
+    return isa_irq;
+}
+
+/**
+ * @brief Route an ISA IRQ to a vector on the bootstrap CPU.
+ *
+ * Fixed delivery, physical destination mode. Polarity and trigger mode
+ * come from the MADT interrupt source override, if there is one.
+ *
+ * @param[in] isa_irq ISA IRQ number (0-15)
+ * @param[in] vector  IDT vector to raise
+ * @return int 0 on success, -1 if no I/O APIC handles the IRQ
+ */
+int ioapic_route_irq(uint8_t isa_irq, uint8_t vector) {
+    if (!madt) return -1;
+
+    uint64_t flags;
+    uint32_t pin;
+    uint32_t gsi = ioapic_isa_to_gsi(isa_irq, &flags);
+    struct ioapic* io = ioapic_for_gsi(gsi, &pin);
+    if (!io) return -1;
+
+    uint64_t entry = vector | flags | ((uint64_t)(lapic_id() & 0xFF) << 56);
+    ioapic_set_entry(io, pin, entry);
+    return 0;
+}
+
+void ioapic_mask_irq(uint8_t isa_irq) {
+    if (!madt) return;
+
+    uint64_t flags;
+    uint32_t pin;
+    struct ioapic* io = ioapic_for_gsi(ioapic_isa_to_gsi(isa_irq, &flags), &pin);
+    if (io) ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, IOAPIC_MASKED);
+}
+
+// 3. Inter-Processor Interrupts
+void lapic_send_ipi(uint32_t apic_id, uint32_t command) {
+    if (x2apic) {
+        // One 64-bit write: destination in the high half
+        wrmsr(MSR_X2APIC_BASE + (LAPIC_REG_ICR_LOW >> 4),
+              ((uint64_t)apic_id << 32) | command);
+        return;
+    }
+
+    // xAPIC: the low half write sends, so set the destination first.
+    // An interrupt handler sending its own IPI in between would change
+    // the destination under us.
+    uint64_t flags = irq_save();
+    lapic_write(LAPIC_REG_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_REG_ICR_LOW, command);
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+    irq_restore(flags);
+}
+
+// 4. Initialization
+// Enable this CPU's Local APIC in the mode chosen by apic_init.
+// x2APIC must be entered from enabled xAPIC mode.
+static void lapic_init(void) {
+    uint64_t base = rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE;
+    wrmsr(MSR_APIC_BASE, base);
+    if (x2apic) wrmsr(MSR_APIC_BASE, base | APIC_BASE_X2APIC);
+
+    // A. Mask the local interrupt sources until something claims them
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_LVT_LINT0, LAPIC_LVT_MASKED);   // ExtINT from the 8259
+    lapic_write(LAPIC_REG_LVT_ERROR, LAPIC_LVT_MASKED);
+
+    // B. Accept every priority, then enable with the spurious vector
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    // C. Clear anything latched before we took over
+    lapic_write(LAPIC_REG_ESR, 0);
+    lapic_eoi();
+}
+
+/**
+ * @brief Switch interrupt delivery from the 8259 to the APICs.
+ *
+ * Enables the Local APIC (x2APIC if supported, xAPIC MMIO otherwise),
+ * maps every I/O APIC of the MADT and masks all their inputs. IRQs are
+ * then routed one by one with ioapic_route_irq.
+ *
+ * @return int 0 on success, -1 if the APIC path is unavailable
+ */
+int apic_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+
+    // A. Requirements: an APIC, a MADT and at least one I/O APIC
+    cpuid(1, &eax, &edx, &ecx, &ebx);
+    madt = acpi_get_madt();
+    if (!(edx & CPUID_EDX_APIC) || !madt || madt->ioapic_count == 0) {
+        madt = NULL;
+        return -1;
+    }
+
+    // B. Local APIC mode: x2APIC when supported, else the MMIO page
+    x2apic = (ecx & CPUID_ECX_X2APIC) != 0;
+    if (!x2apic) {
+        if (vmm_map_physical(madt->lapic_address, PAGE_SIZE,
+                             PTE_PRESENT | PTE_WRITE | PTE_PCD | PTE_PWT) != 0) {
+            madt = NULL;
+            return -1;
+        }
+        lapic_mmio = phys_to_virt(madt->lapic_address);
+    }
+
+    // C. I/O APICs: map, size, mask every input (one that cannot be
+    // mapped is left out; its inputs stay unusable)
+    for (uint32_t i = 0; i < madt->ioapic_count; i++) {
+        const struct acpi_ioapic* info = &madt->ioapics[i];
+        if (vmm_map_physical(info->address, PAGE_SIZE,
+                             PTE_PRESENT | PTE_WRITE | PTE_PCD | PTE_PWT) != 0) {
+            continue;
+        }
+
+        struct ioapic* io = &ioapics[ioapic_count++];
+        io->regs = phys_to_virt(info->address);
+        io->gsi_base = info->gsi_base;
+        io->gsi_count = ((ioapic_read(io, IOAPIC_REG_VERSION) >> 16) & 0xFF) + 1;
+
+        for (uint32_t pin = 0; pin < io->gsi_count; pin++) {
+            ioapic_write(io, IOAPIC_REG_REDIR + pin * 2, IOAPIC_MASKED);
+        }
+    }
+
+    // None usable: stay on the 8259. The Local APIC is still untouched,
+    // so its interrupts keep reaching the CPU.
+    if (ioapic_count == 0) {
+        madt = NULL;
+        x2apic = 0;
+        return -1;
+    }
+    lapic_init();
+
+    // D. Systems booting in PIC mode route the 8259 through the IMCR:
+    // select APIC mode so ISA interrupts reach the I/O APIC instead.
+    if (madt->has_8259) {
+        outb(IMCR_SELECT, 0x70);
+        outb(IMCR_DATA, 0x01);
+    }
+
+    terminal_writestring(x2apic ? "[APIC] x2APIC enabled, ID " : "[APIC] xAPIC enabled, ID ");
+    terminal_writehex(lapic_id());
+    terminal_writestring(".\n");
+    return 0;
+}
+
+void apic_init_cpu(void) {
+    lapic_init();
+}
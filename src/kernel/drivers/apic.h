@@ -0,0 +1,76 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+
+// --- Local APIC Registers ---
+// Offsets into the xAPIC MMIO page. In x2APIC mode the same register is
+// the MSR 0x800 + (offset >> 4).
+#define LAPIC_REG_ID            0x20
+#define LAPIC_REG_VERSION       0x30
+#define LAPIC_REG_TPR           0x80    // Task Priority
+#define LAPIC_REG_EOI           0xB0
+#define LAPIC_REG_SVR           0xF0    // Spurious Vector + APIC enable
+#define LAPIC_REG_ESR           0x280   // Error Status
+#define LAPIC_REG_ICR_LOW       0x300   // Interrupt Command (IPIs)
+#define LAPIC_REG_ICR_HIGH      0x310   // xAPIC only: destination
+#define LAPIC_REG_LVT_TIMER     0x320
+#define LAPIC_REG_LVT_LINT0     0x350
+#define LAPIC_REG_LVT_LINT1     0x360
+#define LAPIC_REG_LVT_ERROR     0x370
+#define LAPIC_REG_TIMER_INIT    0x380   // Initial count
+#define LAPIC_REG_TIMER_CURRENT 0x390   // Current count
+#define LAPIC_REG_TIMER_DIVIDE  0x3E0
+
+#define LAPIC_SVR_ENABLE        (1 << 8)
+
+// ICR command: delivery mode (bits 8-10), level, delivery status
+#define LAPIC_ICR_FIXED         (0 << 8)
+#define LAPIC_ICR_INIT          (5 << 8)
+#define LAPIC_ICR_STARTUP       (6 << 8)    // Vector = start page (addr >> 12)
+#define LAPIC_ICR_PENDING       (1 << 12)   // xAPIC: not yet accepted
+#define LAPIC_ICR_ASSERT        (1 << 14)
+#define LAPIC_LVT_MASKED        (1 << 16)
+
+// --- Vectors ---
+#define APIC_SPURIOUS_VECTOR    0xFF    // Never needs an EOI
+
+// --- Function Prototypes ---
+
+// Enable this CPU's Local APIC and mask every I/O APIC input
+// Uses x2APIC when the CPU supports it. Needs acpi_init() to have succeeded.
+// Returns 0 on success, -1 if there is no APIC or no I/O APIC.
+int apic_init(void);
+
+// Enable the Local APIC of an application processor (same mode as the BSP)
+void apic_init_cpu(void);
+
+// Non-zero when the Local APIC is driven through MSRs (x2APIC)
+int apic_is_x2apic(void);
+
+// Local APIC register access (offsets above, both modes)
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+
+// Send an IPI: command = delivery mode | flags | vector (LAPIC_ICR_*)
+void lapic_send_ipi(uint32_t apic_id, uint32_t command);
+
+// APIC ID of the CPU running this code
+uint32_t lapic_id(void);
+
+// Signal End Of Interrupt to the Local APIC
+void lapic_eoi(void);
+
+// Mode-specific EOI, for the per-vector EOI table (the vector is unused:
+// the Local APIC retires the highest in-service one)
+void lapic_eoi_x2apic(uint8_t vector);
+void lapic_eoi_xapic(uint8_t vector);
+
+// Route an ISA IRQ to a vector on this CPU (applies ACPI source overrides)
+// Returns 0 on success, -1 if no I/O APIC handles the IRQ.
+int ioapic_route_irq(uint8_t isa_irq, uint8_t vector);
+
+// Stop delivering an ISA IRQ
+void ioapic_mask_irq(uint8_t isa_irq);
+
+#endif
@@ -0,0 +1,72 @@
+#include "irqchip.h"
+#include "pic.h"
+#include "apic.h"
+#include "acpi.h"
+#include "vga.h"
+
+static int use_apic = 0;
+
+static void irq_eoi_none(uint8_t vector) {
+    (void)vector;
+}
+
+irq_eoi_fn irq_eoi_table[256];
+
+// 8259 fallback: only the 16 remapped vectors belong to the PIC
+static void irq_eoi_pic(uint8_t vector) {
+    pic_send_eoi(vector - IRQ_VECTOR_BASE);
+}
+
+/**
+ * @brief Select and set up the interrupt controller.
+ *
+ * Prefers the APICs (configured from the ACPI MADT) and keeps the 8259
+ * as a fallback for machines without them. Also fills the EOI table.
+ *
+ * @param[in] multiboot_addr Address of the multiboot info structure
+ */
+void irqchip_init(uint64_t multiboot_addr) {
+    // 1. Nothing to acknowledge by default
+    for (int i = 0; i < 256; i++) {
+        irq_eoi_table[i] = irq_eoi_none;
+    }
+
+    // 2. APIC path: every device vector EOIs through the Local APIC
+    if (acpi_init(multiboot_addr) == 0 && apic_init() == 0) {
+        pic_disable();
+        use_apic = 1;
+
+        irq_eoi_fn eoi = apic_is_x2apic() ? lapic_eoi_x2apic : lapic_eoi_xapic;
+        for (int i = IRQ_VECTOR_BASE; i < APIC_SPURIOUS_VECTOR; i++) {
+            irq_eoi_table[i] = eoi;
+        }
+        terminal_writestring("[IRQ] Using the I/O APIC, 8259 masked.\n");
+        return;
+    }
+
+    // 3. Fallback: the 8259, already remapped to 32-47
+    for (int i = IRQ_VECTOR_BASE; i < IRQ_VECTOR_BASE + 16; i++) {
+        irq_eoi_table[i] = irq_eoi_pic;
+    }
+    terminal_writestring("[IRQ] No APIC, using the 8259.\n");
+}
+
+void irqchip_enable_irq(uint8_t irq) {
+    if (use_apic) {
+        ioapic_route_irq(irq, IRQ_VECTOR_BASE + irq);
+    } else {
+        pic_unmask(irq);
+    }
+}
+
+void irqchip_disable_irq(uint8_t irq) {
+    if (use_apic) {
+        ioapic_mask_irq(irq);
+    } else {
+        pic_mask(irq);
+    }
+}
+
+int irqchip_uses_apic(void) {
+    return use_apic;
+}
@@ -0,0 +1,36 @@
+#ifndef IRQCHIP_H
+#define IRQCHIP_H
+
+#include <stdint.h>
+
+// --- Vectors ---
+#define IRQ_VECTOR_BASE 32          // ISA IRQ n arrives on vector 32 + n
+
+// --- EOI Fast Path ---
+// One End Of Interrupt routine per vector, chosen when the controller is
+// set up, so acknowledging an interrupt is a single indirect call with no
+// mode checks. Vectors that need no EOI (exceptions, spurious) get a no-op.
+typedef void (*irq_eoi_fn)(uint8_t vector);
+extern irq_eoi_fn irq_eoi_table[256];
+
+static inline void irq_eoi(uint8_t vector) {
+    irq_eoi_table[vector](vector);
+}
+
+// --- Function Prototypes ---
+
+// Pick the interrupt controller: Local APIC + I/O APIC when ACPI describes
+// them (the 8259 is then masked), the remapped 8259 otherwise.
+// Call after vmm_init and pic_remap.
+void irqchip_init(uint64_t multiboot_addr);
+
+// Unmask an ISA IRQ, delivered on IRQ_VECTOR_BASE + irq
+void irqchip_enable_irq(uint8_t irq);
+
+// Mask an ISA IRQ
+void irqchip_disable_irq(uint8_t irq);
+
+// Non-zero when the APICs are in charge
+int irqchip_uses_apic(void);
+
+#endif
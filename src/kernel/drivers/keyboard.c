@@ -1,12 +1,27 @@
 #include "keyboard.h"
 #include "../arch/x86_64/io.h"
 #include "vga.h"
+#include "irqchip.h"
+#include "../arch/x86_64/irq.h"
+#include "../core/softirq.h"
+#include "../core/spinlock.h"
+
+// Scancodes wait here between the IRQ (producer) and the softirq (consumer)
+#define SCANCODE_QUEUE_SIZE 64      // Power of two
 
 // State variables
 char keyboard_buffer[MAX_BUFFER_SIZE];
 int buffer_index = 0;
 bool command_ready = false;
 
+static volatile uint8_t scancode_queue[SCANCODE_QUEUE_SIZE];
+static volatile uint32_t queue_head = 0;    // Next slot the IRQ writes
+static volatile uint32_t queue_tail = 0;    // Next slot the softirq reads
+
+// Line buffer and command_ready: the softirq (any CPU) fills the line,
+// the shell reads it and hands it back with keyboard_init
+static struct spinlock keyboard_lock = SPINLOCK_INIT("keyboard");
+
 // US Keyboard Layout (Scancode Set 1)
 // 0 means "Key not mapped" or "Special Key" (like Shift/Ctrl)
 unsigned char kbd_us[128] = {
@@ -43,16 +58,21 @@ unsigned char kbd_us[128] = {
 };
 
 void keyboard_init(void) {
+    uint64_t flags = spin_lock_irqsave(&keyboard_lock);
     buffer_index = 0;
-    command_ready = false;
     for (int i = 0; i < MAX_BUFFER_SIZE; i++) {
         keyboard_buffer[i] = 0;
     }
-}
+    command_ready = false;
+    int pending = queue_tail != queue_head;
+    spin_unlock_irqrestore(&keyboard_lock, flags);
 
-void keyboard_handler(void) {
-    uint8_t scancode = inb(0x60);
+    // Keys typed while the last command ran
+    if (pending) softirq_raise(SOFTIRQ_KEYBOARD);
+}
 
+// Apply one scancode to the line buffer and the screen
+static void keyboard_process(uint8_t scancode) {
     // If key released, ignore
     if (scancode & 0x80) return;
 
@@ -86,3 +106,37 @@ void keyboard_handler(void) {
         }
     }
 }
+
+// Bottom half: runs with interrupts enabled, so console output (which
+// may scroll the whole screen) no longer delays other interrupts.
+// A finished line stays untouched until the shell has run it: the
+// scancodes after Enter wait in the queue for keyboard_init.
+static void keyboard_softirq(void) {
+    spin_lock(&keyboard_lock);
+    while (!command_ready && queue_tail != queue_head) {
+        uint8_t scancode = scancode_queue[queue_tail % SCANCODE_QUEUE_SIZE];
+        queue_tail++;
+        keyboard_process(scancode);
+    }
+    spin_unlock(&keyboard_lock);
+}
+
+// Top half: read the controller (which acknowledges it) and queue
+int keyboard_handler(void* ctx) {
+    (void)ctx;
+    uint8_t scancode = inb(0x60);
+
+    // Queue full: drop the key rather than block
+    if (queue_head - queue_tail < SCANCODE_QUEUE_SIZE) {
+        scancode_queue[queue_head % SCANCODE_QUEUE_SIZE] = scancode;
+        queue_head++;
+    }
+    softirq_raise(SOFTIRQ_KEYBOARD);
+    return IRQ_HANDLED;
+}
+
+void keyboard_install(void) {
+    softirq_register(SOFTIRQ_KEYBOARD, keyboard_softirq);
+    irq_register(IRQ_VECTOR_BASE + 1, keyboard_handler, NULL);
+    irqchip_enable_irq(1);
+}
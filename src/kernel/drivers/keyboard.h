@@ -13,7 +13,8 @@ extern bool command_ready;
 // The buffer itself
 extern char keyboard_buffer[MAX_BUFFER_SIZE];
 
-void keyboard_handler(void);
+int keyboard_handler(void* ctx); // IRQ 1 top half (irq_register)
 void keyboard_init(void); // To clear the buffer initially
+void keyboard_install(void); // Hook up IRQ 1 and its softirq
 
 #endif
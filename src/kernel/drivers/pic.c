@@ -43,4 +43,25 @@ void pic_remap(void) {
     // TODO: unmask specific IRQs later (like Keyboard).
     outb(PIC1_DATA, 0xFF);
     outb(PIC2_DATA, 0xFF);
-}
\ No newline at end of file
+}
+
+// Set / clear one IRQ's bit in its PIC's mask register
+void pic_mask(uint8_t irq) {
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) | (1 << (irq & 7)));
+}
+
+void pic_unmask(uint8_t irq) {
+    uint16_t port = (irq < 8) ? PIC1_DATA : PIC2_DATA;
+    outb(port, inb(port) & ~(1 << (irq & 7)));
+
+    // Slave IRQs only get through when the cascade (IRQ2) is open too
+    if (irq >= 8) outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << 2));
+}
+
+void pic_disable(void) {
+    // Mask everything: the APICs take over. The PIC stays remapped to
+    // 32-47 so a spurious IRQ 7/15 never lands on an exception vector.
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+}
@@ -4,5 +4,8 @@
 
 void pic_remap(void);
 void pic_send_eoi(uint8_t irq);
+void pic_mask(uint8_t irq);
+void pic_unmask(uint8_t irq);
+void pic_disable(void);   // Mask all lines (APIC mode)
 
 #endif
\ No newline at end of file
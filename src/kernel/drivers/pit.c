@@ -0,0 +1,36 @@
+#include "pit.h"
+#include "../arch/x86_64/io.h"
+
+// --- PIT Ports ---
+#define PIT_CHANNEL0    0x40
+#define PIT_CHANNEL2    0x42
+#define PIT_COMMAND     0x43
+#define PIT_GATE        0x61    // Bit 0: channel 2 gate, bit 5: channel 2 output
+
+// --- Commands ---
+// Channel (bits 6-7), lobyte/hibyte access (0x30), mode 0 = interrupt on terminal count
+#define PIT_CMD_CH0_ONESHOT 0x30
+#define PIT_CMD_CH2_ONESHOT 0xB0
+
+void pit_wait_ticks(uint16_t count) {
+    // 1. Gate low (stop channel 2), speaker off
+    uint8_t gate = inb(PIT_GATE);
+    outb(PIT_GATE, (gate & ~0x02) & ~0x01);
+
+    // 2. Load the count; the output goes high when it reaches zero
+    outb(PIT_COMMAND, PIT_CMD_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, count & 0xFF);
+    outb(PIT_CHANNEL2, count >> 8);
+
+    // 3. Gate high starts the countdown
+    outb(PIT_GATE, (gate & ~0x02) | 0x01);
+    while (!(inb(PIT_GATE) & 0x20));
+
+    outb(PIT_GATE, gate);
+}
+
+void pit_oneshot(uint16_t count) {
+    outb(PIT_COMMAND, PIT_CMD_CH0_ONESHOT);
+    outb(PIT_CHANNEL0, count & 0xFF);
+    outb(PIT_CHANNEL0, count >> 8);
+}
@@ -0,0 +1,16 @@
+#ifndef PIT_H
+#define PIT_H
+
+#include <stdint.h>
+
+// --- PIT (8253/8254 Programmable Interval Timer) ---
+#define PIT_FREQUENCY   1193182     // Input clock in Hz
+
+// Busy-wait for count PIT ticks on channel 2 (speaker gate, no IRQ)
+// Used to calibrate faster clocks at boot. count: 1-65535
+void pit_wait_ticks(uint16_t count);
+
+// Fire IRQ0 once after count ticks (channel 0, mode 0). 0 means 65536.
+void pit_oneshot(uint16_t count);
+
+#endif
@@ -1,7 +1,9 @@
 #include "vga.h"
+#include "../memory/physmap.h"
 
-// VGA Text Mode Buffer Address
-static volatile uint16_t* const VGA_MEMORY = (volatile uint16_t*) 0xB8000;
+// VGA Text Mode Buffer Address (physical 0xB8000, through the direct map)
+static volatile uint16_t* const VGA_MEMORY =
+    (volatile uint16_t*) (PHYSMAP_BASE + 0xB8000);
 // Screen Dimensions
 static const size_t VGA_WIDTH = 80;
 static const size_t VGA_HEIGHT = 25;
@@ -158,4 +160,30 @@ void terminal_writehex(uint64_t n) {
         int index = (n >> i) & 0xF;
         terminal_putchar(hex[index]);
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Write a 64-bit unsigned integer in decimal format.
+ *
+ * @param[in] n The number to write
+ */
+void terminal_writedec(uint64_t n) {
+    if (n == 0) {
+        terminal_putchar('0');
+        return;
+    }
+
+    char buffer[20];
+    int idx = 0;
+
+    // Extract digits in reverse
+    while (n > 0) {
+        buffer[idx++] = '0' + (n % 10);
+        n /= 10;
+    }
+
+    // Print in correct order
+    while (idx > 0) {
+        terminal_putchar(buffer[--idx]);
+    }
+}
@@ -74,4 +74,12 @@ void terminal_putchar(char c);
  */
 void terminal_writehex(uint64_t n);
 
+/**
+ * @brief Write a 64-bit unsigned integer in decimal format.
+ *
+ * @param[in] n The number to write
+ * @return void
+ */
+void terminal_writedec(uint64_t n);
+
 #endif
\ No newline at end of file
@@ -37,6 +37,10 @@ struct multiboot_tag_mmap {
     struct multiboot_mmap_entry entries[];
 };
 
+// Tag Types 14 / 15: Copy of the ACPI RSDP (1.0 / 2.0+), right after the header
+#define MULTIBOOT_TAG_TYPE_ACPI_OLD 14
+#define MULTIBOOT_TAG_TYPE_ACPI_NEW 15
+
 // Memory Region Types
 #define MULTIBOOT_MEMORY_AVAILABLE 1
 #define MULTIBOOT_MEMORY_RESERVED  2
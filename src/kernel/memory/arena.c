@@ -0,0 +1,123 @@
+#include "arena.h"
+#include "pmm.h"
+#include "physmap.h"
+
+// 1. Chunks
+// Each chunk is a buddy block of 2^order frames with this header at the
+// start. Chunks are chained newest first, so rolling back only ever walks
+// (and frees) the chunks allocated after the mark.
+struct arena_chunk {
+    struct arena_chunk* prev;   // Older chunk
+    uint32_t order;             // Chunk is 2^order frames
+    uint64_t used;              // Bytes handed out, header included
+};
+
+#define ARENA_DEFAULT_ALIGN 16
+#define ARENA_HEADER_SIZE ((sizeof(struct arena_chunk) + ARENA_DEFAULT_ALIGN - 1) & \
+                           ~(uint64_t)(ARENA_DEFAULT_ALIGN - 1))
+
+static uint64_t chunk_size(const struct arena_chunk* chunk) {
+    return (uint64_t)PAGE_SIZE << chunk->order;
+}
+
+static void chunk_free(struct arena* arena, struct arena_chunk* chunk) {
+    arena->chunk_bytes -= chunk_size(chunk);
+    pmm_free_frames((void*)virt_to_phys(chunk), chunk->order);
+}
+
+/**
+ * @brief Add a chunk big enough for one allocation to the arena.
+ *
+ * @param[in] arena The arena
+ * @param[in] need  Bytes the allocation needs, alignment slack included
+ * @return struct arena_chunk* The new chunk, or NULL if out of memory
+ */
+static struct arena_chunk* chunk_new(struct arena* arena, uint64_t need) {
+    uint32_t order = 0;
+    while (((uint64_t)PAGE_SIZE << order) < ARENA_HEADER_SIZE + need) {
+        if (++order > PMM_MAX_ORDER) return NULL;
+    }
+
+    uint64_t phys = (uint64_t)pmm_alloc_frames(order);
+    if (!phys) return NULL;
+
+    struct arena_chunk* chunk = (struct arena_chunk*)phys_to_virt(phys);
+    chunk->prev = arena->current;
+    chunk->order = order;
+    chunk->used = ARENA_HEADER_SIZE;
+
+    arena->current = chunk;
+    arena->chunk_bytes += chunk_size(chunk);
+    return chunk;
+}
+
+// 2. Interface
+struct arena boot_arena = { NULL, 0 };
+
+void arena_init(struct arena* arena) {
+    arena->current = NULL;
+    arena->chunk_bytes = 0;
+}
+
+void* arena_alloc(struct arena* arena, size_t size, size_t align) {
+    if (align == 0) align = ARENA_DEFAULT_ALIGN;
+    if (align & (align - 1)) return NULL;
+
+    // A. Bump inside the current chunk (alignment is relative to the chunk,
+    // which is page aligned, so offsets and addresses align the same way)
+    struct arena_chunk* chunk = arena->current;
+    if (chunk) {
+        uint64_t offset = (chunk->used + align - 1) & ~(uint64_t)(align - 1);
+        if (offset + size <= chunk_size(chunk)) {
+            chunk->used = offset + size;
+            return (uint8_t*)chunk + offset;
+        }
+    }
+
+    // B. Chain a new chunk; the old one keeps its unused tail until reset
+    chunk = chunk_new(arena, size + align);
+    if (!chunk) return NULL;
+
+    uint64_t offset = (chunk->used + align - 1) & ~(uint64_t)(align - 1);
+    chunk->used = offset + size;
+    return (uint8_t*)chunk + offset;
+}
+
+struct arena_mark arena_mark(struct arena* arena) {
+    struct arena_mark mark;
+    mark.chunk = arena->current;
+    mark.used = arena->current ? arena->current->used : 0;
+    return mark;
+}
+
+void arena_rollback(struct arena* arena, struct arena_mark mark) {
+    // Free the chunks created after the mark
+    while (arena->current && arena->current != mark.chunk) {
+        struct arena_chunk* chunk = arena->current;
+        arena->current = chunk->prev;
+        chunk_free(arena, chunk);
+    }
+    if (arena->current) {
+        arena->current->used = mark.used;
+    }
+}
+
+void arena_reset(struct arena* arena) {
+    if (!arena->current) return;
+
+    // Keep the oldest chunk: the next user most likely needs about as much
+    while (arena->current->prev) {
+        struct arena_chunk* chunk = arena->current;
+        arena->current = chunk->prev;
+        chunk_free(arena, chunk);
+    }
+    arena->current->used = ARENA_HEADER_SIZE;
+}
+
+void arena_destroy(struct arena* arena) {
+    while (arena->current) {
+        struct arena_chunk* chunk = arena->current;
+        arena->current = chunk->prev;
+        chunk_free(arena, chunk);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// --- Arena ---
+// Bump-pointer allocator over a chain of PMM blocks. Nothing is freed on
+// its own: the whole arena is rolled back to a mark, reset or destroyed.
+// Meant for scratch memory with a clear lifetime (one shell command, one
+// boot step), where it costs a pointer bump and never fragments the heap.
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk* current;    // Chunk being carved (newest)
+    uint64_t chunk_bytes;           // Total size of all chunks
+};
+
+// A checkpoint: everything allocated after it goes away on rollback
+struct arena_mark {
+    struct arena_chunk* chunk;
+    uint64_t used;
+};
+
+// --- Function Prototypes ---
+
+// Start an empty arena (no memory is taken until the first allocation)
+void arena_init(struct arena* arena);
+
+// Allocate size bytes aligned to align (power of two, 0 = 16)
+// Returns NULL when out of memory or the request exceeds a 4MB block.
+void* arena_alloc(struct arena* arena, size_t size, size_t align);
+
+// Remember the current position / go back to it
+struct arena_mark arena_mark(struct arena* arena);
+void arena_rollback(struct arena* arena, struct arena_mark mark);
+
+// Drop every allocation, keeping the first chunk for reuse
+void arena_reset(struct arena* arena);
+
+// Drop every allocation and give all chunks back to the PMM
+void arena_destroy(struct arena* arena);
+
+// Early-boot structures that are kept for good (parsed firmware tables).
+// Never reset; only used before the APs start.
+extern struct arena boot_arena;
+
+#endif
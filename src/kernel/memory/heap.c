@@ -0,0 +1,411 @@
+#include "heap.h"
+#include "pmm.h"
+#include "physmap.h"
+#include "../drivers/vga.h"
+
+// 1. Frame tags
+// Every heap frame is tagged in the PMM so kfree() can tell, from the
+// pointer alone, which slab or span it belongs to.
+// Slab frames store their index inside the slab (a slab is at most 8 frames),
+// so the header is found by stepping back to the first frame.
+#define HEAP_TAG_SLAB        0x80   // | frame index inside the slab (0-7)
+#define HEAP_TAG_LARGE       0x40   // First frame of a kmalloc span
+#define HEAP_TAG_LARGE_TAIL  0x20   // Other frames of a kmalloc span
+#define HEAP_TAG_INDEX_MASK  0x07
+
+#define HEAP_MAX_SLAB_ORDER  3      // Slabs are 4KB - 32KB
+
+// 2. Slab header
+// Sits at the start of the slab's first frame; the objects follow it.
+// Free objects are chained through their first 8 bytes.
+struct slab {
+    struct kmem_cache* cache;
+    struct slab* next;
+    struct slab* prev;
+    void* free_list;
+    uint32_t inuse;
+};
+
+// 3. Caches
+// The kmem_cache structures themselves come from this bootstrap cache.
+static struct kmem_cache cache_cache;
+static struct kmem_cache* cache_registry = NULL;
+
+// Serializes adding caches. Readers walk the registry without it: a cache
+// is fully set up before it is published and is never removed.
+static struct spinlock registry_lock = SPINLOCK_INIT("kmem_registry");
+
+// Size classes for kmalloc: powers of two plus the 1.5x steps in between,
+// so no request wastes more than a third of its object.
+static const uint32_t class_sizes[HEAP_CLASS_COUNT] = {
+    16, 32, 64, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+static const char* class_names[HEAP_CLASS_COUNT] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-192", "kmalloc-256", "kmalloc-384", "kmalloc-512",
+    "kmalloc-768", "kmalloc-1024", "kmalloc-1536", "kmalloc-2048"
+};
+static struct kmem_cache kmalloc_caches[HEAP_CLASS_COUNT];
+
+// Frames held by kmalloc spans (larger than HEAP_MAX_SMALL), updated atomically
+static uint64_t large_frames = 0;
+
+// Size -> class lookup in 16 byte steps: class_index[(size - 1) / 16]
+static uint8_t class_index[HEAP_MAX_SMALL / 16];
+
+// 4. Helper Functions
+static void slab_push(struct slab** list, struct slab* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list) (*list)->prev = slab;
+    *list = slab;
+}
+
+static void slab_unlink(struct slab** list, struct slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static void* kmem_cache_refill(void* ctx);
+static void kmem_cache_drain(void* ctx, void* obj);
+
+/**
+ * @brief Fill in a cache descriptor and pick its slab size.
+ *
+ * The slab order is the smallest one that wastes at most 1/8 of the slab
+ * (header included), e.g., 2KB objects use 16KB slabs holding 7 of them.
+ *
+ * @param[out] cache Cache to set up
+ * @param[in]  name  Name shown in statistics
+ * @param[in]  size  Object size in bytes
+ * @param[in]  align Object alignment (0 for the default)
+ * @return int 0 on success, -1 if the object does not fit in a slab
+ */
+static int kmem_cache_setup(struct kmem_cache* cache, const char* name,
+                            size_t size, size_t align) {
+    // A. Default alignment: cache line for 64B and up, otherwise the next
+    // power of two, so no small object straddles a cache line
+    if (align == 0) {
+        align = 8;
+        while (align < size && align < HEAP_CACHE_LINE) {
+            align <<= 1;
+        }
+    }
+    if (align & (align - 1)) return -1;
+    if (size < sizeof(void*)) size = sizeof(void*);
+
+    cache->name = name;
+    cache->align = (uint32_t)align;
+    cache->obj_size = (uint32_t)((size + align - 1) & ~(align - 1));
+    cache->obj_offset = (uint32_t)((sizeof(struct slab) + align - 1) & ~(align - 1));
+
+    // B. Smallest slab that is not too wasteful
+    uint32_t order = 0;
+    for (; order <= HEAP_MAX_SLAB_ORDER; order++) {
+        uint64_t slab_bytes = (uint64_t)PAGE_SIZE << order;
+        if (cache->obj_offset + cache->obj_size > slab_bytes) continue;
+
+        uint64_t count = (slab_bytes - cache->obj_offset) / cache->obj_size;
+        uint64_t waste = slab_bytes - count * cache->obj_size;
+        if (waste * 8 <= slab_bytes || order == HEAP_MAX_SLAB_ORDER) break;
+    }
+    if (order > HEAP_MAX_SLAB_ORDER) return -1;
+
+    cache->slab_order = order;
+    cache->objs_per_slab = (uint32_t)((((uint64_t)PAGE_SIZE << order) - cache->obj_offset) /
+                                      cache->obj_size);
+    cache->partial = NULL;
+    cache->full = NULL;
+    cache->empty = NULL;
+    cache->active_objs = 0;
+    cache->total_slabs = 0;
+    cache->high_water = 0;
+    cache->use_magazines = 0;
+    spin_lock_init(&cache->lock, name);
+    magazine_layer_init(&cache->mags, name, kmem_cache_refill, kmem_cache_drain, cache);
+
+    uint64_t flags = spin_lock_irqsave(&registry_lock);
+    cache->next = cache_registry;
+    __atomic_store_n(&cache_registry, cache, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&registry_lock, flags);
+    return 0;
+}
+
+/**
+ * @brief Get a new slab from the PMM and chain all its objects.
+ *
+ * @param[in] cache Cache the slab is for
+ * @return struct slab* The slab, or NULL if out of memory
+ */
+static struct slab* slab_create(struct kmem_cache* cache) {
+    uint64_t phys = (uint64_t)pmm_alloc_frames(cache->slab_order);
+    if (!phys) return NULL;
+
+    for (uint32_t i = 0; i < (1U << cache->slab_order); i++) {
+        pmm_set_frame_tag((void*)(phys + i * PAGE_SIZE), HEAP_TAG_SLAB | i);
+    }
+
+    struct slab* slab = (struct slab*)phys_to_virt(phys);
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->inuse = 0;
+
+    // Chain back to front so objects are handed out in address order
+    uint8_t* base = (uint8_t*)slab + cache->obj_offset;
+    void* head = NULL;
+    for (uint32_t i = cache->objs_per_slab; i-- > 0;) {
+        void** obj = (void**)(base + (uint64_t)i * cache->obj_size);
+        *obj = head;
+        head = obj;
+    }
+    slab->free_list = head;
+
+    cache->total_slabs++;
+    return slab;
+}
+
+static void slab_destroy(struct slab* slab) {
+    struct kmem_cache* cache = slab->cache;
+    cache->total_slabs--;
+    pmm_free_frames((void*)virt_to_phys(slab), cache->slab_order);
+}
+
+// Find the slab header of a heap object (NULL if not a slab object)
+static struct slab* slab_of(const void* obj) {
+    uint64_t frame = virt_to_phys(obj) & ~(uint64_t)(PAGE_SIZE - 1);
+    uint8_t tag = pmm_get_frame_tag((void*)frame);
+    if (!(tag & HEAP_TAG_SLAB)) return NULL;
+
+    frame -= (uint64_t)(tag & HEAP_TAG_INDEX_MASK) * PAGE_SIZE;
+    return (struct slab*)phys_to_virt(frame);
+}
+
+// 5. Cache Interface
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align) {
+    struct kmem_cache* cache = kmem_cache_alloc(&cache_cache);
+    if (!cache) return NULL;
+
+    int err = kmem_cache_setup(cache, name, size, align);
+    if (err != 0) {
+        kmem_cache_free(&cache_cache, cache);
+        return NULL;
+    }
+    cache->use_magazines = 1;
+    return cache;
+}
+
+/**
+ * @brief Take one object from the slabs of a cache.
+ *
+ * O(1): takes the first free object of the first partial slab.
+ *
+ * @param[in] cache The cache
+ * @return void* The object, or NULL if out of memory
+ */
+static void* kmem_cache_alloc_slab(struct kmem_cache* cache) {
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+    struct slab* slab = cache->partial;
+    if (!slab) {
+        slab = cache->empty;
+        cache->empty = NULL;
+        if (!slab) slab = slab_create(cache);
+        if (!slab) {
+            spin_unlock_irqrestore(&cache->lock, flags);
+            return NULL;
+        }
+        slab_push(&cache->partial, slab);
+    }
+
+    void** obj = (void**)slab->free_list;
+    slab->free_list = *obj;
+    slab->inuse++;
+
+    if (slab->inuse == cache->objs_per_slab) {
+        slab_unlink(&cache->partial, slab);
+        slab_push(&cache->full, slab);
+    }
+
+    cache->active_objs++;
+    if (cache->active_objs > cache->high_water) {
+        cache->high_water = cache->active_objs;
+    }
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+    return obj;
+}
+
+/**
+ * @brief Give an object back to its slab.
+ *
+ * A slab that becomes empty is kept as the cache's spare; if there is
+ * already one, its frames go back to the PMM.
+ *
+ * @param[in] cache The cache the object came from
+ * @param[in] obj   The object
+ */
+static void kmem_cache_free_slab(struct kmem_cache* cache, void* obj) {
+    struct slab* slab = slab_of(obj);
+    uint64_t flags = spin_lock_irqsave(&cache->lock);
+
+    if (slab->inuse == cache->objs_per_slab) {
+        slab_unlink(&cache->full, slab);
+        slab_push(&cache->partial, slab);
+    }
+
+    *(void**)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->inuse--;
+    cache->active_objs--;
+
+    if (slab->inuse == 0) {
+        slab_unlink(&cache->partial, slab);
+        if (!cache->empty) {
+            cache->empty = slab;
+        } else {
+            slab_destroy(slab);
+        }
+    }
+
+    spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+// Magazine backend: objects move between the magazines and the slabs
+static void* kmem_cache_refill(void* ctx) {
+    return kmem_cache_alloc_slab((struct kmem_cache*)ctx);
+}
+
+static void kmem_cache_drain(void* ctx, void* obj) {
+    kmem_cache_free_slab((struct kmem_cache*)ctx, obj);
+}
+
+/**
+ * @brief Allocate one object from a cache.
+ *
+ * @param[in] cache The cache
+ * @return void* The object, or NULL if out of memory
+ */
+void* kmem_cache_alloc(struct kmem_cache* cache) {
+    if (cache->use_magazines) {
+        return magazine_alloc(&cache->mags);
+    }
+    return kmem_cache_alloc_slab(cache);
+}
+
+/**
+ * @brief Give an object back to its cache.
+ *
+ * @param[in] cache The cache the object came from
+ * @param[in] obj   The object (NULL is ignored)
+ */
+void kmem_cache_free(struct kmem_cache* cache, void* obj) {
+    if (!obj) return;
+
+    struct slab* slab = slab_of(obj);
+    if (!slab || slab->cache != cache) return;  // Not from this cache
+
+    if (cache->use_magazines) {
+        magazine_free(&cache->mags, obj);
+    } else {
+        kmem_cache_free_slab(cache, obj);
+    }
+}
+
+struct kmem_cache* kmem_cache_list(void) {
+    return __atomic_load_n(&cache_registry, __ATOMIC_ACQUIRE);
+}
+
+uint64_t heap_get_large_frames(void) {
+    return __atomic_load_n(&large_frames, __ATOMIC_RELAXED);
+}
+
+// 6. kmalloc / kfree
+/**
+ * @brief Allocate a page-aligned span of whole frames.
+ *
+ * The buddy block is rounded up to a power of two; the unused tail frames
+ * are freed right away, so a span only costs the pages it needs.
+ *
+ * @param[in] size Size in bytes (> HEAP_MAX_SMALL)
+ * @return void* The span, or NULL if out of memory or too large
+ */
+static void* kmalloc_large(size_t size) {
+    uint64_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t order = 0;
+    while ((1ULL << order) < pages) order++;
+    if (order > PMM_MAX_ORDER) return NULL;
+
+    uint64_t phys = (uint64_t)pmm_alloc_frames(order);
+    if (!phys) return NULL;
+
+    for (uint64_t i = pages; i < (1ULL << order); i++) {
+        pmm_free_frame((void*)(phys + i * PAGE_SIZE));
+    }
+
+    __atomic_fetch_add(&large_frames, pages, __ATOMIC_RELAXED);
+    pmm_set_frame_tag((void*)phys, HEAP_TAG_LARGE);
+    for (uint64_t i = 1; i < pages; i++) {
+        pmm_set_frame_tag((void*)(phys + i * PAGE_SIZE), HEAP_TAG_LARGE_TAIL);
+    }
+    return phys_to_virt(phys);
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0) return NULL;
+    if (size > HEAP_MAX_SMALL) {
+        return kmalloc_large(size);
+    }
+    return kmem_cache_alloc(&kmalloc_caches[class_index[(size - 1) / 16]]);
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+
+    struct slab* slab = slab_of(ptr);
+    if (slab) {
+        kmem_cache_free(slab->cache, ptr);
+        return;
+    }
+
+    uint64_t phys = virt_to_phys(ptr);
+    if (pmm_get_frame_tag((void*)phys) != HEAP_TAG_LARGE) return;  // Not ours
+
+    // Measure the span before freeing any of it: once a frame is freed,
+    // another CPU may reuse it and tag the frames after it as its own
+    uint64_t pages = 1;
+    while (pmm_get_frame_tag((void*)(phys + pages * PAGE_SIZE)) == HEAP_TAG_LARGE_TAIL) {
+        pages++;
+    }
+    for (uint64_t i = 0; i < pages; i++) {
+        pmm_free_frame((void*)(phys + i * PAGE_SIZE));
+    }
+    __atomic_fetch_sub(&large_frames, pages, __ATOMIC_RELAXED);
+}
+
+// 7. Initialization
+void heap_init(void) {
+    kmem_cache_setup(&cache_cache, "kmem_cache", sizeof(struct kmem_cache), 0);
+
+    uint32_t cls = 0;
+    for (uint32_t i = 0; i < HEAP_CLASS_COUNT; i++) {
+        kmem_cache_setup(&kmalloc_caches[i], class_names[i], class_sizes[i], 0);
+
+        // Every 16 byte step up to this class size maps to it
+        for (; cls * 16 < class_sizes[i]; cls++) {
+            class_index[cls] = (uint8_t)i;
+        }
+        kmalloc_caches[i].use_magazines = 1;
+    }
+
+    // From here on, caches and the PMM can get magazines
+    magazine_init();
+
+    terminal_writestring("[HEAP] Slab allocator ready (16B - 2KB classes).\n");
+}
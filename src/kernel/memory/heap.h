@@ -0,0 +1,70 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "magazine.h"
+#include "../core/spinlock.h"
+
+// --- Constants ---
+#define HEAP_CACHE_LINE   64      // Objects of 64B and up start on a cache line
+#define HEAP_MAX_SMALL    2048    // Largest kmalloc served by a size class
+#define HEAP_CLASS_COUNT  12      // 16, 32, 64, 128, 192, 256, 384, 512, 768, 1K, 1.5K, 2K
+
+struct slab;
+
+// --- Object Cache ---
+// A pool of equally sized objects carved out of slabs (1-8 PMM frames).
+// Slabs are kept on three lists so allocation never searches: objects come
+// from the first partial slab, then from a cached empty one, then from a
+// fresh slab. In front of the slabs, a per-CPU magazine layer serves most
+// allocations and frees without touching the shared slab lists.
+// The lock covers the slab lists and counters; it is taken with
+// interrupts disabled and may call into the PMM while held.
+struct kmem_cache {
+    struct spinlock lock;
+    const char* name;
+    uint32_t obj_size;          // Object size, rounded up to the alignment
+    uint32_t align;             // Object alignment (power of two)
+    uint32_t slab_order;        // Each slab is 2^slab_order frames
+    uint32_t objs_per_slab;
+    uint32_t obj_offset;        // First object, right after the slab header
+    struct slab* partial;       // Some objects free, some in use
+    struct slab* full;          // No free object
+    struct slab* empty;         // At most one fully free slab, kept for reuse
+    uint64_t active_objs;       // Objects out of the slabs (magazines included)
+    uint64_t total_slabs;       // Slabs owned by the cache
+    uint64_t high_water;        // Peak of active_objs
+    struct kmem_cache* next;    // All caches, for statistics
+    int use_magazines;          // Go through the magazine layer first
+    struct magazine_layer mags;
+};
+
+// --- Function Prototypes ---
+
+// Set up the kmalloc size classes (after vmm_init)
+void heap_init(void);
+
+// Allocate size bytes (NULL on failure or size 0)
+// Up to HEAP_MAX_SMALL comes from a size class, larger requests get a
+// page-aligned span of whole frames.
+void* kmalloc(size_t size);
+
+// Free memory returned by kmalloc (NULL is ignored)
+void kfree(void* ptr);
+
+// Create a cache of fixed-size objects
+// align: 0 for the default (cache line for objects >= 64B)
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align);
+
+// Allocate / free one object of a cache
+void* kmem_cache_alloc(struct kmem_cache* cache);
+void kmem_cache_free(struct kmem_cache* cache, void* obj);
+
+// First cache of the registry (walk with ->next)
+struct kmem_cache* kmem_cache_list(void);
+
+// Frames held by kmalloc allocations larger than HEAP_MAX_SMALL
+uint64_t heap_get_large_frames(void);
+
+#endif
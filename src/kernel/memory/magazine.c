@@ -0,0 +1,200 @@
+#include "magazine.h"
+#include "heap.h"
+#include "../arch/x86_64/irqflags.h"
+
+// Magazines themselves come from a plain cache without a magazine layer.
+// Until magazine_init() runs, layers simply pass through to their backend.
+static struct kmem_cache* magazine_cache = NULL;
+
+void magazine_init(void) {
+    struct kmem_cache* cache = kmem_cache_create("magazine", sizeof(struct magazine), 0);
+
+    // Magazines must not be cached in magazines themselves
+    if (cache) cache->use_magazines = 0;
+    magazine_cache = cache;
+}
+
+void magazine_layer_init(struct magazine_layer* layer, const char* name,
+                         void* (*refill)(void* ctx),
+                         void (*drain)(void* ctx, void* obj), void* ctx) {
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        layer->cpus[cpu].loaded = NULL;
+        layer->cpus[cpu].previous = NULL;
+    }
+    spin_lock_init(&layer->depot.lock, name);
+    layer->depot.full = NULL;
+    layer->depot.empty = NULL;
+    layer->depot.full_count = 0;
+    layer->depot.empty_count = 0;
+    layer->depot.refill = refill;
+    layer->depot.drain = drain;
+    layer->depot.ctx = ctx;
+}
+
+// 1. Depot helpers
+// The depot is the only part shared between CPUs. Its lock is held just
+// for the list operation; callers already run with interrupts disabled.
+static struct magazine* depot_pop(struct magazine_depot* depot,
+                                  struct magazine** list, uint32_t* count) {
+    spin_lock(&depot->lock);
+    struct magazine* mag = *list;
+    if (mag) {
+        *list = mag->next;
+        (*count)--;
+    }
+    spin_unlock(&depot->lock);
+    return mag;
+}
+
+// Returns 0 (and keeps nothing) when the list already holds enough
+static int depot_push(struct magazine_depot* depot, struct magazine** list,
+                      uint32_t* count, struct magazine* mag) {
+    spin_lock(&depot->lock);
+    int pushed = *count < MAGAZINE_DEPOT_MAX;
+    if (pushed) {
+        mag->next = *list;
+        *list = mag;
+        (*count)++;
+    }
+    spin_unlock(&depot->lock);
+    return pushed;
+}
+
+// Get an empty magazine: recycled from the depot, else a new one
+static struct magazine* magazine_empty(struct magazine_depot* depot) {
+    struct magazine* mag = depot_pop(depot, &depot->empty, &depot->empty_count);
+    if (!mag && magazine_cache) {
+        mag = kmem_cache_alloc(magazine_cache);
+        if (mag) mag->rounds = 0;
+    }
+    return mag;
+}
+
+// Keep an empty magazine for later, or free it if the depot has enough
+static void magazine_retire(struct magazine_depot* depot, struct magazine* mag) {
+    if (!depot_push(depot, &depot->empty, &depot->empty_count, mag)) {
+        kmem_cache_free(magazine_cache, mag);
+    }
+}
+
+// 2. Allocation / Free
+/**
+ * @brief Allocate an object through the magazine layer.
+ *
+ * Fast path: pop from this CPU's loaded (or previous) magazine.
+ * Slow path: swap in a full magazine from the depot, or fill half a
+ * magazine from the backend in one batch.
+ *
+ * @param[in] layer The layer
+ * @return void* The object, or NULL if the backend is out of memory
+ */
+void* magazine_alloc(struct magazine_layer* layer) {
+    uint64_t flags = irq_save();
+    struct magazine_cpu* cpu = &layer->cpus[cpu_id()];
+    struct magazine_depot* depot = &layer->depot;
+    void* obj = NULL;
+
+    // A. Loaded magazine, then the previous one
+    if (!cpu->loaded || cpu->loaded->rounds == 0) {
+        if (cpu->previous && cpu->previous->rounds > 0) {
+            struct magazine* tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        }
+    }
+
+    // B. Trade an empty magazine for a full one from the depot
+    if (!cpu->loaded || cpu->loaded->rounds == 0) {
+        struct magazine* full = depot_pop(depot, &depot->full, &depot->full_count);
+        if (full) {
+            if (cpu->previous) magazine_retire(depot, cpu->previous);
+            cpu->previous = cpu->loaded;
+            cpu->loaded = full;
+        }
+    }
+
+    // C. Batch refill from the backend
+    if (!cpu->loaded || cpu->loaded->rounds == 0) {
+        if (!cpu->loaded) cpu->loaded = magazine_empty(depot);
+        if (!cpu->loaded) {
+            obj = depot->refill(depot->ctx);
+            irq_restore(flags);
+            return obj;
+        }
+        while (cpu->loaded->rounds < MAGAZINE_SIZE / 2) {
+            void* fresh = depot->refill(depot->ctx);
+            if (!fresh) break;
+            cpu->loaded->round[cpu->loaded->rounds++] = fresh;
+        }
+    }
+
+    if (cpu->loaded->rounds > 0) {
+        obj = cpu->loaded->round[--cpu->loaded->rounds];
+    }
+    irq_restore(flags);
+    return obj;
+}
+
+/**
+ * @brief Free an object through the magazine layer.
+ *
+ * Fast path: push onto this CPU's loaded (or previous) magazine.
+ * Slow path: hand a full magazine to the depot, or, when the depot is
+ * already holding enough, drain it to the backend in one batch.
+ *
+ * @param[in] layer The layer
+ * @param[in] obj   The object
+ */
+void magazine_free(struct magazine_layer* layer, void* obj) {
+    uint64_t flags = irq_save();
+    struct magazine_cpu* cpu = &layer->cpus[cpu_id()];
+    struct magazine_depot* depot = &layer->depot;
+
+    // A. Loaded magazine, then the previous one
+    if (!cpu->loaded || cpu->loaded->rounds == MAGAZINE_SIZE) {
+        if (cpu->previous && cpu->previous->rounds < MAGAZINE_SIZE) {
+            struct magazine* tmp = cpu->loaded;
+            cpu->loaded = cpu->previous;
+            cpu->previous = tmp;
+        }
+    }
+
+    // B. Both full (or missing): park one in the depot, load an empty one
+    if (!cpu->loaded || cpu->loaded->rounds == MAGAZINE_SIZE) {
+        struct magazine* full = cpu->previous;
+        cpu->previous = cpu->loaded;
+        cpu->loaded = NULL;
+
+        if (full && !depot_push(depot, &depot->full, &depot->full_count, full)) {
+            // Depot has enough: drain the whole magazine and reuse it
+            while (full->rounds > 0) {
+                depot->drain(depot->ctx, full->round[--full->rounds]);
+            }
+            cpu->loaded = full;
+        }
+
+        if (!cpu->loaded) cpu->loaded = magazine_empty(depot);
+        if (!cpu->loaded) {
+            depot->drain(depot->ctx, obj);
+            irq_restore(flags);
+            return;
+        }
+    }
+
+    cpu->loaded->round[cpu->loaded->rounds++] = obj;
+    irq_restore(flags);
+}
+
+uint64_t magazine_cached(struct magazine_layer* layer) {
+    uint64_t total = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        if (layer->cpus[i].loaded) total += layer->cpus[i].loaded->rounds;
+        if (layer->cpus[i].previous) total += layer->cpus[i].previous->rounds;
+    }
+    uint64_t flags = spin_lock_irqsave(&layer->depot.lock);
+    for (struct magazine* mag = layer->depot.full; mag; mag = mag->next) {
+        total += mag->rounds;
+    }
+    spin_unlock_irqrestore(&layer->depot.lock, flags);
+    return total;
+}
@@ -0,0 +1,66 @@
+#ifndef MAGAZINE_H
+#define MAGAZINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../arch/x86_64/cpu.h"
+#include "../core/spinlock.h"
+
+// --- Tunables ---
+#define MAGAZINE_SIZE       32  // Objects per magazine
+#define MAGAZINE_DEPOT_MAX  8   // Full (and empty) magazines the depot keeps
+
+// --- Magazine ---
+// A small LIFO stack of free objects (heap objects or frame addresses).
+struct magazine {
+    struct magazine* next;      // Depot list link
+    uint32_t rounds;            // Objects currently stacked
+    void* round[MAGAZINE_SIZE];
+};
+
+// Each CPU works on two magazines, so alternating alloc/free at a
+// magazine boundary does not bounce magazines to and from the depot.
+struct magazine_cpu {
+    struct magazine* loaded;
+    struct magazine* previous;
+};
+
+// Shared pool of full and empty magazines, plus the backend allocator
+// that fills and drains magazines in batches when the depot runs dry/over.
+// The lock only covers the two lists; backends lock for themselves.
+struct magazine_depot {
+    struct spinlock lock;
+    struct magazine* full;
+    struct magazine* empty;
+    uint32_t full_count;
+    uint32_t empty_count;
+    void* (*refill)(void* ctx);         // Take one object from the backend
+    void (*drain)(void* ctx, void* obj);// Give one object back to the backend
+    void* ctx;
+};
+
+struct magazine_layer {
+    struct magazine_cpu cpus[MAX_CPUS];
+    struct magazine_depot depot;
+};
+
+// --- Function Prototypes ---
+
+// Enable magazine allocation (once the heap can hand them out)
+void magazine_init(void);
+
+// Set up a layer in front of a backend allocator ('name' labels the depot lock)
+void magazine_layer_init(struct magazine_layer* layer, const char* name,
+                         void* (*refill)(void* ctx),
+                         void (*drain)(void* ctx, void* obj), void* ctx);
+
+// Allocate an object (NULL when the backend is out of memory too)
+void* magazine_alloc(struct magazine_layer* layer);
+
+// Free an object (stays cached on this CPU when possible)
+void magazine_free(struct magazine_layer* layer, void* obj);
+
+// Number of objects held by the layer (all CPUs and the depot)
+uint64_t magazine_cached(struct magazine_layer* layer);
+
+#endif
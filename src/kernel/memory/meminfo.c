@@ -0,0 +1,37 @@
+#include "meminfo.h"
+#include "vmm.h"
+#include "heap.h"
+
+/**
+ * @brief Take a snapshot of all memory counters.
+ *
+ * Each subsystem is read on its own, so the numbers are consistent per
+ * subsystem but not across them (an allocation may land in between).
+ *
+ * @param[out] info Filled with the current counters
+ */
+void meminfo_collect(struct meminfo* info) {
+    // 1. Physical frames, per region and overall
+    info->region_count = pmm_get_region_stats(info->regions, PMM_MAX_REGIONS);
+    info->total_frames = 0;
+    for (int i = 0; i < info->region_count; i++) {
+        info->total_frames += info->regions[i].free_frames + info->regions[i].used_frames;
+    }
+    info->free_frames = pmm_get_free_frames();
+    info->cached_frames = pmm_get_cached_frames();
+
+    struct pmm_zero_pool_stats zero;
+    pmm_get_zero_pool_stats(&zero);
+    info->zeroed_frames = zero.count;
+
+    // 2. Fragmentation
+    pmm_get_frag_stats(&info->frag);
+
+    // 3. Who holds the used frames
+    info->table_frames = vmm_get_table_frames();
+    info->slab_frames = 0;
+    for (struct kmem_cache* cache = kmem_cache_list(); cache; cache = cache->next) {
+        info->slab_frames += cache->total_slabs << cache->slab_order;
+    }
+    info->large_frames = heap_get_large_frames();
+}
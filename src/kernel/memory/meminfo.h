@@ -0,0 +1,29 @@
+#ifndef MEMINFO_H
+#define MEMINFO_H
+
+#include <stdint.h>
+#include "pmm.h"
+
+// --- Memory Accounting Snapshot ---
+// Gathered from the PMM, VMM and heap in one call. Counts are in frames.
+struct meminfo {
+    uint64_t total_frames;      // Frames in available memory map regions
+    uint64_t free_frames;       // Free in the bitmap or cached in magazines
+    uint64_t cached_frames;     // Free frames parked in per-CPU magazines
+    uint64_t zeroed_frames;     // Frames ready in the pre-zeroed pool
+
+    int region_count;
+    struct pmm_region_stats regions[PMM_MAX_REGIONS];
+    struct pmm_frag_stats frag;
+
+    uint64_t table_frames;      // Page tables of all address spaces
+    uint64_t slab_frames;       // Slabs of every kmem_cache
+    uint64_t large_frames;      // kmalloc spans above the size classes
+};
+
+// --- Function Prototypes ---
+
+// Take a snapshot of all memory counters
+void meminfo_collect(struct meminfo* info);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef PHYSMAP_H
+#define PHYSMAP_H
+
+#include <stdint.h>
+
+// --- Kernel Address Space Layout ---
+// Direct Physical Map: all RAM is mapped linearly starting here,
+// so physical address P is always reachable at PHYSMAP_BASE + P.
+// boot.asm already maps the first 1GB here; vmm_init extends it to all RAM.
+#define PHYSMAP_BASE        0xFFFF800000000000ULL
+
+// Kernel image (.text/.data/.bss), linked at the top 2GB
+#define KERNEL_VIRTUAL_BASE 0xFFFFFFFF80000000ULL
+
+/**
+ * @brief Get the direct-map virtual address of a physical address.
+ *
+ * @param[in] physical_addr Physical address (RAM or low-memory devices)
+ * @return void* Kernel virtual address inside the direct map
+ */
+static inline void* phys_to_virt(uint64_t physical_addr) {
+    return (void*)(physical_addr + PHYSMAP_BASE);
+}
+
+/**
+ * @brief Get the physical address behind a kernel virtual address.
+ *
+ * Works for the direct map and for the kernel image window.
+ *
+ * @param[in] virtual_addr Direct-map or kernel image address
+ * @return uint64_t Physical address
+ */
+static inline uint64_t virt_to_phys(const void* virtual_addr) {
+    uint64_t addr = (uint64_t)virtual_addr;
+    if (addr >= KERNEL_VIRTUAL_BASE) {
+        return addr - KERNEL_VIRTUAL_BASE;
+    }
+    return addr - PHYSMAP_BASE;
+}
+
+#endif
@@ -1,47 +1,411 @@
 #include "pmm.h"
+#include "physmap.h"
 #include <multiboot.h>
 #include "../drivers/vga.h"
+#include "../core/spinlock.h"
+#include "magazine.h"
 
 // 1. Configuration
-#define MAX_MEMORY_SIZE 0x40000000  // 1GB (reduced from 4GB for testing)
-#define FRAMES_COUNT (MAX_MEMORY_SIZE / PAGE_SIZE)
-#define BITMAP_SIZE (FRAMES_COUNT / 8)
+// Everything is sized at boot from the highest usable address in the
+// memory map. The bitmap is handled 64 frames at a time (one uint64_t
+// "leaf" word). A second, much smaller level sits on top of it: bit N of
+// summary word S is set when leaf word (S * 64 + N) still has at least one
+// free frame. 2GB of RAM = 8192 leaf words = 128 summary words.
+// frames_count is rounded up to a whole summary word (4096 frames), which
+// also keeps it a multiple of the largest buddy block.
+#define FRAMES_PER_SUMMARY_WORD (64 * 64)
 
-// 2. THE FIX: Hardcoded location for the Bitmap (5MB Mark)
-// This prevents it from overlapping with the Kernel or Multiboot Info.
-// 5MB is safer than 16MB as it's well within the identity-mapped region.
-static uint8_t* bitmap = (uint8_t*)0x500000;
+// 2. Tracking structures
+// Placed at boot right after the kernel image (and the multiboot info, if
+// GRUB put it higher), so they never overlap either. They are accessed
+// through the direct physical map.
+static uint64_t highest_usable_addr = 0;
+static uint64_t frames_count = 0;
+static uint64_t bitmap_words = 0;
+static uint64_t summary_words = 0;
+static uint64_t* bitmap = NULL;
+static uint64_t* summary = NULL;
+
+// Extra references per frame (0 = one owner). Frames shared copy-on-write
+// between address spaces are only freed once every mapping dropped them.
+static uint16_t* frame_shares = NULL;
+
+// One byte per frame for the allocator that owns it (e.g., the heap uses it
+// to find the slab a pointer belongs to). Reset to 0 when the frame is freed.
+static uint8_t* frame_tags = NULL;
 
 // 3. Frame allocation tracking for optimization
 static uint64_t free_frames_count = 0;
-static uint64_t next_free_frame = 0;
+static uint64_t next_free_summary = 0;  // First summary word worth scanning
+
+// Buddy engine: one free area per order.
+// Bit I of an area's map is set when block I (frames I*2^K .. I*2^K + 2^K - 1)
+// is a free block of exactly that order. The frame bitmap stays the source
+// of truth for single frames; the areas only describe how free frames group
+// into aligned blocks. Keeping the areas as bitmaps (instead of linked lists
+// threaded through the free frames) means a free frame is never touched.
+// Order K needs one bit per 2^K frames, so all orders together take
+// roughly as much space as the frame bitmap itself.
+struct free_area {
+    uint64_t* map;      // One bit per block of this order
+    uint64_t words;     // Size of map in uint64_t words
+    uint64_t count;     // Number of free blocks of this order
+    uint64_t hint;      // First map word that may have a bit set
+};
+
+static struct free_area free_areas[PMM_MAX_ORDER + 1];
+
+// Pre-zeroed frames, topped up from the idle loop.
+// A small LIFO of physical addresses; 64 frames = 256KB of ready memory.
+#define ZERO_POOL_SIZE 64
+static uint64_t zero_pool[ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
+static uint64_t zero_pool_hits = 0;
+static uint64_t zero_pool_misses = 0;
 
-// 4. Helper Functions - Forward declaration
-static int bitmap_test(uint64_t frame_index);
+// Per-CPU magazines of single frames in front of the bitmap.
+// Frames sitting in a magazine stay marked used in the bitmap; their bit
+// in 'cached' tells them apart from allocated ones, so freeing one twice
+// is caught. Atomic bit ops: magazine pops do not take pmm_lock.
+static struct magazine_layer frame_mags;
+static uint64_t* cached = NULL;
+
+// One lock for the bitmap, the buddy areas, share counts and the zero
+// pool. Single frames mostly come from the per-CPU magazines and only
+// take it to refill or drain them in batches.
+static struct spinlock pmm_lock = SPINLOCK_INIT("pmm");
+
+// Ranges never handed to the allocator, even if the memory map says "available"
+struct pmm_range {
+    uint64_t start;     // First frame
+    uint64_t end;       // One past the last frame
+};
+
+// Available regions of the memory map, kept for statistics
+static struct pmm_range regions[PMM_MAX_REGIONS];
+static int region_count = 0;
+
+#define PMM_MAX_RESERVED 4
+static struct pmm_range reserved[PMM_MAX_RESERVED];
+static int reserved_count = 0;
+
+// 4. Helper Functions
+static int bitmap_test(uint64_t frame_index) {
+    return (bitmap[frame_index / 64] & (1ULL << (frame_index % 64))) != 0;
+}
+
+// Allocated to someone: used in the bitmap and not waiting in a magazine
+static int frame_owned(uint64_t frame_index) {
+    uint64_t mask = 1ULL << (frame_index % 64);
+    return bitmap_test(frame_index) &&
+           !(__atomic_load_n(&cached[frame_index / 64], __ATOMIC_RELAXED) & mask);
+}
+
+// Mark a frame as cached; returns 0 if it already was
+static int cached_set(uint64_t frame_index) {
+    uint64_t mask = 1ULL << (frame_index % 64);
+    return !(__atomic_fetch_or(&cached[frame_index / 64], mask, __ATOMIC_RELAXED) & mask);
+}
+
+static void cached_clear(uint64_t frame_index) {
+    uint64_t mask = 1ULL << (frame_index % 64);
+    __atomic_fetch_and(&cached[frame_index / 64], ~mask, __ATOMIC_RELAXED);
+}
 
 static void bitmap_set(uint64_t frame_index) {
-    if (!bitmap_test(frame_index)) {
-        free_frames_count--;
+    uint64_t word = frame_index / 64;
+    uint64_t mask = 1ULL << (frame_index % 64);
+
+    if (bitmap[word] & mask) return;
+
+    free_frames_count--;
+    bitmap[word] |= mask;
+
+    // Leaf word just became full: hide it from the summary
+    if (bitmap[word] == ~0ULL) {
+        summary[word / 64] &= ~(1ULL << (word % 64));
     }
-    bitmap[frame_index / 8] |= (1 << (frame_index % 8));
 }
 
 static void bitmap_unset(uint64_t frame_index) {
-    if (bitmap_test(frame_index)) {
-        free_frames_count++;
+    uint64_t word = frame_index / 64;
+    uint64_t mask = 1ULL << (frame_index % 64);
+
+    if (!(bitmap[word] & mask)) return;
+
+    free_frames_count++;
+    bitmap[word] &= ~mask;
+    summary[word / 64] |= 1ULL << (word % 64);
+
+    if (word / 64 < next_free_summary) {
+        next_free_summary = word / 64;
     }
-    bitmap[frame_index / 8] &= ~(1 << (frame_index % 8));
 }
 
-static int bitmap_test(uint64_t frame_index) {
-    return (bitmap[frame_index / 8] & (1 << (frame_index % 8))) != 0;
+/**
+ * @brief Build the mask covering bits [bit, bit + count) of one word.
+ *
+ * @param[in] bit   First bit (0-63)
+ * @param[in] count Number of bits (1-64)
+ * @return uint64_t The mask
+ */
+static uint64_t word_mask(uint64_t bit, uint64_t count) {
+    if (count == 64) return ~0ULL;
+    return ((1ULL << count) - 1) << bit;
+}
+
+/**
+ * @brief Mark a run of frames as used, one bitmap word at a time.
+ *
+ * @param[in] start First frame index
+ * @param[in] count Number of frames
+ */
+static void bitmap_set_range(uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+
+    while (start < end) {
+        uint64_t word = start / 64;
+        uint64_t bit = start % 64;
+        uint64_t n = 64 - bit;
+        if (n > end - start) n = end - start;
+
+        uint64_t mask = word_mask(bit, n);
+        free_frames_count -= n - __builtin_popcountll(bitmap[word] & mask);
+        bitmap[word] |= mask;
+
+        if (bitmap[word] == ~0ULL) {
+            summary[word / 64] &= ~(1ULL << (word % 64));
+        }
+        start += n;
+    }
+}
+
+/**
+ * @brief Mark a run of frames as free, one bitmap word at a time.
+ *
+ * @param[in] start First frame index
+ * @param[in] count Number of frames
+ */
+static void bitmap_unset_range(uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+
+    if (count == 0) return;
+    if (start / (64 * 64) < next_free_summary) {
+        next_free_summary = start / (64 * 64);
+    }
+
+    while (start < end) {
+        uint64_t word = start / 64;
+        uint64_t bit = start % 64;
+        uint64_t n = 64 - bit;
+        if (n > end - start) n = end - start;
+
+        uint64_t mask = word_mask(bit, n);
+        free_frames_count += __builtin_popcountll(bitmap[word] & mask);
+        bitmap[word] &= ~mask;
+        summary[word / 64] |= 1ULL << (word % 64);
+        start += n;
+    }
 }
 
 static uint64_t get_frame_index(uint64_t physical_address) {
     return physical_address / PAGE_SIZE;
 }
 
-// 4. Initialization
+/**
+ * @brief Find the first free frame at or after a summary word.
+ *
+ * Two ctz instructions per hit: one picks the leaf word out of the summary,
+ * the other picks the clear bit out of the leaf.
+ *
+ * @param[in] start First summary word to scan
+ * @param[in] end   One past the last summary word to scan
+ * @return int64_t Frame index, or -1 if the range has no free frame
+ */
+static int64_t bitmap_find_free(uint64_t start, uint64_t end) {
+    for (uint64_t s = start; s < end; s++) {
+        if (summary[s] == 0) continue;
+
+        uint64_t word = s * 64 + __builtin_ctzll(summary[s]);
+        uint64_t bit = __builtin_ctzll(~bitmap[word]);
+        return (int64_t)(word * 64 + bit);
+    }
+    return -1;
+}
+
+// 5. Buddy Engine
+static int area_test(uint32_t order, uint64_t block) {
+    struct free_area* area = &free_areas[order];
+    return (area->map[block / 64] & (1ULL << (block % 64))) != 0;
+}
+
+static void area_set(uint32_t order, uint64_t block) {
+    struct free_area* area = &free_areas[order];
+    area->map[block / 64] |= 1ULL << (block % 64);
+    area->count++;
+    if (block / 64 < area->hint) {
+        area->hint = block / 64;
+    }
+}
+
+static void area_clear(uint32_t order, uint64_t block) {
+    struct free_area* area = &free_areas[order];
+    area->map[block / 64] &= ~(1ULL << (block % 64));
+    area->count--;
+}
+
+/**
+ * @brief Find any free block of the given order.
+ *
+ * @param[in] order Order to search (the area must have count > 0)
+ * @return int64_t Block index, or -1 if the area is empty
+ */
+static int64_t area_find(uint32_t order) {
+    struct free_area* area = &free_areas[order];
+
+    for (uint64_t w = area->hint; w < area->words; w++) {
+        if (area->map[w] != 0) {
+            area->hint = w;
+            return (int64_t)(w * 64 + __builtin_ctzll(area->map[w]));
+        }
+    }
+    area->hint = area->words;
+    return -1;
+}
+
+/**
+ * @brief Return a block to the buddy areas, merging it with free buddies.
+ *
+ * Each step up costs one bit test, so this is O(PMM_MAX_ORDER).
+ *
+ * @param[in] frame First frame of the block (aligned to 2^order frames)
+ * @param[in] order Order of the block
+ */
+static void buddy_insert(uint64_t frame, uint32_t order) {
+    uint64_t block = frame >> order;
+
+    while (order < PMM_MAX_ORDER && area_test(order, block ^ 1)) {
+        area_clear(order, block ^ 1);
+        block >>= 1;
+        order++;
+    }
+    area_set(order, block);
+}
+
+/**
+ * @brief Split a free block down to a smaller aligned block inside it.
+ *
+ * The block (from_block, from_order) must already be removed from its area.
+ * Every half that does not contain the target is given back at its order.
+ *
+ * @param[in] frame      First frame of the target block
+ * @param[in] from_order Order of the block being split
+ * @param[in] to_order   Order of the target block
+ */
+static void buddy_split(uint64_t frame, uint32_t from_order, uint32_t to_order) {
+    while (from_order > to_order) {
+        from_order--;
+        area_set(from_order, (frame >> from_order) ^ 1);
+    }
+}
+
+/**
+ * @brief Take a single frame that the bitmap says is free out of the buddy areas.
+ *
+ * Finds the free block that contains the frame and splits it down to order 0.
+ *
+ * @param[in] frame Frame index being allocated
+ */
+static void buddy_claim(uint64_t frame) {
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        if (area_test(order, frame >> order)) {
+            area_clear(order, frame >> order);
+            buddy_split(frame, order, 0);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Hand a run of frames to both the bitmap and the buddy areas.
+ *
+ * The run is cut into the largest naturally aligned blocks that fit.
+ *
+ * @param[in] start First frame index
+ * @param[in] end   One past the last frame index
+ */
+static void pmm_release_range(uint64_t start, uint64_t end) {
+    if (start >= end) return;
+
+    bitmap_unset_range(start, end - start);
+
+    while (start < end) {
+        uint32_t order = 0;
+        while (order < PMM_MAX_ORDER &&
+               (start & ((2ULL << order) - 1)) == 0 &&
+               start + (2ULL << order) <= end) {
+            order++;
+        }
+        buddy_insert(start, order);
+        start += 1ULL << order;
+    }
+}
+
+/**
+ * @brief Release an available range, skipping every reserved range.
+ *
+ * @param[in] start First frame index
+ * @param[in] end   One past the last frame index
+ * @param[in] first First entry of the reserved table still to check
+ */
+static void pmm_release_available(uint64_t start, uint64_t end, int first) {
+    for (int i = first; i < reserved_count && start < end; i++) {
+        if (reserved[i].end <= start || reserved[i].start >= end) continue;
+
+        if (reserved[i].start > start) {
+            pmm_release_available(start, reserved[i].start, i + 1);
+        }
+        start = reserved[i].end;
+    }
+    pmm_release_range(start, end);
+}
+
+static void pmm_reserve(uint64_t start_addr, uint64_t end_addr) {
+    if (reserved_count == PMM_MAX_RESERVED) return;
+
+    reserved[reserved_count].start = start_addr / PAGE_SIZE;
+    reserved[reserved_count].end = (end_addr + PAGE_SIZE - 1) / PAGE_SIZE;
+    reserved_count++;
+}
+
+static void* pmm_mag_refill(void* ctx);
+static void pmm_mag_drain(void* ctx, void* frame_addr);
+
+// 6. Initialization
+/**
+ * @brief Find the memory map tag in the multiboot info.
+ *
+ * @param[in] multiboot_addr Address of the multiboot info structure
+ * @return struct multiboot_tag_mmap* The tag, or NULL if GRUB gave none
+ */
+static struct multiboot_tag_mmap* pmm_find_mmap(uint64_t multiboot_addr) {
+    struct multiboot_tag* tag = (struct multiboot_tag*)phys_to_virt(multiboot_addr + 8);
+
+    while (tag->type != 0) {
+        if (tag->type == MULTIBOOT_TAG_TYPE_MMAP) {
+            return (struct multiboot_tag_mmap*)tag;
+        }
+        tag = (struct multiboot_tag*) ((uint8_t*)tag + ((tag->size + 7) & ~7));
+    }
+    return NULL;
+}
+
+static struct multiboot_mmap_entry* pmm_mmap_entry(struct multiboot_tag_mmap* mmap,
+                                                   int i) {
+    return (struct multiboot_mmap_entry*) ((uint64_t)mmap->entries +
+                                           (i * mmap->entry_size));
+}
+
 /**
  * @brief Initialize the Physical Memory Manager.
  *
@@ -54,125 +418,278 @@ static uint64_t get_frame_index(uint64_t physical_address) {
 void pmm_init(uint64_t multiboot_addr, uint64_t kernel_end) {
     terminal_writestring("[PMM] Init started.\n");
 
-    // Debug: Print where this putting the bitmap
-    terminal_writestring("[PMM] Bitmap stored at: 0x500000 (5MB)\n");
+    // A. Parse Multiboot
+    terminal_writestring("[PMM] Parsing multiboot info...\n");
+    struct multiboot_tag_mmap* mmap = pmm_find_mmap(multiboot_addr);
+    if (!mmap) {
+        terminal_writestring("[PMM] No Memory Map! Nothing to manage.\n");
+        return;
+    }
+    terminal_writestring("[PMM] Found Memory Map!\n");
 
-    // A. Mark EVERYTHING as used initially
-    free_frames_count = 0;
-    next_free_frame = 0;
-    
-    // Safer initialization: write one byte at a time
-    terminal_writestring("[PMM] Initializing bitmap...\n");
-    for (uint32_t i = 0; i < BITMAP_SIZE; i++) {
-        bitmap[i] = 0xFF; 
+    int num_entries = (mmap->size - sizeof(struct multiboot_tag_mmap)) /
+                      mmap->entry_size;
+
+    // B. Size everything from the highest usable address
+    uint64_t highest_addr = 0;
+    for (int i = 0; i < num_entries; i++) {
+        struct multiboot_mmap_entry* entry = pmm_mmap_entry(mmap, i);
+        if (entry->type == MULTIBOOT_MEMORY_AVAILABLE &&
+            entry->addr + entry->len > highest_addr) {
+            highest_addr = entry->addr + entry->len;
+        }
     }
-    terminal_writestring("[PMM] Bitmap initialized.\n");
-    free_frames_count = 0;  // Reset counter after marking all as used
-    
-    // B. Parse Multiboot
-    terminal_writestring("[PMM] Parsing multiboot info...\n");
-    struct multiboot_tag* tag = (struct multiboot_tag*)(multiboot_addr + 8);
 
-    while (tag->type != 0) {
-        if (tag->type == MULTIBOOT_TAG_TYPE_MMAP) {
-            terminal_writestring("[PMM] Found Memory Map!\n");
-
-            struct multiboot_tag_mmap* mmap = (struct multiboot_tag_mmap*) tag;
-            int num_entries = (mmap->size - sizeof(struct multiboot_tag_mmap)) /
-                              mmap->entry_size;
-
-            terminal_writestring("[PMM] Processing entries...\n");
-
-            for (int i = 0; i < num_entries; i++) {
-                struct multiboot_mmap_entry* entry =
-                    (struct multiboot_mmap_entry*) ((uint64_t)mmap->entries +
-                                                     (i * mmap->entry_size));
-                
-                // If region is Available (Type 1), free those frames
-                if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
-                    uint64_t start_frame = entry->addr / PAGE_SIZE;
-                    uint64_t end_frame = (entry->addr + entry->len) / PAGE_SIZE;
-
-                    if (end_frame > FRAMES_COUNT) end_frame = FRAMES_COUNT;
-
-                    // Do not free the bitmap's own memory (5MB to 5MB + 128KB)
-                    uint64_t bitmap_start = 0x500000 / PAGE_SIZE;
-                    uint64_t bitmap_end = bitmap_start + (BITMAP_SIZE / PAGE_SIZE) + 1;
-
-                    for (uint64_t f = start_frame; f < end_frame; f++) {
-                        // Skip the bitmap area itself!
-                        if (f >= bitmap_start && f < bitmap_end) continue;
-                        
-                        bitmap_unset(f);
-                    }
-                }
-            }
-            
-            terminal_writestring("[PMM] Entries processed.\n");
+    highest_usable_addr = highest_addr;
+    frames_count = highest_addr / PAGE_SIZE;
+    frames_count = (frames_count + FRAMES_PER_SUMMARY_WORD - 1) &
+                   ~(uint64_t)(FRAMES_PER_SUMMARY_WORD - 1);
+    bitmap_words = frames_count / 64;
+    summary_words = bitmap_words / 64;
+
+    // C. Place the tracking structures right after the kernel image.
+    // GRUB may have put the multiboot info behind the kernel; skip it too.
+    uint64_t multiboot_end = multiboot_addr + *(uint32_t*)phys_to_virt(multiboot_addr);
+    uint64_t meta_start = kernel_end > multiboot_end ? kernel_end : multiboot_end;
+    meta_start = (meta_start + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t meta_end = meta_start;
+
+    bitmap = (uint64_t*)phys_to_virt(meta_end);
+    meta_end += bitmap_words * sizeof(uint64_t);
+    cached = (uint64_t*)phys_to_virt(meta_end);
+    meta_end += bitmap_words * sizeof(uint64_t);
+    summary = (uint64_t*)phys_to_virt(meta_end);
+    meta_end += summary_words * sizeof(uint64_t);
+
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        struct free_area* area = &free_areas[order];
+        area->map = (uint64_t*)phys_to_virt(meta_end);
+        area->words = (frames_count >> order) / 64;
+        if (area->words == 0) area->words = 1;
+        area->count = 0;
+        area->hint = 0;
+        meta_end += area->words * sizeof(uint64_t);
+    }
+
+    frame_shares = (uint16_t*)phys_to_virt(meta_end);
+    meta_end += frames_count * sizeof(uint16_t);
+    frame_tags = (uint8_t*)phys_to_virt(meta_end);
+    meta_end += frames_count * sizeof(uint8_t);
+
+    terminal_writestring("[PMM] Highest usable address: ");
+    terminal_writehex(highest_addr);
+    terminal_writestring("\n[PMM] Bitmap stored at: ");
+    terminal_writehex(meta_start);
+    terminal_writestring("\n");
+
+    // D. Mark EVERYTHING as used initially
+    terminal_writestring("[PMM] Initializing bitmap...\n");
+    for (uint64_t i = 0; i < bitmap_words; i++) {
+        bitmap[i] = ~0ULL;
+        cached[i] = 0;
+    }
+    for (uint64_t i = 0; i < summary_words; i++) {
+        summary[i] = 0;
+    }
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        for (uint64_t w = 0; w < free_areas[order].words; w++) {
+            free_areas[order].map[w] = 0;
         }
-        tag = (struct multiboot_tag*) ((uint8_t*)tag + ((tag->size + 7) & ~7));
     }
+    for (uint64_t i = 0; i < frames_count; i++) {
+        frame_shares[i] = 0;
+        frame_tags[i] = 0;
+    }
+    free_frames_count = 0;
+    next_free_summary = 0;
+    magazine_layer_init(&frame_mags, "pmm_frames", pmm_mag_refill, pmm_mag_drain, NULL);
+    terminal_writestring("[PMM] Bitmap initialized.\n");
+
+    // E. Collect what must never be handed out
+    // Kernel & Low Memory, plus extra safety for BIOS/GRUB (first 2MB)
+    reserved_count = 0;
+    pmm_reserve(0, kernel_end > 0x200000 ? kernel_end : 0x200000);
+    pmm_reserve(multiboot_addr, multiboot_end);
+    pmm_reserve(meta_start, meta_end);
 
-    // C. Mark Kernel & Low Memory as Used
-    terminal_writestring("[PMM] Marking kernel memory...\n");
-    uint64_t reserved_frames = (kernel_end + PAGE_SIZE - 1) / PAGE_SIZE;
-    // Add extra safety for BIOS/GRUB (first 2MB)
-    if (reserved_frames < 512) reserved_frames = 512; 
+    // F. Free the Available (Type 1) regions, one word-wide fill per range
+    terminal_writestring("[PMM] Processing entries...\n");
+    for (int i = 0; i < num_entries; i++) {
+        struct multiboot_mmap_entry* entry = pmm_mmap_entry(mmap, i);
+        if (entry->type != MULTIBOOT_MEMORY_AVAILABLE) continue;
 
-    for (uint64_t f = 0; f < reserved_frames; f++) {
-        bitmap_set(f);
+        uint64_t start_frame = (entry->addr + PAGE_SIZE - 1) / PAGE_SIZE;
+        uint64_t end_frame = (entry->addr + entry->len) / PAGE_SIZE;
+
+        if (region_count < PMM_MAX_REGIONS && start_frame < end_frame) {
+            regions[region_count].start = start_frame;
+            regions[region_count].end = end_frame;
+            region_count++;
+        }
+
+        // Seeds both the bitmap and the buddy areas
+        pmm_release_available(start_frame, end_frame, 0);
     }
+    terminal_writestring("[PMM] Entries processed.\n");
 
     terminal_writestring("[PMM] Init Complete.\n");
 }
 
-// 6. Allocation / Free
+// 7. Allocation / Free
 /**
- * @brief Allocate a single physical page frame.
+ * @brief Take a single frame straight from the bitmap (pmm_lock held).
  *
  * @return void* Physical address of allocated frame, or NULL if none available
  */
-void* pmm_alloc_frame() {
+static void* pmm_alloc_frame_bitmap(void) {
     // Quick check: no free frames
     if (free_frames_count == 0) {
         return NULL;
     }
 
-    // Start from next_free_frame to avoid rescanning
-    for (uint64_t i = next_free_frame; i < FRAMES_COUNT; i++) {
-        if (!bitmap_test(i)) {
-            bitmap_set(i);
-            next_free_frame = i + 1;  // Update for next allocation
-            return (void*)(i * PAGE_SIZE);
-        }
+    // Start from the hint to skip summary words known to be full,
+    // then wrap around in case the hint went stale.
+    int64_t frame = bitmap_find_free(next_free_summary, summary_words);
+    if (frame < 0) {
+        frame = bitmap_find_free(0, next_free_summary);
     }
-
-    // Wrap around and search from beginning
-    for (uint64_t i = 0; i < next_free_frame; i++) {
-        if (!bitmap_test(i)) {
-            bitmap_set(i);
-            next_free_frame = i + 1;
-            return (void*)(i * PAGE_SIZE);
-        }
+    if (frame < 0) {
+        return NULL;
     }
 
-    return NULL;
+    bitmap_set((uint64_t)frame);
+    buddy_claim((uint64_t)frame);
+    next_free_summary = (uint64_t)frame / (64 * 64);
+    return (void*)((uint64_t)frame * PAGE_SIZE);
+}
+
+// Give a single frame straight back to the bitmap and the buddy areas
+// (pmm_lock held)
+static void pmm_free_frame_bitmap(uint64_t frame) {
+    // bitmap_unset() also pulls the summary hint back if needed
+    bitmap_unset(frame);
+    buddy_insert(frame, 0);
+}
+
+// Magazine backend: frames move between the magazines and the bitmap
+static void* pmm_mag_refill(void* ctx) {
+    (void)ctx;
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    void* frame = pmm_alloc_frame_bitmap();
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return frame;
+}
+
+static void pmm_mag_drain(void* ctx, void* frame_addr) {
+    (void)ctx;
+    uint64_t frame = get_frame_index((uint64_t)frame_addr);
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    cached_clear(frame);
+    pmm_free_frame_bitmap(frame);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/**
+ * @brief Allocate a single physical page frame.
+ *
+ * Served from this CPU's magazine when possible.
+ *
+ * @return void* Physical address of allocated frame, or NULL if none available
+ */
+void* pmm_alloc_frame() {
+    void* frame = magazine_alloc(&frame_mags);
+    if (frame) cached_clear(get_frame_index((uint64_t)frame));
+    return frame;
 }
 
 /**
  * @brief Free a previously allocated physical page frame.
  *
+ * A shared frame only loses one reference; it is freed with the last one.
+ * Freed frames go to this CPU's magazine first. Freeing a frame that is
+ * already free (in the bitmap or a magazine) is ignored.
+ *
  * @param[in] frame_addr Physical address of the frame to free
  */
 void pmm_free_frame(void* frame_addr) {
     uint64_t frame = get_frame_index((uint64_t)frame_addr);
-    if (frame < FRAMES_COUNT && bitmap_test(frame)) {
-        bitmap_unset(frame);
-        // Update next_free_frame if freed an earlier frame
-        if (frame < next_free_frame) {
-            next_free_frame = frame;
+    if (frame >= frames_count) return;
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    if (frame_shares[frame] > 0) {
+        frame_shares[frame]--;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return;
+    }
+    int owned = bitmap_test(frame) && cached_set(frame);
+    if (owned) frame_tags[frame] = 0;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
+    if (owned) magazine_free(&frame_mags, frame_addr);
+}
+
+/**
+ * @brief Allocate 2^order physically contiguous frames.
+ *
+ * @param[in] order Block size as a power of two (0 - PMM_MAX_ORDER)
+ * @return void* Physical address of the first frame, or NULL if none available
+ */
+void* pmm_alloc_frames(uint32_t order) {
+    if (order > PMM_MAX_ORDER) {
+        return NULL;
+    }
+
+    // Smallest block that is big enough wins; split off the rest
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    for (uint32_t o = order; o <= PMM_MAX_ORDER; o++) {
+        if (free_areas[o].count == 0) continue;
+
+        int64_t block = area_find(o);
+        if (block < 0) continue;
+
+        uint64_t frame = (uint64_t)block << o;
+        area_clear(o, (uint64_t)block);
+        buddy_split(frame, o, order);
+        bitmap_set_range(frame, 1ULL << order);
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return (void*)(frame * PAGE_SIZE);
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
+    return NULL;
+}
+
+/**
+ * @brief Free a block returned by pmm_alloc_frames().
+ *
+ * @param[in] addr  Physical address of the first frame
+ * @param[in] order Order the block was allocated with
+ */
+void pmm_free_frames(void* addr, uint32_t order) {
+    uint64_t frame = get_frame_index((uint64_t)addr);
+
+    if (order > PMM_MAX_ORDER) return;
+    if (frame & ((1ULL << order) - 1)) return;  // Not a block of this order
+    if (frame + (1ULL << order) > frames_count) return;
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    if (frame_owned(frame)) {                   // Else a double free
+        for (uint64_t i = 0; i < (1ULL << order); i++) {
+            frame_tags[frame + i] = 0;
         }
+        bitmap_unset_range(frame, 1ULL << order);
+        buddy_insert(frame, order);
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+/**
+ * @brief Get the end of the highest usable RAM region.
+ *
+ * @return uint64_t Physical address one past the last usable byte
+ */
+uint64_t pmm_get_highest_address(void) {
+    return highest_usable_addr;
 }
 
 /**
@@ -181,5 +698,233 @@ void pmm_free_frame(void* frame_addr) {
  * @return uint64_t Number of free physical frames
  */
 uint64_t pmm_get_free_frames(void) {
-    return free_frames_count;
-}
\ No newline at end of file
+    // Frames cached in magazines are free too, even if the bitmap says used
+    return free_frames_count + magazine_cached(&frame_mags);
+}
+
+/**
+ * @brief Add a reference to an allocated frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ */
+int pmm_share_frame(void* frame_addr) {
+    uint64_t frame = get_frame_index((uint64_t)frame_addr);
+    if (frame >= frames_count) return -1;
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    int ok = frame_owned(frame) && frame_shares[frame] < PMM_MAX_SHARES;
+    if (ok) frame_shares[frame]++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return ok ? 0 : -1;
+}
+
+/**
+ * @brief Count the references held on a frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @return uint32_t 0 if the frame is free, otherwise its number of owners
+ */
+uint32_t pmm_frame_refs(void* frame_addr) {
+    uint64_t frame = get_frame_index((uint64_t)frame_addr);
+    if (frame >= frames_count) return 0;
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    uint32_t refs = frame_owned(frame) ? 1 + frame_shares[frame] : 0;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return refs;
+}
+
+/**
+ * @brief Set the owner tag of an allocated frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @param[in] tag        Value defined by the owning allocator
+ */
+void pmm_set_frame_tag(void* frame_addr, uint8_t tag) {
+    uint64_t frame = get_frame_index((uint64_t)frame_addr);
+    if (frame < frames_count) {
+        frame_tags[frame] = tag;
+    }
+}
+
+/**
+ * @brief Read the owner tag of a frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @return uint8_t The tag (0 for free or untagged frames)
+ */
+uint8_t pmm_get_frame_tag(void* frame_addr) {
+    uint64_t frame = get_frame_index((uint64_t)frame_addr);
+    if (frame >= frames_count) return 0;
+    return frame_tags[frame];
+}
+
+// 8. Pre-zeroed Frame Pool
+/**
+ * @brief Fill a physical frame with zeroes.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ */
+static void pmm_zero_frame(uint64_t frame_addr) {
+    uint64_t* ptr = (uint64_t*)phys_to_virt(frame_addr);
+    uint64_t count = PAGE_SIZE / sizeof(uint64_t);
+
+    __asm__ volatile("rep stosq"
+                     : "+D"(ptr), "+c"(count)
+                     : "a"(0ULL)
+                     : "memory");
+}
+
+/**
+ * @brief Allocate a single physical frame filled with zeroes.
+ *
+ * @return void* Physical address of allocated frame, or NULL if none available
+ */
+void* pmm_alloc_zeroed_frame(void) {
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    if (zero_pool_count > 0) {
+        uint64_t frame = zero_pool[--zero_pool_count];
+        zero_pool_hits++;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return (void*)frame;
+    }
+    zero_pool_misses++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+
+    void* frame = pmm_alloc_frame();
+
+    // Pool ran dry: pay for the zeroing inline
+    if (frame) {
+        pmm_zero_frame((uint64_t)frame);
+    }
+    return frame;
+}
+
+/**
+ * @brief Top up the pre-zeroed frame pool.
+ *
+ * @param[in] max_frames Upper bound on frames zeroed by this call
+ * @return uint32_t Number of frames added to the pool
+ */
+uint32_t pmm_refill_zero_pool(uint32_t max_frames) {
+    uint32_t added = 0;
+
+    while (added < max_frames) {
+        if (zero_pool_count >= ZERO_POOL_SIZE) break;
+        void* frame = pmm_alloc_frame();
+        if (!frame) break;
+
+        // The slow part runs without the lock. Other CPUs may fill the
+        // pool meanwhile: a frame that no longer fits goes back.
+        pmm_zero_frame((uint64_t)frame);
+
+        uint64_t flags = spin_lock_irqsave(&pmm_lock);
+        int stored = zero_pool_count < ZERO_POOL_SIZE;
+        if (stored) zero_pool[zero_pool_count++] = (uint64_t)frame;
+        spin_unlock_irqrestore(&pmm_lock, flags);
+
+        if (!stored) {
+            pmm_free_frame(frame);
+            break;
+        }
+        added++;
+    }
+    return added;
+}
+
+/**
+ * @brief Read the pre-zeroed pool counters.
+ *
+ * @param[out] stats Filled with the current pool level and hit/miss counters
+ */
+void pmm_get_zero_pool_stats(struct pmm_zero_pool_stats* stats) {
+    stats->count = zero_pool_count;
+    stats->capacity = ZERO_POOL_SIZE;
+    stats->hits = zero_pool_hits;
+    stats->misses = zero_pool_misses;
+}
+
+// 9. Statistics
+// Count the free frames in [start, end) one bitmap word at a time
+static uint64_t bitmap_count_free(uint64_t start, uint64_t end) {
+    uint64_t count = 0;
+    while (start < end) {
+        uint64_t bit = start % 64;
+        uint64_t n = 64 - bit;
+        if (n > end - start) n = end - start;
+
+        uint64_t free_bits = ~bitmap[start / 64] & word_mask(bit, n);
+        count += __builtin_popcountll(free_bits);
+        start += n;
+    }
+    return count;
+}
+
+int pmm_get_region_stats(struct pmm_region_stats* stats, int max) {
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    int n = 0;
+    for (; n < region_count && n < max; n++) {
+        uint64_t start = regions[n].start;
+        uint64_t end = regions[n].end < frames_count ? regions[n].end : frames_count;
+        uint64_t free = start < end ? bitmap_count_free(start, end) : 0;
+
+        stats[n].start = regions[n].start * PAGE_SIZE;
+        stats[n].end = regions[n].end * PAGE_SIZE;
+        stats[n].free_frames = free;
+        stats[n].used_frames = (regions[n].end - regions[n].start) - free;
+    }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return n;
+}
+
+// Close a free run and file it in the histogram
+static void frag_add_run(struct pmm_frag_stats* stats, uint64_t run) {
+    if (run == 0) return;
+
+    uint32_t bucket = 63 - __builtin_clzll(run);
+    if (bucket >= PMM_RUN_BUCKETS) bucket = PMM_RUN_BUCKETS - 1;
+
+    stats->runs[bucket]++;
+    stats->run_count++;
+    if (run > stats->largest_run) stats->largest_run = run;
+}
+
+void pmm_get_frag_stats(struct pmm_frag_stats* stats) {
+    stats->largest_run = 0;
+    stats->run_count = 0;
+    for (int i = 0; i < PMM_RUN_BUCKETS; i++) {
+        stats->runs[i] = 0;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&pmm_lock);
+    uint64_t run = 0;
+    for (uint64_t w = 0; w < bitmap_words; w++) {
+        uint64_t word = bitmap[w];
+
+        // Whole words first: all free extends the run, all used ends it
+        if (word == 0) {
+            run += 64;
+            continue;
+        }
+        if (word == ~0ULL) {
+            frag_add_run(stats, run);
+            run = 0;
+            continue;
+        }
+
+        for (int bit = 0; bit < 64; bit++) {
+            if (word & (1ULL << bit)) {
+                frag_add_run(stats, run);
+                run = 0;
+            } else {
+                run++;
+            }
+        }
+    }
+    frag_add_run(stats, run);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+uint64_t pmm_get_cached_frames(void) {
+    return magazine_cached(&frame_mags);
+}
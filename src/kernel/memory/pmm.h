@@ -7,6 +7,42 @@
 // Page Size is 4KB (Standard for x86_64)
 #define PAGE_SIZE 4096
 
+// Largest buddy block: 2^10 frames = 4MB (order 9 = one 2MB huge page)
+#define PMM_MAX_ORDER 10
+
+// Extra references a frame can hold (the share count is 16 bits wide)
+#define PMM_MAX_SHARES 0xFFFF
+
+// Available regions of the memory map tracked for statistics
+#define PMM_MAX_REGIONS 16
+
+// Free-run histogram: bucket B counts runs of 2^B to 2^(B+1) - 1 frames
+// (the last bucket also takes everything longer)
+#define PMM_RUN_BUCKETS 16
+
+// Usage of one available memory map region
+struct pmm_region_stats {
+    uint64_t start;         // Physical start (frame aligned)
+    uint64_t end;           // Physical end (exclusive)
+    uint64_t free_frames;
+    uint64_t used_frames;   // Includes frames cached in magazines
+};
+
+// Fragmentation of the free frames
+struct pmm_frag_stats {
+    uint64_t largest_run;               // Longest run of free frames
+    uint64_t run_count;                 // Number of free runs
+    uint64_t runs[PMM_RUN_BUCKETS];     // Runs per log2 length bucket
+};
+
+// Counters of the pre-zeroed frame pool
+struct pmm_zero_pool_stats {
+    uint32_t count;     // Frames ready in the pool right now
+    uint32_t capacity;  // Maximum frames the pool holds
+    uint64_t hits;      // Allocations served from the pool
+    uint64_t misses;    // Allocations that had to zero inline
+};
+
 /**
  * @brief Get the number of free frames available.
  *
@@ -14,13 +50,23 @@
  */
 uint64_t pmm_get_free_frames(void);
 
+/**
+ * @brief Get the end of the highest usable RAM region.
+ *
+ * Everything below this address is covered by the direct physical map.
+ *
+ * @return uint64_t Physical address one past the last usable byte
+ */
+uint64_t pmm_get_highest_address(void);
+
 /**
  * @brief Initialize the Physical Memory Manager.
  *
  * Parses the multiboot memory map and sets up the frame bitmap.
  * Marks kernel and reserved regions as used.
+ * Runs on the boot page tables, which direct-map the first 1GB.
  *
- * @param[in] multiboot_addr     Address of the multiboot info structure
+ * @param[in] multiboot_addr     Physical address of the multiboot info structure
  * @param[in] kernel_physical_end Physical end address of the kernel
  */
 void pmm_init(uint64_t multiboot_addr, uint64_t kernel_physical_end);
@@ -35,8 +81,127 @@ void* pmm_alloc_frame(void);
 /**
  * @brief Free a previously allocated physical page frame.
  *
+ * If other references were added with pmm_share_frame(), this only drops
+ * one of them and the frame stays allocated.
+ *
  * @param[in] frame_addr Physical address of the frame to free
  */
 void pmm_free_frame(void* frame_addr);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Add a reference to an allocated frame.
+ *
+ * Used for frames mapped by several address spaces (copy-on-write).
+ * Each reference is dropped by one pmm_free_frame() call. The count
+ * saturates: once a frame has PMM_MAX_SHARES extra references, further
+ * calls fail and the caller must give the new mapping its own copy.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @return int 0 on success, -1 if the frame is not allocated or saturated
+ */
+int pmm_share_frame(void* frame_addr);
+
+/**
+ * @brief Count the references held on a frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @return uint32_t 0 if the frame is free, otherwise its number of owners
+ */
+uint32_t pmm_frame_refs(void* frame_addr);
+
+/**
+ * @brief Set the owner tag of an allocated frame.
+ *
+ * One byte per frame, free for the allocator that owns the frame to use
+ * (the heap records which slab a frame belongs to). Cleared on free.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @param[in] tag        Value defined by the owning allocator
+ */
+void pmm_set_frame_tag(void* frame_addr, uint8_t tag);
+
+/**
+ * @brief Read the owner tag of a frame.
+ *
+ * @param[in] frame_addr Physical address of the frame
+ * @return uint8_t The tag (0 for free or untagged frames)
+ */
+uint8_t pmm_get_frame_tag(void* frame_addr);
+
+/**
+ * @brief Allocate 2^order physically contiguous frames.
+ *
+ * Blocks come from the buddy allocator and are naturally aligned to their
+ * own size, so an order 9 block can back a 2MB huge page.
+ *
+ * @param[in] order Block size as a power of two (0 - PMM_MAX_ORDER)
+ * @return void* Physical address of the first frame, or NULL if none available
+ */
+void* pmm_alloc_frames(uint32_t order);
+
+/**
+ * @brief Free a block returned by pmm_alloc_frames().
+ *
+ * The block is merged with its free buddies on the way back.
+ *
+ * @param[in] addr  Physical address of the first frame
+ * @param[in] order Order the block was allocated with
+ */
+void pmm_free_frames(void* addr, uint32_t order);
+
+/**
+ * @brief Allocate a single physical page frame filled with zeroes.
+ *
+ * Served from the pre-zeroed pool when possible; falls back to
+ * pmm_alloc_frame() plus inline zeroing when the pool is empty.
+ * Safe to call with interrupts enabled or disabled.
+ *
+ * @return void* Physical address of allocated frame, or NULL if none available
+ */
+void* pmm_alloc_zeroed_frame(void);
+
+/**
+ * @brief Top up the pre-zeroed frame pool.
+ *
+ * Meant for the idle loop: frames are zeroed with interrupts enabled,
+ * so a pending IRQ is never held up by more than one frame's worth of work.
+ *
+ * @param[in] max_frames Upper bound on frames zeroed by this call
+ * @return uint32_t Number of frames added to the pool
+ */
+uint32_t pmm_refill_zero_pool(uint32_t max_frames);
+
+/**
+ * @brief Read the pre-zeroed pool counters.
+ *
+ * @param[out] stats Filled with the current pool level and hit/miss counters
+ */
+void pmm_get_zero_pool_stats(struct pmm_zero_pool_stats* stats);
+
+/**
+ * @brief Get free/used frame counts per available memory map region.
+ *
+ * @param[out] stats Array filled with one entry per region
+ * @param[in]  max   Capacity of the array
+ * @return int Number of entries written
+ */
+int pmm_get_region_stats(struct pmm_region_stats* stats, int max);
+
+/**
+ * @brief Measure how fragmented the free frames are.
+ *
+ * Walks the whole bitmap (64 frames per step where words are all free or
+ * all used). Frames cached in magazines count as used.
+ *
+ * @param[out] stats Largest free run and run length histogram
+ */
+void pmm_get_frag_stats(struct pmm_frag_stats* stats);
+
+/**
+ * @brief Get the number of free frames parked in per-CPU magazines.
+ *
+ * @return uint64_t Frames free but not visible in the bitmap
+ */
+uint64_t pmm_get_cached_frames(void);
+
+#endif
@@ -0,0 +1,172 @@
+#include "vma.h"
+#include "heap.h"
+#include "../core/spinlock.h"
+
+// 1. Descriptor cache
+// Created on first use, so the heap only has to be up before the first
+// region is reserved. The lock keeps two CPUs from both creating it.
+static struct kmem_cache* vma_cache = NULL;
+static struct spinlock vma_cache_lock = SPINLOCK_INIT("vma_cache");
+
+struct vma* vma_alloc(void) {
+    struct kmem_cache* cache = __atomic_load_n(&vma_cache, __ATOMIC_ACQUIRE);
+    if (!cache) {
+        spin_lock(&vma_cache_lock);
+        cache = vma_cache;
+        if (!cache) {
+            cache = kmem_cache_create("vma", sizeof(struct vma), 0);
+            __atomic_store_n(&vma_cache, cache, __ATOMIC_RELEASE);
+        }
+        spin_unlock(&vma_cache_lock);
+        if (!cache) return NULL;
+    }
+
+    struct vma* vma = kmem_cache_alloc(cache);
+    if (!vma) return NULL;
+
+    vma->start = 0;
+    vma->end = 0;
+    vma->flags = 0;
+    vma->left = NULL;
+    vma->right = NULL;
+    vma->height = 1;
+    return vma;
+}
+
+void vma_free(struct vma* vma) {
+    kmem_cache_free(vma_cache, vma);
+}
+
+// 2. AVL balancing helpers
+static int vma_height(struct vma* node) {
+    return node ? node->height : 0;
+}
+
+static void vma_update(struct vma* node) {
+    int l = vma_height(node->left);
+    int r = vma_height(node->right);
+    node->height = (l > r ? l : r) + 1;
+}
+
+static struct vma* vma_rotate_right(struct vma* node) {
+    struct vma* pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    vma_update(node);
+    vma_update(pivot);
+    return pivot;
+}
+
+static struct vma* vma_rotate_left(struct vma* node) {
+    struct vma* pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    vma_update(node);
+    vma_update(pivot);
+    return pivot;
+}
+
+/**
+ * @brief Restore the AVL property at one node after a child changed.
+ *
+ * @param[in] node Subtree root whose children are already balanced
+ * @return struct vma* New subtree root
+ */
+static struct vma* vma_balance(struct vma* node) {
+    vma_update(node);
+    int diff = vma_height(node->left) - vma_height(node->right);
+
+    if (diff > 1) {
+        if (vma_height(node->left->left) < vma_height(node->left->right)) {
+            node->left = vma_rotate_left(node->left);
+        }
+        return vma_rotate_right(node);
+    }
+    if (diff < -1) {
+        if (vma_height(node->right->right) < vma_height(node->right->left)) {
+            node->right = vma_rotate_right(node->right);
+        }
+        return vma_rotate_left(node);
+    }
+    return node;
+}
+
+// 3. Tree operations
+static struct vma* vma_insert_at(struct vma* node, struct vma* vma, int* err) {
+    if (!node) return vma;
+
+    if (vma->end <= node->start) {
+        node->left = vma_insert_at(node->left, vma, err);
+    } else if (vma->start >= node->end) {
+        node->right = vma_insert_at(node->right, vma, err);
+    } else {
+        // Overlaps this region
+        *err = -1;
+        return node;
+    }
+    return vma_balance(node);
+}
+
+int vma_insert(struct vma** root, struct vma* vma) {
+    int err = 0;
+    vma->left = NULL;
+    vma->right = NULL;
+    vma->height = 1;
+    *root = vma_insert_at(*root, vma, &err);
+    return err;
+}
+
+struct vma* vma_find(struct vma* root, uint64_t addr) {
+    while (root) {
+        if (addr < root->start) {
+            root = root->left;
+        } else if (addr >= root->end) {
+            root = root->right;
+        } else {
+            return root;
+        }
+    }
+    return NULL;
+}
+
+// Detach the smallest node of a subtree into *min
+static struct vma* vma_remove_min(struct vma* node, struct vma** min) {
+    if (!node->left) {
+        *min = node;
+        return node->right;
+    }
+    node->left = vma_remove_min(node->left, min);
+    return vma_balance(node);
+}
+
+static struct vma* vma_remove_at(struct vma* node, uint64_t start, struct vma** out) {
+    if (!node) return NULL;
+
+    if (start < node->start) {
+        node->left = vma_remove_at(node->left, start, out);
+    } else if (start > node->start) {
+        node->right = vma_remove_at(node->right, start, out);
+    } else {
+        *out = node;
+        if (!node->left) return node->right;
+        if (!node->right) return node->left;
+
+        // Two children: the in-order successor takes this node's place
+        struct vma* succ = NULL;
+        struct vma* right = vma_remove_min(node->right, &succ);
+        succ->left = node->left;
+        succ->right = right;
+        return vma_balance(succ);
+    }
+    return vma_balance(node);
+}
+
+struct vma* vma_remove(struct vma** root, uint64_t start) {
+    struct vma* out = NULL;
+    *root = vma_remove_at(*root, start, &out);
+    if (out) {
+        out->left = NULL;
+        out->right = NULL;
+    }
+    return out;
+}
@@ -0,0 +1,37 @@
+#ifndef VMA_H
+#define VMA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// --- Virtual Memory Area ---
+// One reserved region [start, end) of an address space. The regions of a
+// space never overlap and live in an AVL tree keyed by start address, so a
+// page fault finds its region in O(log n).
+struct vma {
+    uint64_t start;       // First byte (4KB aligned)
+    uint64_t end;         // One past the last byte (4KB aligned)
+    uint64_t flags;       // Page flags used when a page is faulted in
+    struct vma* left;
+    struct vma* right;
+    int height;           // AVL height (a leaf is 1)
+};
+
+// --- Function Prototypes ---
+
+// Get a zeroed descriptor (NULL when out of memory)
+struct vma* vma_alloc(void);
+
+// Return a descriptor to the pool
+void vma_free(struct vma* vma);
+
+// Insert into the tree. Returns 0 on success, -1 if it overlaps a region.
+int vma_insert(struct vma** root, struct vma* vma);
+
+// Find the region containing addr (NULL if none)
+struct vma* vma_find(struct vma* root, uint64_t addr);
+
+// Unlink the region starting at start. Returns it, or NULL if none.
+struct vma* vma_remove(struct vma** root, uint64_t start);
+
+#endif
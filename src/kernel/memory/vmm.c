@@ -1,10 +1,85 @@
 #include "vmm.h"
 #include "pmm.h"
+#include "physmap.h"
+#include "vma.h"
+#include "heap.h"
 #include "../drivers/vga.h"
+#include "../arch/x86_64/cpuid.h"
+#include "../arch/x86_64/cpu.h"
+#include "../arch/x86_64/irq.h"
+#include "../arch/x86_64/irqflags.h"
+#include "../core/preempt.h"
+#include "../core/spinlock.h"
+#include "../drivers/apic.h"
 
 // The Kernel's main Page Map Level 4
-// Allocate this in vmm_init
+// Allocate this in vmm_init. All tables are reached through the direct map.
 uint64_t* kernel_pml4 = NULL;
+static uint64_t kernel_pml4_phys = 0;
+
+// The kernel address space, and the one whose PML4 is in CR3 right now
+static struct vmm_space kernel_space;
+static struct vmm_space* current_space[MAX_CPUS];
+
+// PML4 entries 256-511 map the kernel half. Their PDPTs are created once at
+// boot and shared by every address space, so a kernel mapping made in any
+// space is seen by all of them.
+#define VMM_KERNEL_PML4_FIRST 256
+#define VMM_KERNEL_HALF       0xFFFF800000000000ULL  // First kernel-half address
+
+// Page table locks: every edit of a space's tables or VMA tree holds the
+// lock its PML4 hashes to. Kernel-half tables are edited through the
+// kernel space only. The locks live here rather than in the descriptors
+// because a lock must never be freed (see spinlock.h).
+#define VMM_SPACE_LOCKS 16
+static struct spinlock space_locks[VMM_SPACE_LOCKS];
+
+// PCID support (CPUID 1, ECX bit 17) and the INVPCID instruction
+// (CPUID 7, EBX bit 10). Both are set by vmm_init.
+static int vmm_has_pcid = 0;
+static int vmm_has_invpcid = 0;
+
+// Per-CPU PCID table: owner[P] is the PML4 (physical) tagged with PCID P,
+// and gen[P] the space's TLB generation those entries were cached under.
+// Slot 0 always belongs to the kernel space; next_victim rotates over the
+// others when a new space needs a PCID.
+struct pcid_table {
+    uint64_t owner[VMM_PCID_COUNT];
+    uint64_t gen[VMM_PCID_COUNT];
+    uint32_t next_victim;
+};
+
+static struct pcid_table pcid_tables[MAX_CPUS];
+
+// Source of TLB generations. Every edit that needs a flush stamps the
+// space with a fresh value, so a PCID cached under an older stamp is
+// stale, even on a CPU that is not running the space right now. Values
+// are never reused, so a new space on a recycled PML4 frame is never
+// mistaken for the old one.
+static uint64_t tlb_gen_clock = 0;
+
+// Per-CPU shootdown mailbox. Senders OR flush bits into 'pending', take a
+// request number and send VMM_TLB_VECTOR; the target applies the bits and
+// publishes the last request number it has covered in 'done'.
+#define TLB_FLUSH_LOCAL   1     // Current PCID (user-half edit)
+#define TLB_FLUSH_GLOBAL  2     // Everything, global entries included
+
+struct tlb_mailbox {
+    volatile uint32_t pending;
+    volatile uint64_t requests;
+    volatile uint64_t done;
+} __attribute__((aligned(64)));
+
+static struct tlb_mailbox tlb_mailboxes[MAX_CPUS];
+#define CR3_NOFLUSH   (1ULL << 63)  // Keep the TLB entries of the new PCID
+#define CR4_PGE       (1ULL << 7)   // Global pages
+#define CR4_PCIDE     (1ULL << 17)  // Process-context identifiers
+
+// End of the RAM part of the direct map (set by vmm_init)
+static uint64_t physmap_end = 0;
+
+// Set by vmm_init when CPUID reports 1GB page support (PDPE1GB)
+static int vmm_has_1g_pages = 0;
 
 // Helper: Get the index for a specific level from a virtual address
 // x86_64 addresses are split into 9-bit chunks for each level
@@ -13,61 +88,667 @@ uint64_t* kernel_pml4 = NULL;
 #define PD_INDEX(va)   (((va) >> 21) & 0x1FF)
 #define PT_INDEX(va)   (((va) >> 12) & 0x1FF)
 
+// Helper: Physical address stored in a table entry (flags masked out)
+#define PTE_ADDR(entry) ((entry) & PTE_ADDR_MASK)
+
+// Helper: Direct-map pointer to the table an entry points to
+#define PTE_TABLE(entry) ((uint64_t*)phys_to_virt(PTE_ADDR(entry)))
+
 // Helper: Invalidate the TLB (Translation Lookaside Buffer) for one page
 // This forces the CPU to relearn the mapping for this address.
+// For a huge page, one invlpg anywhere inside it drops the whole entry.
 static void vmm_flush_tlb(uint64_t virtual_addr) {
     __asm__ volatile("invlpg (%0)" :: "r" (virtual_addr) : "memory");
 }
 
+// Helper: Drop every (non-global) TLB entry by writing CR3 back to itself
+// With PCIDs on, this only drops the entries of the current PCID.
+static void vmm_flush_tlb_all(void) {
+    uint64_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    __asm__ volatile("mov %0, %%cr3" :: "r"(cr3) : "memory");
+}
+
+// INVPCID types
+#define INVPCID_ADDR          0   // One address in one PCID
+#define INVPCID_CONTEXT       1   // Everything tagged with one PCID
+#define INVPCID_ALL_GLOBAL    2   // Everything, global entries included
+
+static void vmm_invpcid(uint64_t type, uint64_t pcid, uint64_t virtual_addr) {
+    struct { uint64_t pcid; uint64_t addr; } desc = { pcid, virtual_addr };
+    __asm__ volatile("invpcid %0, %1" :: "m"(desc), "r"(type) : "memory");
+}
+
+static uint64_t read_cr4(void) {
+    uint64_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    return cr4;
+}
+
+static void write_cr4(uint64_t cr4) {
+    __asm__ volatile("mov %0, %%cr4" :: "r"(cr4) : "memory");
+}
+
+// Helper: Drop every TLB entry, global (kernel half) ones and all PCIDs included
+static void vmm_flush_tlb_global(void) {
+    if (vmm_has_invpcid) {
+        vmm_invpcid(INVPCID_ALL_GLOBAL, 0, 0);
+    } else {
+        // Toggling PGE flushes the whole TLB
+        uint64_t cr4 = read_cr4();
+        write_cr4(cr4 & ~CR4_PGE);
+        write_cr4(cr4);
+    }
+}
+
+// Pending TLB invalidations of one range operation.
+// Addresses are collected while the tables are edited and flushed once at
+// the end. Past VMM_TLB_FLUSH_THRESHOLD pages, a single CR3 reload is cheaper
+// than that many invlpg, so the batch just remembers "flush everything".
+// Kernel-half pages are global, which a CR3 reload does not flush: the
+// batch notes when it touched any so the fallback flush covers them too.
+// Frames and tables unmapped by the operation wait in the batch until
+// every CPU has dropped its translations (vmm_tlb_finish).
+#define VMM_TLB_FREE_BATCH 64
+
+struct tlb_batch {
+    uint64_t addrs[VMM_TLB_FLUSH_THRESHOLD];
+    uint32_t count;
+    int flush_all;
+    int global;
+    uint64_t frees[VMM_TLB_FREE_BATCH];    // Physical address | PMM order
+    uint32_t free_count;
+};
+
+static void tlb_batch_add(struct tlb_batch* batch, uint64_t virtual_addr) {
+    if (virtual_addr >= VMM_KERNEL_HALF) batch->global = 1;
+    if (batch->flush_all) return;
+    if (batch->count == VMM_TLB_FLUSH_THRESHOLD) {
+        batch->flush_all = 1;
+        return;
+    }
+    batch->addrs[batch->count++] = virtual_addr;
+}
+
+static void tlb_batch_flush(struct tlb_batch* batch) {
+    if (batch->flush_all && batch->global) {
+        vmm_flush_tlb_global();
+    } else if (batch->flush_all) {
+        vmm_flush_tlb_all();
+    } else {
+        for (uint32_t i = 0; i < batch->count; i++) {
+            vmm_flush_tlb(batch->addrs[i]);
+        }
+    }
+    batch->count = 0;
+    batch->flush_all = 0;
+    batch->global = 0;
+}
+
+// TLB Shootdown
+// Apply the flushes other CPUs asked this one for. Runs from the IPI,
+// and from every loop that waits for another CPU with interrupts off,
+// so two CPUs shooting down each other cannot deadlock.
+void vmm_tlb_sync(void) {
+    uint64_t flags = irq_save();
+    struct tlb_mailbox* box = &tlb_mailboxes[cpu_id()];
+
+    // Requests up to 'seen' posted their bits before taking their number
+    uint64_t seen = __atomic_load_n(&box->requests, __ATOMIC_SEQ_CST);
+    if (seen != box->done) {
+        uint32_t bits = __atomic_exchange_n(&box->pending, 0, __ATOMIC_SEQ_CST);
+        if (bits & TLB_FLUSH_GLOBAL) {
+            vmm_flush_tlb_global();
+        } else if (bits & TLB_FLUSH_LOCAL) {
+            vmm_flush_tlb_all();
+        }
+        __atomic_store_n(&box->done, seen, __ATOMIC_RELEASE);
+    }
+    irq_restore(flags);
+}
+
+int vmm_tlb_interrupt(void* ctx) {
+    (void)ctx;
+    vmm_tlb_sync();
+    return IRQ_HANDLED;
+}
+
+static uint64_t tlb_post(uint32_t cpu, uint32_t bits) {
+    struct tlb_mailbox* box = &tlb_mailboxes[cpu];
+    __atomic_fetch_or(&box->pending, bits, __ATOMIC_SEQ_CST);
+    return __atomic_add_fetch(&box->requests, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Make the other CPUs drop stale translations of a space.
+ *
+ * Kernel-half edits reach every online CPU (the entries are global).
+ * User-half edits only reach CPUs running the space; the others were
+ * taken care of by the generation stamp. Remote CPUs flush their whole
+ * PCID (one CR3 reload) instead of replaying the batch. Returns once all
+ * of them are done.
+ *
+ * @param[in] space  The edited space (already stamped)
+ * @param[in] global Non-zero if kernel-half entries changed
+ */
+static void vmm_shootdown(struct vmm_space* space, int global) {
+    uint64_t requests[MAX_CPUS];
+    uint32_t self = cpu_id();
+
+    // A. Post a request to every CPU that may hold the old entries.
+    // The stamp was a full barrier: a CPU switching to the space after
+    // this check reads the new generation and flushes by itself.
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        requests[cpu] = 0;
+        if (cpu == self || !__atomic_load_n(&cpus[cpu].online, __ATOMIC_SEQ_CST)) continue;
+        if (!global && __atomic_load_n(&current_space[cpu], __ATOMIC_SEQ_CST) != space) continue;
+
+        requests[cpu] = tlb_post(cpu, global ? TLB_FLUSH_GLOBAL : TLB_FLUSH_LOCAL);
+        lapic_send_ipi(cpus[cpu].apic_id, LAPIC_ICR_FIXED | LAPIC_ICR_ASSERT | VMM_TLB_VECTOR);
+    }
+
+    // B. Wait for each of them, serving our own mailbox meanwhile
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (!requests[cpu]) continue;
+        while (__atomic_load_n(&tlb_mailboxes[cpu].done, __ATOMIC_ACQUIRE) < requests[cpu]) {
+            vmm_tlb_sync();
+            __asm__ volatile("pause");
+        }
+    }
+}
+
+/**
+ * @brief Complete a batch: flush every CPU, then free what was unmapped.
+ *
+ * This CPU flushes the listed addresses when the space is loaded here (or
+ * the kernel half changed). The space then gets a new generation, so any
+ * PCID still tagged with it on any CPU is flushed at its next switch, and
+ * CPUs running it right now are shot down. Only after that may the frames
+ * and tables queued on the batch be reused.
+ *
+ * @param[in]     space The edited address space
+ * @param[in,out] batch Pending invalidations and frees (emptied)
+ */
+static void vmm_tlb_finish(struct vmm_space* space, struct tlb_batch* batch) {
+    if (batch->count || batch->flush_all) {
+        int global = batch->global;
+
+        preempt_disable();
+        if (global || space == current_space[cpu_id()]) tlb_batch_flush(batch);
+        __atomic_store_n(&space->tlb_gen,
+                         __atomic_add_fetch(&tlb_gen_clock, 1, __ATOMIC_SEQ_CST),
+                         __ATOMIC_SEQ_CST);
+        vmm_shootdown(space, global);
+        preempt_enable();
+    }
+    batch->count = 0;
+    batch->flush_all = 0;
+    batch->global = 0;
+
+    for (uint32_t i = 0; i < batch->free_count; i++) {
+        uint64_t phys = batch->frees[i] & ~(uint64_t)(PAGE_SIZE - 1);
+        uint32_t order = batch->frees[i] & (PAGE_SIZE - 1);
+        if (order == 0) {
+            pmm_free_frame((void*)phys);
+        } else {
+            pmm_free_frames((void*)phys, order);
+        }
+    }
+    batch->free_count = 0;
+}
+
+// Queue a block of 2^order frames to be freed once the batch is flushed
+static void tlb_batch_free(struct vmm_space* space, struct tlb_batch* batch,
+                           uint64_t physical_addr, uint32_t order) {
+    if (batch->free_count == VMM_TLB_FREE_BATCH) vmm_tlb_finish(space, batch);
+    batch->frees[batch->free_count++] = physical_addr | order;
+}
+
+// Take a space's page table lock. The holder may be waiting for a
+// shootdown, so spin with interrupts off but keep answering them.
+static uint64_t vmm_lock_space(struct vmm_space* space) {
+    struct spinlock* lock = &space_locks[(space->pml4_phys >> 12) % VMM_SPACE_LOCKS];
+    uint64_t flags = irq_save();
+    while (!spin_trylock(lock)) {
+        vmm_tlb_sync();
+        __asm__ volatile("pause");
+    }
+    return flags;
+}
+
+static void vmm_unlock_space(struct vmm_space* space, uint64_t flags) {
+    spin_unlock(&space_locks[(space->pml4_phys >> 12) % VMM_SPACE_LOCKS]);
+    irq_restore(flags);
+}
+
+// Helper: Kernel-half leaves are global, so switching spaces keeps them cached
+static uint64_t vmm_leaf_flags(uint64_t virtual_addr, uint64_t flags) {
+    if (virtual_addr >= VMM_KERNEL_HALF) flags |= PTE_GLOBAL;
+    return flags;
+}
+
+// Page table frames in use (PML4s included), for memory statistics
+static uint64_t table_frames = 0;
+
+// Helper: Get a zeroed frame for a page table (0 if out of memory)
+static uint64_t vmm_alloc_table(void) {
+    uint64_t table = (uint64_t)pmm_alloc_zeroed_frame();
+    if (table) __atomic_add_fetch(&table_frames, 1, __ATOMIC_RELAXED);
+    return table;
+}
+
+// Page tables can be cached by other CPUs' page walkers: freed through the batch
+static void vmm_free_table_frame(struct vmm_space* space, struct tlb_batch* batch,
+                                 uint64_t table_phys) {
+    __atomic_sub_fetch(&table_frames, 1, __ATOMIC_RELAXED);
+    tlb_batch_free(space, batch, table_phys, 0);
+}
+
+/**
+ * @brief Break a huge page entry into a table of smaller pages.
+ *
+ * A 1GB PDPT entry becomes a PD of 512 2MB pages; a 2MB PD entry becomes
+ * a PT of 512 4KB pages. The translation is unchanged, so no flush is needed.
+ *
+ * @param[in,out] entry    The huge page entry to split
+ * @param[in]     child_sz Size of each page in the new table
+ * @return int 0 on success, -1 when out of memory (the entry is unchanged)
+ */
+static int vmm_split_huge(uint64_t* entry, uint64_t child_sz) {
+    uint64_t base = PTE_ADDR(*entry);
+    uint64_t flags = *entry & ~PTE_ADDR_MASK;
+    uint64_t table_phys = vmm_alloc_table();
+    if (!table_phys) return -1;
+    uint64_t* table = (uint64_t*)phys_to_virt(table_phys);
+
+    // PS means "huge page" in a PD entry but "PAT" in a PT entry
+    if (child_sz == PAGE_SIZE) {
+        flags &= ~PTE_HUGE;
+    }
+
+    for (int i = 0; i < 512; i++) {
+        table[i] = (base + i * child_sz) | flags;
+    }
+
+    // Table pointers keep permissive flags; the leaves hold the real ones
+    *entry = table_phys | PTE_PRESENT | PTE_WRITE | (flags & PTE_USER);
+    return 0;
+}
+
+/**
+ * @brief Return the table an entry points to, creating it if needed.
+ *
+ * If the entry is a huge page it is split first, so the caller can always
+ * keep walking down.
+ *
+ * User pages need PTE_USER at every level of the walk, so it is added to
+ * the entry when the mapping being created asks for it.
+ *
+ * @param[in,out] entry    Entry in the current table
+ * @param[in]     child_sz Page size covered by each entry of the next table
+ * @param[in]     flags    Flags of the mapping being created (for PTE_USER)
+ * @return uint64_t* The next level table, or NULL when out of memory
+ *                   (the entry is left as it was)
+ */
+static uint64_t* vmm_next_table(uint64_t* entry, uint64_t child_sz, uint64_t flags) {
+    if (!(*entry & PTE_PRESENT)) {
+        // New tables must start out empty (garbage means random mappings).
+        // The PMM hands out pre-zeroed frames, so no clearing loop here.
+        uint64_t table = vmm_alloc_table();
+        if (!table) return NULL;
+        *entry = table | PTE_PRESENT | PTE_WRITE;
+    } else if (*entry & PTE_HUGE) {
+        if (vmm_split_huge(entry, child_sz) != 0) return NULL;
+    }
+    *entry |= flags & PTE_USER;
+    return PTE_TABLE(*entry);
+}
+
+static void vmm_free_huge_frames(struct vmm_space* space, struct tlb_batch* batch,
+                                 uint64_t physical_addr, uint64_t size);
+
+/**
+ * @brief Free a page table and every table below it.
+ *
+ * The table must already be unlinked; its frames are queued on the batch.
+ *
+ * @param[in]     space       Address space the table belonged to
+ * @param[in,out] batch       Batch the frees are queued on
+ * @param[in]     table       Direct-map pointer to the table
+ * @param[in]     level       3 = PDPT, 2 = PD, 1 = PT
+ * @param[in]     free_frames Non-zero to also give the mapped frames back
+ */
+static void vmm_free_table(struct vmm_space* space, struct tlb_batch* batch,
+                           uint64_t* table, int level, int free_frames) {
+    for (int i = 0; i < 512; i++) {
+        if (!(table[i] & PTE_PRESENT)) continue;
+
+        if (level > 1 && !(table[i] & PTE_HUGE)) {
+            vmm_free_table(space, batch, PTE_TABLE(table[i]), level - 1, free_frames);
+        } else if (free_frames && level == 1) {
+            tlb_batch_free(space, batch, PTE_ADDR(table[i]), 0);
+        } else if (free_frames) {
+            vmm_free_huge_frames(space, batch, PTE_ADDR(table[i]),
+                                 level == 3 ? VMM_HUGE_1G : VMM_HUGE_2M);
+        }
+    }
+    vmm_free_table_frame(space, batch, virt_to_phys(table));
+}
+
+/**
+ * @brief Install a huge page entry, replacing whatever was there.
+ *
+ * @param[in]     space Address space of the entry
+ * @param[in,out] entry PD entry (2MB) or PDPT entry (1GB)
+ * @param[in]     value Physical address | flags (PTE_HUGE included)
+ * @param[in]     level Level of the table the old entry could point to
+ * @param[in]     virtual_addr Address mapped by the entry
+ * @param[in,out] batch Pending TLB invalidations
+ */
+static void vmm_set_huge(struct vmm_space* space, uint64_t* entry, uint64_t value,
+                         int level, uint64_t virtual_addr, struct tlb_batch* batch) {
+    uint64_t old = *entry;
+    *entry = value;
+    if (!(old & PTE_PRESENT)) return;
+
+    tlb_batch_add(batch, virtual_addr);
+    if (!(old & PTE_HUGE)) {
+        // A smaller mapping was here before: drop its tables.
+        // Its 4KB translations are spread over the whole range,
+        // so one invlpg would not be enough.
+        batch->flush_all = 1;
+        vmm_free_table(space, batch, PTE_TABLE(old), level, 0);
+    }
+}
+
+/**
+ * @brief Map a physically contiguous range into the kernel address space.
+ *
+ * Uses a 1GB page (when supported), then a 2MB page, then 4KB pages,
+ * depending on how both addresses are aligned and how much is left.
+ * Runs of 4KB pages reuse one walk for every entry of the same page table.
+ * Only entries that were already present need a TLB flush; those are
+ * batched and flushed once at the end.
+ *
+ * If a page table cannot be allocated, the pages mapped so far stay
+ * mapped and the rest of the range is left untouched.
+ *
+ * The caller holds the space's lock.
+ *
+ * @param[in] space         Address space to map into
+ * @param[in] virtual_addr  Start of the range (4KB aligned)
+ * @param[in] physical_addr Physical start of the range (4KB aligned)
+ * @param[in] length        Size of the range in bytes
+ * @param[in] flags         Page flags (PTE_PRESENT | PTE_WRITE ...)
+ * @return int 0 on success, -1 when out of memory
+ */
+static int vmm_map_range_in(struct vmm_space* space, uint64_t virtual_addr,
+                            uint64_t physical_addr, uint64_t length,
+                            uint64_t flags) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+    uint64_t* pml4 = space->pml4;
+    uint64_t end = virtual_addr + length;
+    int err = 0;
+    flags = vmm_leaf_flags(virtual_addr, flags);
+
+    while (virtual_addr < end) {
+        uint64_t align = virtual_addr | physical_addr;
+        uint64_t left = end - virtual_addr;
+
+        // A. Walk PML4 -> PDP
+        uint64_t* pdp = vmm_next_table(&pml4[PML4_INDEX(virtual_addr)], VMM_HUGE_1G, flags);
+        if (!pdp) {
+            err = -1;
+            break;
+        }
+        uint64_t* pdpe = &pdp[PDP_INDEX(virtual_addr)];
+
+        if (vmm_has_1g_pages && !(align & (VMM_HUGE_1G - 1)) && left >= VMM_HUGE_1G) {
+            vmm_set_huge(space, pdpe, physical_addr | flags | PTE_HUGE, 2, virtual_addr, &batch);
+            virtual_addr += VMM_HUGE_1G;
+            physical_addr += VMM_HUGE_1G;
+            continue;
+        }
+
+        // B. Walk PDP -> PD
+        uint64_t* pd = vmm_next_table(pdpe, VMM_HUGE_2M, flags);
+        if (!pd) {
+            err = -1;
+            break;
+        }
+        uint64_t* pde = &pd[PD_INDEX(virtual_addr)];
+
+        if (!(align & (VMM_HUGE_2M - 1)) && left >= VMM_HUGE_2M) {
+            vmm_set_huge(space, pde, physical_addr | flags | PTE_HUGE, 1, virtual_addr, &batch);
+            virtual_addr += VMM_HUGE_2M;
+            physical_addr += VMM_HUGE_2M;
+            continue;
+        }
+
+        // C. Walk PD -> PT, then fill entries until the end of this table
+        uint64_t* pt = vmm_next_table(pde, PAGE_SIZE, flags);
+        if (!pt) {
+            err = -1;
+            break;
+        }
+        for (uint64_t i = PT_INDEX(virtual_addr); i < 512 && virtual_addr < end; i++) {
+            if (pt[i] & PTE_PRESENT) {
+                tlb_batch_add(&batch, virtual_addr);
+            }
+            pt[i] = physical_addr | flags;
+            virtual_addr += PAGE_SIZE;
+            physical_addr += PAGE_SIZE;
+        }
+    }
+
+    // D. One flush for the whole range (a partial one too)
+    vmm_tlb_finish(space, &batch);
+    return err;
+}
+
+int vmm_map_range(uint64_t virtual_addr, uint64_t physical_addr,
+                  uint64_t length, uint64_t flags) {
+    return vmm_map_range_space(&kernel_space, virtual_addr, physical_addr, length, flags);
+}
+
+int vmm_map_range_space(struct vmm_space* space, uint64_t virtual_addr,
+                        uint64_t physical_addr, uint64_t length, uint64_t flags) {
+    uint64_t lock_flags = vmm_lock_space(space);
+    int err = vmm_map_range_in(space, virtual_addr, physical_addr, length, flags);
+    vmm_unlock_space(space, lock_flags);
+    return err;
+}
+
 // The Core Mapping Function
-void vmm_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags) {
-    // A. Calculate Indices
-    uint64_t pml4_idx = PML4_INDEX(virtual_addr);
-    uint64_t pdp_idx  = PDP_INDEX(virtual_addr);
-    uint64_t pd_idx   = PD_INDEX(virtual_addr);
-    uint64_t pt_idx   = PT_INDEX(virtual_addr);
-
-    // B. Walk the PML4 -> PDP
-    // Check if the PDP entry exists. If not, allocate a new table.
-    if (!(kernel_pml4[pml4_idx] & PTE_PRESENT)) {
-        uint64_t pdp_alloc = (uint64_t)pmm_alloc_frame();
-        // Clear the new page (crucial! garbage means random mappings)
-        uint64_t* ptr = (uint64_t*)pdp_alloc; // Note: In a full OS,need to map this first! 
-                                              // But right now just identity mapped, so the os can access it directly.
-        for(int i=0; i<512; i++) ptr[i] = 0;
-        
-        // Point PML4 to this new PDP
-        kernel_pml4[pml4_idx] = pdp_alloc | PTE_PRESENT | PTE_WRITE;
-    }
-    
-    // Get the PDP address from the PML4 entry (mask out flags)
-    uint64_t* pdp = (uint64_t*)(kernel_pml4[pml4_idx] & ~0xFFF);
-
-    // C. Walk the PDP -> PD
-    if (!(pdp[pdp_idx] & PTE_PRESENT)) {
-        uint64_t pd_alloc = (uint64_t)pmm_alloc_frame();
-        uint64_t* ptr = (uint64_t*)pd_alloc;
-        for(int i=0; i<512; i++) ptr[i] = 0;
-
-        pdp[pdp_idx] = pd_alloc | PTE_PRESENT | PTE_WRITE;
-    }
-    uint64_t* pd = (uint64_t*)(pdp[pdp_idx] & ~0xFFF);
-
-    // D. Walk the PD -> PT
-    if (!(pd[pd_idx] & PTE_PRESENT)) {
-        uint64_t pt_alloc = (uint64_t)pmm_alloc_frame();
-        uint64_t* ptr = (uint64_t*)pt_alloc;
-        for(int i=0; i<512; i++) ptr[i] = 0;
-
-        pd[pd_idx] = pt_alloc | PTE_PRESENT | PTE_WRITE;
-    }
-    uint64_t* pt = (uint64_t*)(pd[pd_idx] & ~0xFFF);
-
-    // E. Final Step: Map the Physical Frame
-    pt[pt_idx] = physical_addr | flags;
-    
-    // F. Flush TLB
-    vmm_flush_tlb(virtual_addr);
+int vmm_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+    uint64_t lock_flags = vmm_lock_space(&kernel_space);
+
+    // A. Walk PML4 -> PDP -> PD -> PT, creating (or splitting) as needed
+    uint64_t* pt = NULL;
+    uint64_t* pdp = vmm_next_table(&kernel_pml4[PML4_INDEX(virtual_addr)], VMM_HUGE_1G, flags);
+    uint64_t* pd  = pdp ? vmm_next_table(&pdp[PDP_INDEX(virtual_addr)], VMM_HUGE_2M, flags) : NULL;
+    if (pd) pt = vmm_next_table(&pd[PD_INDEX(virtual_addr)], PAGE_SIZE, flags);
+    if (!pt) {
+        vmm_unlock_space(&kernel_space, lock_flags);
+        return -1;
+    }
+
+    // B. Final Step: Map the Physical Frame
+    uint64_t* pte = &pt[PT_INDEX(virtual_addr)];
+    if (*pte & PTE_PRESENT) tlb_batch_add(&batch, virtual_addr);
+    *pte = physical_addr | vmm_leaf_flags(virtual_addr, flags);
+
+    // C. Flush TLB (on every CPU, if the page was mapped before)
+    vmm_tlb_finish(&kernel_space, &batch);
+    vmm_unlock_space(&kernel_space, lock_flags);
+    return 0;
+}
+
+// Map a 2MB or 1GB page with a single PD / PDPT entry
+int vmm_map_huge_page(uint64_t virtual_addr, uint64_t physical_addr,
+                      uint64_t size, uint64_t flags) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+
+    if (size != VMM_HUGE_2M && size != VMM_HUGE_1G) return -1;
+    if (size == VMM_HUGE_1G && !vmm_has_1g_pages) return -1;
+    if ((virtual_addr | physical_addr) & (size - 1)) return -1;
+
+    uint64_t lock_flags = vmm_lock_space(&kernel_space);
+    uint64_t* pdp = vmm_next_table(&kernel_pml4[PML4_INDEX(virtual_addr)], VMM_HUGE_1G, flags);
+    uint64_t value = physical_addr | vmm_leaf_flags(virtual_addr, flags) | PTE_HUGE;
+    int err = 0;
+
+    if (!pdp) {
+        err = -1;
+    } else if (size == VMM_HUGE_1G) {
+        vmm_set_huge(&kernel_space, &pdp[PDP_INDEX(virtual_addr)], value, 2, virtual_addr, &batch);
+    } else {
+        uint64_t* pd = vmm_next_table(&pdp[PDP_INDEX(virtual_addr)], VMM_HUGE_2M, flags);
+        if (pd) {
+            vmm_set_huge(&kernel_space, &pd[PD_INDEX(virtual_addr)], value, 1, virtual_addr, &batch);
+        } else {
+            err = -1;
+        }
+    }
+
+    vmm_tlb_finish(&kernel_space, &batch);
+    vmm_unlock_space(&kernel_space, lock_flags);
+    return err;
+}
+
+/**
+ * @brief Return the frames behind a huge page to the PMM.
+ *
+ * @param[in]     space         Address space the page was mapped in
+ * @param[in,out] batch         Batch the frees are queued on
+ * @param[in]     physical_addr Start of the huge page
+ * @param[in]     size          VMM_HUGE_2M or VMM_HUGE_1G
+ */
+static void vmm_free_huge_frames(struct vmm_space* space, struct tlb_batch* batch,
+                                 uint64_t physical_addr, uint64_t size) {
+    uint64_t block = (1ULL << PMM_MAX_ORDER) * PAGE_SIZE;
+    if (size < block) {
+        block = size;
+    }
+    for (uint64_t off = 0; off < size; off += block) {
+        tlb_batch_free(space, batch, physical_addr + off,
+                       __builtin_ctzll(block / PAGE_SIZE));
+    }
+}
+
+/**
+ * @brief Unmap a range of the kernel address space.
+ *
+ * Huge pages fully inside the range are dropped whole; ones that are only
+ * partly covered are split first. Page tables left completely empty are
+ * freed. All invalidations are batched into one flush.
+ *
+ * Splitting needs a new page table. If none can be allocated, the range
+ * is unmapped up to that huge page and the rest stays mapped.
+ *
+ * The caller holds the space's lock.
+ *
+ * @param[in] space        Address space to unmap from
+ * @param[in] virtual_addr Start of the range (4KB aligned)
+ * @param[in] length       Size of the range in bytes
+ * @param[in] free_frames  Non-zero to give the mapped frames back to the PMM
+ *                         (once no CPU can reach them any more)
+ * @return int 0 on success, -1 when a huge page could not be split
+ */
+static int vmm_unmap_range_in(struct vmm_space* space, uint64_t virtual_addr,
+                              uint64_t length, int free_frames) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+    uint64_t* pml4 = space->pml4;
+    uint64_t end = virtual_addr + length;
+    int err = 0;
+
+    while (virtual_addr < end) {
+        uint64_t left = end - virtual_addr;
+
+        // A. PML4 -> PDP (skip 512GB at a time when nothing is there)
+        uint64_t* pml4e = &pml4[PML4_INDEX(virtual_addr)];
+        if (!(*pml4e & PTE_PRESENT)) {
+            virtual_addr = (virtual_addr | ((1ULL << 39) - 1)) + 1;
+            continue;
+        }
+
+        // B. PDP -> PD
+        uint64_t* pdpe = &PTE_TABLE(*pml4e)[PDP_INDEX(virtual_addr)];
+        if (!(*pdpe & PTE_PRESENT)) {
+            virtual_addr = (virtual_addr | (VMM_HUGE_1G - 1)) + 1;
+            continue;
+        }
+        if ((*pdpe & PTE_HUGE) && !(virtual_addr & (VMM_HUGE_1G - 1)) &&
+            left >= VMM_HUGE_1G) {
+            uint64_t old = *pdpe;
+            *pdpe = 0;
+            tlb_batch_add(&batch, virtual_addr);
+            if (free_frames) vmm_free_huge_frames(space, &batch, PTE_ADDR(old), VMM_HUGE_1G);
+            virtual_addr += VMM_HUGE_1G;
+            continue;
+        }
+
+        // C. PD -> PT
+        uint64_t* pd = vmm_next_table(pdpe, VMM_HUGE_2M, 0);
+        if (!pd) {
+            err = -1;
+            break;
+        }
+        uint64_t* pde = &pd[PD_INDEX(virtual_addr)];
+        if (!(*pde & PTE_PRESENT)) {
+            virtual_addr = (virtual_addr | (VMM_HUGE_2M - 1)) + 1;
+            continue;
+        }
+        if ((*pde & PTE_HUGE) && !(virtual_addr & (VMM_HUGE_2M - 1)) &&
+            left >= VMM_HUGE_2M) {
+            uint64_t old = *pde;
+            *pde = 0;
+            tlb_batch_add(&batch, virtual_addr);
+            if (free_frames) vmm_free_huge_frames(space, &batch, PTE_ADDR(old), VMM_HUGE_2M);
+            virtual_addr += VMM_HUGE_2M;
+            continue;
+        }
+
+        // D. Clear entries until the end of this page table
+        uint64_t* pt = vmm_next_table(pde, PAGE_SIZE, 0);
+        if (!pt) {
+            err = -1;
+            break;
+        }
+        uint64_t first = PT_INDEX(virtual_addr);
+        uint64_t i = first;
+        for (; i < 512 && virtual_addr < end; i++) {
+            if (pt[i] & PTE_PRESENT) {
+                uint64_t old = pt[i];
+                pt[i] = 0;
+                tlb_batch_add(&batch, virtual_addr);
+                if (free_frames) tlb_batch_free(space, &batch, PTE_ADDR(old), 0);
+            }
+            virtual_addr += PAGE_SIZE;
+        }
+
+        // The whole table was covered: it is empty now, give it back.
+        // Any invlpg also drops the cached PD entry, so queue one. Not for
+        // a kernel-half table though: every PCID may have cached the PD
+        // entry and invlpg only drops it for the current one.
+        if (first == 0 && i == 512) {
+            *pde = 0;
+            tlb_batch_add(&batch, virtual_addr - VMM_HUGE_2M);
+            if (virtual_addr - VMM_HUGE_2M >= VMM_KERNEL_HALF) batch.flush_all = 1;
+            vmm_free_table_frame(space, &batch, virt_to_phys(pt));
+        }
+    }
+
+    vmm_tlb_finish(space, &batch);
+    return err;
+}
+
+int vmm_unmap_range(uint64_t virtual_addr, uint64_t length, int free_frames) {
+    uint64_t lock_flags = vmm_lock_space(&kernel_space);
+    int err = vmm_unmap_range_in(&kernel_space, virtual_addr, length, free_frames);
+    vmm_unlock_space(&kernel_space, lock_flags);
+    return err;
 }
 
 // Assembly helper to load CR3 register
@@ -75,30 +756,45 @@ extern void load_cr3(uint64_t pml4_addr);
 
 void vmm_init(void) {
     terminal_writestring("[VMM] Initializing Paging...\n");
+    for (int i = 0; i < VMM_SPACE_LOCKS; i++) spin_lock_init(&space_locks[i], "vmm_space");
 
-    // 1. Allocate a new PML4 table
-    uint64_t pml4_phys = (uint64_t)pmm_alloc_frame();
-    kernel_pml4 = (uint64_t*)pml4_phys;
+    // 1. Allocate a new (already zeroed) PML4 table
+    // Until CR3 is switched, the boot tables direct-map the first 1GB,
+    // which is where the PMM hands out its lowest frames.
+    kernel_pml4_phys = vmm_alloc_table();
+    kernel_pml4 = (uint64_t*)phys_to_virt(kernel_pml4_phys);
+    kernel_space.pml4 = kernel_pml4;
+    kernel_space.pml4_phys = kernel_pml4_phys;
+    kernel_space.vmas = NULL;
 
-    // 2. Zero it out
-    for(int i=0; i<512; i++) kernel_pml4[i] = 0;
+    // Give the kernel half all of its PDPTs up front (see VMM_KERNEL_PML4_FIRST)
+    for (int i = VMM_KERNEL_PML4_FIRST; i < 512; i++) {
+        kernel_pml4[i] = vmm_alloc_table() | PTE_PRESENT | PTE_WRITE;
+    }
 
-    // 3. THE FIX: Map Both Low and High Memory
-    // <ap 128MB. This covers the Kernel, PMM Bitmap, and VGA.
-    uint64_t limit = 0x8000000; // 128MB
-    uint64_t kernel_offset = 0xFFFFFFFF80000000; // The Offset from Linker Script
+    // 1GB pages are optional (CPUID 0x80000001, EDX bit 26)
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0x80000001, &eax, &edx, &ecx, &ebx);
+    vmm_has_1g_pages = (edx & (1 << 26)) != 0;
+    if (vmm_has_1g_pages) {
+        terminal_writestring("[VMM] 1GB pages supported.\n");
+    }
 
-    for (uint64_t addr = 0; addr < limit; addr += PAGE_SIZE) {
-        // A. Identity Map (Physical 0 -> Virtual 0)
-        // Keeps the CPU happy (RIP is currently here).
-        // Allows accessing hardware (Video Memory, PMM Bitmap at 16MB) directly.
-        vmm_map_page(addr, addr, PTE_PRESENT | PTE_WRITE);
+    // 2. Direct Physical Map (Physical 0 -> Virtual 0xFFFF800000000000)
+    // Covers all RAM the PMM tracks, so page tables, the PMM bitmap and
+    // low-memory devices (VGA) are reachable at any physical address.
+    // No identity map: the lower half is left empty for user space.
+    uint64_t ram_end = pmm_get_highest_address();
+    ram_end = (ram_end + VMM_HUGE_2M - 1) & ~(VMM_HUGE_2M - 1);
+    vmm_map_range(PHYSMAP_BASE, 0, ram_end, PTE_PRESENT | PTE_WRITE);
+    physmap_end = ram_end;
+
+    // 3. Higher Half Map (Physical 0 -> Virtual 0xFFFFFFFF80000000)
+    // Keeps the C code happy (Global variables and Linker addresses are here).
+    // Map 128MB with 2MB pages; this covers the Kernel and its boot stack.
+    uint64_t limit = 0x8000000; // 128MB
+    vmm_map_range(KERNEL_VIRTUAL_BASE, 0, limit, PTE_PRESENT | PTE_WRITE);
 
-        // B. Higher Half Map (Physical 0 -> Virtual 0xFFFFFFFF80000000)
-        // Keeps the C code happy (Global variables and Linker addresses are here).
-        vmm_map_page(kernel_offset + addr, addr, PTE_PRESENT | PTE_WRITE);
-    }
-    
     // 4. Test Mapping: Map a random high address to video memory
     // Virtual 0xDEADBEEF000 -> Physical 0xB8000 (VGA Text Buffer)
     vmm_map_page(0xDEADBEEF000, 0xB8000, PTE_PRESENT | PTE_WRITE);
@@ -106,29 +802,550 @@ void vmm_init(void) {
     // 5. Load the new Page Table (CR3 Register)
     // The moment this executes, Switch to the new mappings.
     // If this hadn't mapped the Higher Half above, crash here!
-    load_cr3(pml4_phys);
-    
+    load_cr3(kernel_pml4_phys);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        current_space[cpu] = &kernel_space;
+        pcid_tables[cpu].owner[0] = kernel_pml4_phys;
+        pcid_tables[cpu].gen[0] = kernel_space.tlb_gen;
+        pcid_tables[cpu].next_victim = 1;
+    }
+
+    // 6. Global pages for the kernel half, then PCIDs if available.
+    // PCIDE may only be turned on while CR3 holds PCID 0, as it does now.
+    write_cr4(read_cr4() | CR4_PGE);
+
+    cpuid(1, &eax, &edx, &ecx, &ebx);
+    vmm_has_pcid = (ecx & (1 << 17)) != 0;
+    cpuid_count(7, 0, &eax, &edx, &ecx, &ebx);
+    vmm_has_invpcid = (ebx & (1 << 10)) != 0;
+
+    if (vmm_has_pcid) {
+        write_cr4(read_cr4() | CR4_PCIDE);
+        terminal_writestring("[VMM] PCID enabled");
+        terminal_writestring(vmm_has_invpcid ? " (with INVPCID).\n" : ".\n");
+    }
+
     terminal_writestring("[VMM] Paging Enabled. PML4 loaded.\n");
 }
 
+/**
+ * @brief Put an application processor on the kernel page tables.
+ *
+ * The AP arrives from the SMP trampoline on a temporary space; this loads
+ * the kernel PML4 (PCID 0) and enables the same paging features as
+ * vmm_init did on the boot CPU.
+ *
+ * Shootdowns only reach online CPUs, so the AP also queues a full flush
+ * for itself: the vmm_tlb_sync() right after it goes online drops
+ * whatever kernel mapping changed while nobody could tell it.
+ */
+void vmm_init_cpu(void) {
+    uint32_t cpu = cpu_id();
+    __atomic_store_n(&current_space[cpu], &kernel_space, __ATOMIC_SEQ_CST);
+    pcid_tables[cpu].gen[0] = __atomic_load_n(&kernel_space.tlb_gen, __ATOMIC_SEQ_CST);
+    load_cr3(kernel_pml4_phys);
+
+    write_cr4(read_cr4() | CR4_PGE);
+    if (vmm_has_pcid) write_cr4(read_cr4() | CR4_PCIDE);
+
+    tlb_post(cpu, TLB_FLUSH_GLOBAL);
+}
+
+/**
+ * @brief Load an address space into CR3.
+ *
+ * With PCIDs, each CPU tags up to VMM_PCID_COUNT spaces. Switching back to
+ * a space that still owns its PCID sets the no-flush bit, so its TLB
+ * entries are reused, unless the space was edited since they were cached
+ * (its generation moved on). A space without a PCID takes the next victim
+ * slot and gets a flushing CR3 write, which drops the previous owner's
+ * entries. Without PCIDs this is a plain CR3 write (kernel-half entries
+ * are global and survive it either way).
+ *
+ * The space is published as current before its generation is read: an
+ * edit racing with the switch either sees us in current_space and shoots
+ * us down, or we see its new generation and flush here.
+ *
+ * @param[in] space Address space to load
+ */
+static void vmm_load_space(struct vmm_space* space) {
+    uint32_t cpu = cpu_id();
+    __atomic_store_n(&current_space[cpu], space, __ATOMIC_SEQ_CST);
+    uint64_t gen = __atomic_load_n(&space->tlb_gen, __ATOMIC_SEQ_CST);
+
+    if (!vmm_has_pcid) {
+        load_cr3(space->pml4_phys);
+        return;
+    }
+
+    struct pcid_table* table = &pcid_tables[cpu];
+    for (uint64_t pcid = 0; pcid < VMM_PCID_COUNT; pcid++) {
+        if (table->owner[pcid] != space->pml4_phys) continue;
+
+        if (table->gen[pcid] == gen) {
+            load_cr3(space->pml4_phys | pcid | CR3_NOFLUSH);
+        } else {
+            table->gen[pcid] = gen;
+            load_cr3(space->pml4_phys | pcid);
+        }
+        return;
+    }
+
+    uint64_t pcid = table->next_victim;
+    table->next_victim = pcid + 1 < VMM_PCID_COUNT ? pcid + 1 : 1;
+    table->owner[pcid] = space->pml4_phys;
+    table->gen[pcid] = gen;
+    load_cr3(space->pml4_phys | pcid);
+}
+
+void vmm_switch_space(struct vmm_space* space) {
+    uint64_t flags = irq_save();
+    vmm_load_space(space);
+    irq_restore(flags);
+}
+
+/**
+ * @brief Make a physical range reachable through the direct map.
+ *
+ * RAM is mapped at boot; this is for firmware tables and device registers
+ * that may sit above it. Uncached requests (PTE_PCD) always remap their
+ * pages, splitting any huge page of the RAM map around them.
+ *
+ * @param[in] physical_addr Start of the range (any alignment)
+ * @param[in] length        Size of the range in bytes
+ * @param[in] flags         Page flags (PTE_PRESENT | PTE_WRITE ...)
+ * @return int 0 on success, -1 when out of memory
+ */
+int vmm_map_physical(uint64_t physical_addr, uint64_t length, uint64_t flags) {
+    uint64_t start = physical_addr & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = (physical_addr + length + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+
+    if (!(flags & PTE_PCD) && start < physmap_end) {
+        start = physmap_end;
+    }
+    if (start >= end) return 0;
+
+    return vmm_map_range((uint64_t)phys_to_virt(start), start, end - start, flags);
+}
+
 // Unmap Function
-void vmm_unmap_page(uint64_t virtual_addr) {
-    // (Simplified for now: just mark Present bit as 0 in the PT)
-    // In a real OS, this also free the physical frame if needed.
-    uint64_t pml4_idx = PML4_INDEX(virtual_addr);
-    uint64_t pdp_idx  = PDP_INDEX(virtual_addr);
-    uint64_t pd_idx   = PD_INDEX(virtual_addr);
-    uint64_t pt_idx   = PT_INDEX(virtual_addr);
-
-    if (kernel_pml4[pml4_idx] & PTE_PRESENT) {
-        uint64_t* pdp = (uint64_t*)(kernel_pml4[pml4_idx] & ~0xFFF);
-        if (pdp[pdp_idx] & PTE_PRESENT) {
-            uint64_t* pd = (uint64_t*)(pdp[pdp_idx] & ~0xFFF);
-            if (pd[pd_idx] & PTE_PRESENT) {
-                uint64_t* pt = (uint64_t*)(pd[pd_idx] & ~0xFFF);
-                pt[pt_idx] = 0; // Clear the entry
-                vmm_flush_tlb(virtual_addr);
+int vmm_unmap_page(uint64_t virtual_addr) {
+    // Just clear the entry; the frame stays with its owner.
+    // A 4KB hole in a huge page splits it first, so the rest stays mapped.
+    return vmm_unmap_range(virtual_addr, PAGE_SIZE, 0);
+}
+
+// Address spaces & Demand Paging
+struct vmm_space* vmm_kernel_space(void) {
+    return &kernel_space;
+}
+
+struct vmm_space* vmm_current_space(void) {
+    return current_space[cpu_id()];
+}
+
+/**
+ * @brief Reserve an anonymous, demand-zero region in an address space.
+ *
+ * Nothing is mapped and no frame is allocated here. The first touch of each
+ * page faults, and vmm_handle_page_fault() backs it with a zeroed frame.
+ *
+ * @param[in] space        Address space to reserve in
+ * @param[in] virtual_addr Start of the region (4KB aligned)
+ * @param[in] length       Size of the region in bytes (4KB multiple)
+ * @param[in] flags        Flags for the pages once faulted in (PTE_WRITE ...)
+ * @return int 0 on success, -1 on bad arguments, overlap or no memory
+ */
+int vmm_reserve(struct vmm_space* space, uint64_t virtual_addr,
+                uint64_t length, uint64_t flags) {
+    if ((virtual_addr | length) & (PAGE_SIZE - 1) || length == 0) return -1;
+
+    struct vma* vma = vma_alloc();
+    if (!vma) return -1;
+
+    vma->start = virtual_addr;
+    vma->end = virtual_addr + length;
+    vma->flags = flags | PTE_PRESENT;
+
+    uint64_t lock_flags = vmm_lock_space(space);
+    int err = vma_insert(&space->vmas, vma);
+    vmm_unlock_space(space, lock_flags);
+
+    if (err != 0) {
+        vma_free(vma);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Drop a region created by vmm_reserve() and free its frames.
+ *
+ * @param[in] space        Address space the region lives in
+ * @param[in] virtual_addr Start address the region was reserved with
+ * @return int 0 on success, -1 if no region starts there or a huge page
+ *             inside it could not be split (the region then stays reserved)
+ */
+int vmm_release(struct vmm_space* space, uint64_t virtual_addr) {
+    uint64_t lock_flags = vmm_lock_space(space);
+    struct vma* vma = vma_remove(&space->vmas, virtual_addr);
+    if (!vma) {
+        vmm_unlock_space(space, lock_flags);
+        return -1;
+    }
+
+    int err = vmm_unmap_range_in(space, vma->start, vma->end - vma->start, 1);
+    if (err != 0) {
+        vma_insert(&space->vmas, vma);
+        vmm_unlock_space(space, lock_flags);
+        return -1;
+    }
+    vmm_unlock_space(space, lock_flags);
+    vma_free(vma);
+    return 0;
+}
+
+/**
+ * @brief Find the 4KB entry mapping an address, without creating tables.
+ *
+ * @param[in] pml4         Top-level table of the address space
+ * @param[in] virtual_addr Address to look up
+ * @return uint64_t* The PT entry, or NULL if unmapped or inside a huge page
+ */
+static uint64_t* vmm_lookup_pte(uint64_t* pml4, uint64_t virtual_addr) {
+    uint64_t entry = pml4[PML4_INDEX(virtual_addr)];
+    if (!(entry & PTE_PRESENT)) return NULL;
+
+    entry = PTE_TABLE(entry)[PDP_INDEX(virtual_addr)];
+    if (!(entry & PTE_PRESENT) || (entry & PTE_HUGE)) return NULL;
+
+    entry = PTE_TABLE(entry)[PD_INDEX(virtual_addr)];
+    if (!(entry & PTE_PRESENT) || (entry & PTE_HUGE)) return NULL;
+
+    return &PTE_TABLE(entry)[PT_INDEX(virtual_addr)];
+}
+
+// Helper: Copy one 4KB frame to another through the direct map
+static void vmm_copy_frame(uint64_t dst_phys, uint64_t src_phys) {
+    void* dst = phys_to_virt(dst_phys);
+    const void* src = phys_to_virt(src_phys);
+    uint64_t count = PAGE_SIZE / sizeof(uint64_t);
+    __asm__ volatile("rep movsq"
+                     : "+D"(dst), "+S"(src), "+c"(count)
+                     :
+                     : "memory");
+}
+
+/**
+ * @brief Give a copy-on-write page back its write access.
+ *
+ * The last owner of the frame just takes it over; otherwise the contents
+ * are copied to a new frame and this space drops its reference.
+ * The caller holds the space's lock.
+ *
+ * @param[in] space      Address space the fault happened in
+ * @param[in] fault_addr Faulting address
+ * @param[in] err_code   Page fault error code
+ * @return int 0 if resolved, -1 if the page is not copy-on-write
+ */
+static int vmm_resolve_cow(struct vmm_space* space, uint64_t fault_addr,
+                           uint64_t err_code) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+    uint64_t* pte = vmm_lookup_pte(space->pml4, fault_addr);
+    if (!pte || !(*pte & PTE_PRESENT)) return -1;
+    if ((err_code & PF_USER) && !(*pte & PTE_USER)) return -1;
+
+    // Another CPU resolved it first: only our TLB entry was out of date
+    if (*pte & PTE_WRITE) {
+        vmm_flush_tlb(fault_addr);
+        return 0;
+    }
+    if (!(*pte & PTE_COW)) return -1;
+
+    uint64_t old_frame = PTE_ADDR(*pte);
+    uint64_t flags = (*pte & ~PTE_ADDR_MASK & ~PTE_COW) | PTE_WRITE;
+
+    if (pmm_frame_refs((void*)old_frame) <= 1) {
+        *pte = old_frame | flags;
+    } else {
+        uint64_t new_frame = (uint64_t)pmm_alloc_frame();
+        if (!new_frame) return -1;
+
+        vmm_copy_frame(new_frame, old_frame);
+        *pte = new_frame | flags;
+
+        // The old frame stays readable through other CPUs' TLBs until
+        // the shootdown: drop this space's reference only after it
+        tlb_batch_free(space, &batch, old_frame, 0);
+    }
+
+    tlb_batch_add(&batch, fault_addr);
+    vmm_tlb_finish(space, &batch);
+    return 0;
+}
+
+/**
+ * @brief Resolve a page fault in the current address space.
+ *
+ * Not-present faults inside a reserved region get a fresh zeroed frame.
+ * Write faults on copy-on-write pages get a private copy. In both cases
+ * the faulting instruction is simply retried.
+ *
+ * @param[in] fault_addr Faulting address (CR2)
+ * @param[in] err_code   Page fault error code pushed by the CPU
+ * @return int 0 if the fault was resolved, -1 if it is a real error
+ */
+int vmm_handle_page_fault(uint64_t fault_addr, uint64_t err_code) {
+    struct vmm_space* space = current_space[cpu_id()];
+    if (!space) return -1;  // Paging not set up yet
+
+    // Writes to present pages may be copy-on-write; other protection
+    // faults are real errors
+    if (err_code & PF_PRESENT) {
+        if (!(err_code & PF_WRITE)) return -1;
+        uint64_t lock_flags = vmm_lock_space(space);
+        int err = vmm_resolve_cow(space, fault_addr, err_code);
+        vmm_unlock_space(space, lock_flags);
+        return err;
+    }
+
+    void* frame = pmm_alloc_zeroed_frame();
+    if (!frame) return -1;
+
+    uint64_t lock_flags = vmm_lock_space(space);
+    struct vma* vma = vma_find(space->vmas, fault_addr);
+    int err = vma ? 0 : -1;
+
+    // The region must allow what was attempted
+    if (vma && (err_code & PF_WRITE) && !(vma->flags & PTE_WRITE)) err = -1;
+    if (vma && (err_code & PF_USER) && !(vma->flags & PTE_USER)) err = -1;
+
+    // Another thread of the space faulted the page in first: retry on it
+    uint64_t* pte = vmm_lookup_pte(space->pml4, fault_addr);
+    if (err == 0 && pte && (*pte & PTE_PRESENT)) {
+        vmm_unlock_space(space, lock_flags);
+        pmm_free_frame(frame);
+        return 0;
+    }
+
+    // The entry was not present, so no stale TLB entry to flush
+    if (err == 0) {
+        err = vmm_map_range_in(space, fault_addr & ~(uint64_t)(PAGE_SIZE - 1),
+                               (uint64_t)frame, PAGE_SIZE, vma->flags);
+    }
+    vmm_unlock_space(space, lock_flags);
+
+    if (err != 0) pmm_free_frame(frame);
+    return err;
+}
+
+// Address space descriptors (cache created on first use, see vma_alloc)
+static struct kmem_cache* space_cache = NULL;
+static struct spinlock space_cache_lock = SPINLOCK_INIT("vmm_space_cache");
+
+static struct vmm_space* vmm_space_alloc(void) {
+    struct kmem_cache* cache = __atomic_load_n(&space_cache, __ATOMIC_ACQUIRE);
+    if (!cache) {
+        spin_lock(&space_cache_lock);
+        cache = space_cache;
+        if (!cache) {
+            cache = kmem_cache_create("vmm_space", sizeof(struct vmm_space), 0);
+            __atomic_store_n(&space_cache, cache, __ATOMIC_RELEASE);
+        }
+        spin_unlock(&space_cache_lock);
+        if (!cache) return NULL;
+    }
+    return kmem_cache_alloc(cache);
+}
+
+static void vmm_space_free(struct vmm_space* space) {
+    kmem_cache_free(space_cache, space);
+}
+
+/**
+ * @brief Copy a user-half table level, sharing the mapped frames.
+ *
+ * Writable leaves become read-only + PTE_COW in both the source and the
+ * copy, and every mapped frame gets one more reference. A frame whose
+ * share count is saturated is copied for the child right away. Huge
+ * pages are split to 4KB first so each frame can be copied on its own.
+ *
+ * @param[in,out] src   Table of the parent (leaves are write-protected)
+ * @param[out]    dst   Empty table of the child
+ * @param[in]     level 3 = PDPT, 2 = PD, 1 = PT
+ * @return int 0 on success, -1 when out of memory
+ */
+static int vmm_clone_table(uint64_t* src, uint64_t* dst, int level) {
+    for (int i = 0; i < 512; i++) {
+        if (!(src[i] & PTE_PRESENT)) continue;
+
+        if (level == 1) {
+            if (pmm_share_frame((void*)PTE_ADDR(src[i])) != 0) {
+                // Too many sharers: the child gets its own copy now
+                uint64_t frame = (uint64_t)pmm_alloc_frame();
+                if (!frame) return -1;
+                vmm_copy_frame(frame, PTE_ADDR(src[i]));
+                uint64_t flags = src[i] & ~PTE_ADDR_MASK;
+                if (flags & PTE_COW) flags = (flags & ~PTE_COW) | PTE_WRITE;
+                dst[i] = frame | flags;
+                continue;
             }
+            if (src[i] & PTE_WRITE) {
+                src[i] = (src[i] & ~(uint64_t)PTE_WRITE) | PTE_COW;
+            }
+            dst[i] = src[i];
+            continue;
+        }
+
+        if ((src[i] & PTE_HUGE) &&
+            vmm_split_huge(&src[i], level == 3 ? VMM_HUGE_2M : PAGE_SIZE) != 0) {
+            return -1;
         }
+
+        uint64_t table = vmm_alloc_table();
+        if (!table) return -1;
+        dst[i] = table | (src[i] & ~PTE_ADDR_MASK);
+
+        if (vmm_clone_table(PTE_TABLE(src[i]), PTE_TABLE(dst[i]), level - 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Copy every region of a VMA tree into another space.
+// The child is not visible to anyone yet, so its lock is not taken (it
+// may well be the parent's, which the caller holds).
+static int vmm_clone_vmas(struct vma* node, struct vmm_space* child) {
+    if (!node) return 0;
+
+    struct vma* vma = vma_alloc();
+    if (!vma) return -1;
+    vma->start = node->start;
+    vma->end = node->end;
+    vma->flags = node->flags;
+    if (vma_insert(&child->vmas, vma) != 0) {
+        vma_free(vma);
+        return -1;
+    }
+
+    if (vmm_clone_vmas(node->left, child) != 0) return -1;
+    return vmm_clone_vmas(node->right, child);
+}
+
+/**
+ * @brief Create an address space with an empty user half.
+ *
+ * The kernel half points at the kernel space's PDPTs, so kernel mappings
+ * made later show up here too.
+ *
+ * @return struct vmm_space* The new space, or NULL when out of memory
+ */
+struct vmm_space* vmm_create_address_space(void) {
+    struct vmm_space* space = vmm_space_alloc();
+    if (!space) return NULL;
+
+    uint64_t pml4_phys = vmm_alloc_table();
+    if (!pml4_phys) {
+        vmm_space_free(space);
+        return NULL;
+    }
+    space->pml4_phys = pml4_phys;
+    space->pml4 = (uint64_t*)phys_to_virt(pml4_phys);
+    space->vmas = NULL;
+    space->tlb_gen = __atomic_add_fetch(&tlb_gen_clock, 1, __ATOMIC_SEQ_CST);
+
+    for (int i = VMM_KERNEL_PML4_FIRST; i < 512; i++) {
+        space->pml4[i] = kernel_space.pml4[i];
+    }
+    return space;
+}
+
+/**
+ * @brief Create a copy-on-write clone of an address space.
+ *
+ * The user half is copied table by table, but no page contents are: both
+ * spaces map the same frames read-only and the first write to a page
+ * copies it (see vmm_resolve_cow). The kernel half is shared as is.
+ * Reserved regions are copied too, so untouched demand-zero pages stay
+ * lazy in both spaces.
+ *
+ * @param[in] parent Address space to clone
+ * @return struct vmm_space* The new space, or NULL when out of memory
+ */
+struct vmm_space* vmm_clone_address_space(struct vmm_space* parent) {
+    // A. Kernel half: same PDPTs for everyone
+    struct vmm_space* child = vmm_create_address_space();
+    if (!child) return NULL;
+
+    // B. User half: copy the tables, share the frames
+    uint64_t lock_flags = vmm_lock_space(parent);
+    int err = vmm_clone_vmas(parent->vmas, child);
+    for (int i = 0; i < VMM_KERNEL_PML4_FIRST && err == 0; i++) {
+        if (!(parent->pml4[i] & PTE_PRESENT)) continue;
+
+        uint64_t table = vmm_alloc_table();
+        if (!table) {
+            err = -1;
+            break;
+        }
+        child->pml4[i] = table | (parent->pml4[i] & ~PTE_ADDR_MASK);
+        err = vmm_clone_table(PTE_TABLE(parent->pml4[i]), PTE_TABLE(child->pml4[i]), 3);
+    }
+
+    // C. The parent lost write access to its pages, on every CPU
+    struct tlb_batch batch = { .count = 0, .flush_all = 1 };
+    vmm_tlb_finish(parent, &batch);
+    vmm_unlock_space(parent, lock_flags);
+
+    // Out of memory: drop the partial copy. The parent keeps its
+    // PTE_COW pages; their next write fault just restores write access.
+    if (err != 0) {
+        vmm_destroy_address_space(child);
+        return NULL;
     }
-}
\ No newline at end of file
+    return child;
+}
+
+/**
+ * @brief Free an address space and everything mapped in its user half.
+ *
+ * Shared frames only lose this space's reference. The kernel half
+ * belongs to every space and is left alone.
+ *
+ * No CPU may be running the space. PCIDs some CPU still has tagged with
+ * it need no flush here: a later space on the same PML4 frame gets a new
+ * generation, so loading it flushes them.
+ *
+ * @param[in] space Address space to free (not current anywhere, not the kernel one)
+ */
+void vmm_destroy_address_space(struct vmm_space* space) {
+    struct tlb_batch batch = { .count = 0, .flush_all = 0 };
+    if (space == &kernel_space) return;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (__atomic_load_n(&current_space[cpu], __ATOMIC_SEQ_CST) == space) return;
+    }
+
+    for (int i = 0; i < VMM_KERNEL_PML4_FIRST; i++) {
+        if (space->pml4[i] & PTE_PRESENT) {
+            vmm_free_table(space, &batch, PTE_TABLE(space->pml4[i]), 3, 1);
+        }
+    }
+
+    while (space->vmas) {
+        vma_free(vma_remove(&space->vmas, space->vmas->start));
+    }
+
+    vmm_free_table_frame(space, &batch, space->pml4_phys);
+    vmm_tlb_finish(space, &batch);
+    vmm_space_free(space);
+}
+
+/**
+ * @brief Get the number of frames used by page tables.
+ *
+ * @return uint64_t PML4, PDPT, PD and PT frames of all address spaces
+ */
+uint64_t vmm_get_table_frames(void) {
+    return __atomic_load_n(&table_frames, __ATOMIC_RELAXED);
+}
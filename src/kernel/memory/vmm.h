@@ -9,24 +9,133 @@
 #define PTE_PRESENT   1         // Page is present in RAM
 #define PTE_WRITE     2         // Page is writable
 #define PTE_USER      4         // User Mode can access this page
+#define PTE_PWT       (1 << 3)  // Write-through caching
+#define PTE_PCD       (1 << 4)  // Cache disabled (device registers)
+#define PTE_HUGE      (1 << 7)  // PS bit: PD/PDPT entry maps a 2MB/1GB page
+#define PTE_GLOBAL    (1 << 8)  // Survives CR3 switches (kernel half only)
+#define PTE_COW       (1 << 9)  // Software bit: read-only because shared copy-on-write
 #define PTE_NX        (1ULL << 63) // No Execute (prevents running code here)
 
+// --- Page Fault Error Code ---
+// Pushed by the CPU on #PF (vector 14).
+#define PF_PRESENT    1         // Fault on a present page (protection error)
+#define PF_WRITE      2         // Faulting access was a write
+#define PF_USER       4         // Fault happened in User Mode
+
 // --- Constants ---
 #define PAGE_SIZE 4096
+#define VMM_TLB_VECTOR 0xF2           // IPI: TLB shootdown
+#define VMM_HUGE_2M   0x200000ULL     // Page mapped by one PD entry
+#define VMM_HUGE_1G   0x40000000ULL   // Page mapped by one PDPT entry
+#define PTE_ADDR_MASK 0x000FFFFFFFFFF000ULL // Physical address bits of an entry
+
+// --- Tunables ---
+// Range operations batch their TLB invalidations. Past this many pages,
+// one CR3 reload replaces the individual invlpg instructions.
+#define VMM_TLB_FLUSH_THRESHOLD 32
+
+// PCIDs each CPU hands out to address spaces (PCID 0 is the kernel space).
+// A space switched to again while it still owns its PCID keeps its TLB
+// entries; past this many live spaces, the oldest PCID is recycled.
+#define VMM_PCID_COUNT 16
+
+// --- Address Space ---
+struct vma;
+
+struct vmm_space {
+    uint64_t* pml4;       // Top-level table (through the direct map)
+    uint64_t pml4_phys;   // Physical address of the PML4 (what CR3 holds)
+    struct vma* vmas;     // Root of the reserved region tree
+    volatile uint64_t tlb_gen;  // Stamp of the last edit needing a flush
+};
 
 // --- Function Prototypes ---
 
 // Initialize the VMM (Create a new PML4 and switch to it)
 void vmm_init(void);
 
+// Load the kernel space on an application processor (SMP bring-up)
+void vmm_init_cpu(void);
+
 // Map a specific virtual page to a physical frame
 // flags: e.g., PTE_PRESENT | PTE_WRITE
-void vmm_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags);
+// Returns 0 on success, -1 when a page table could not be allocated
+int vmm_map_page(uint64_t virtual_addr, uint64_t physical_addr, uint64_t flags);
+
+// Map a 2MB or 1GB huge page (both addresses aligned to size)
+// size: VMM_HUGE_2M or VMM_HUGE_1G (1GB only if the CPU supports it)
+// Returns 0 on success, -1 on bad size/alignment or no memory
+int vmm_map_huge_page(uint64_t virtual_addr, uint64_t physical_addr,
+                      uint64_t size, uint64_t flags);
+
+// Map a physically contiguous range (length in bytes, 4KB aligned)
+// Picks 1GB/2MB pages automatically when alignment allows, walks the
+// tables once per page table and flushes the TLB once at the end.
+// Returns 0 on success, -1 when out of memory (the part already mapped
+// stays mapped)
+int vmm_map_range(uint64_t virtual_addr, uint64_t physical_addr,
+                  uint64_t length, uint64_t flags);
+
+// Same, in another address space (e.g. a lower-half mapping of a clone)
+int vmm_map_range_space(struct vmm_space* space, uint64_t virtual_addr,
+                        uint64_t physical_addr, uint64_t length, uint64_t flags);
+
+// Make a physical range reachable at phys_to_virt() (length in bytes)
+// For device registers pass PTE_PCD | PTE_PWT: the pages are remapped
+// uncached even inside RAM's direct map. Cacheable ranges already covered
+// by the direct map are left alone. Returns 0 on success, -1 when out of memory.
+int vmm_map_physical(uint64_t physical_addr, uint64_t length, uint64_t flags);
 
 // Unmap a page (make it inaccessible)
-void vmm_unmap_page(uint64_t virtual_addr);
+// Returns 0 on success, -1 if a huge page around it could not be split
+int vmm_unmap_page(uint64_t virtual_addr);
+
+// Unmap a range (length in bytes, 4KB aligned)
+// free_frames: non-zero to return the mapped frames to the PMM.
+// Page tables left empty are freed; TLB flushes are batched.
+// Returns 0 on success, -1 if a partly covered huge page could not be split
+int vmm_unmap_range(uint64_t virtual_addr, uint64_t length, int free_frames);
+
+// Make a space the current one on this CPU (Context Switch)
+// Uses a PCID-tagged CR3 write when the CPU supports it, so the TLB entries
+// of the previous space survive.
+void vmm_switch_space(struct vmm_space* space);
+
+// Create a space with the kernel half only. Returns NULL when out of memory.
+struct vmm_space* vmm_create_address_space(void);
+
+// Create a copy of a space's user half (copy-on-write) that shares the
+// kernel half. Returns NULL when out of memory.
+struct vmm_space* vmm_clone_address_space(struct vmm_space* parent);
+
+// Free a space created by vmm_create/clone_address_space (must not be in CR3 on any CPU)
+void vmm_destroy_address_space(struct vmm_space* space);
+
+// The kernel address space / the one currently loaded in CR3
+struct vmm_space* vmm_kernel_space(void);
+struct vmm_space* vmm_current_space(void);
+
+// Reserve a demand-zero region (nothing is mapped until first touch)
+// flags: flags for the faulted-in pages, e.g., PTE_WRITE
+// Returns 0 on success, -1 on bad alignment, overlap or no memory
+int vmm_reserve(struct vmm_space* space, uint64_t virtual_addr,
+                uint64_t length, uint64_t flags);
+
+// Drop a region created by vmm_reserve and free its frames
+// Returns 0 on success, -1 if no region starts at virtual_addr
+int vmm_release(struct vmm_space* space, uint64_t virtual_addr);
+
+// Frames used by page tables (all address spaces), for statistics
+uint64_t vmm_get_table_frames(void);
+
+// Called from the #PF handler. Returns 0 if the fault was resolved.
+int vmm_handle_page_fault(uint64_t fault_addr, uint64_t err_code);
+
+// Apply TLB flushes other CPUs requested from this one (any context).
+// Loops that wait for another CPU with interrupts disabled call it too.
+void vmm_tlb_sync(void);
 
-// Switch the CPU to use a specific PML4 table (Context Switch)
-void vmm_switch_pml4(uint64_t pml4_physical_addr);
+// VMM_TLB_VECTOR handler (irq_register)
+int vmm_tlb_interrupt(void* ctx);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include "ktime.h"
+#include "../arch/x86_64/tsc.h"
+#include "../arch/x86_64/cpuid.h"
+#include "../drivers/pit.h"
+#include "../drivers/vga.h"
+
+// --- Calibration ---
+#define KTIME_CAL_TICKS     11932   // ~10ms of PIT input clock
+#define KTIME_CAL_RUNS      3       // Keep the shortest (least disturbed) run
+
+// Conversions are fixed-point multiplies, no division on the read path:
+//   ns     = (cycles * ns_mult) >> 32
+//   cycles = (ns * cyc_mult) >> 20
+// The products go through 128 bits so long uptimes do not overflow.
+#define KTIME_NS_SHIFT      32
+#define KTIME_CYC_SHIFT     20
+
+static uint64_t tsc_hz = 0;
+static uint64_t tsc_base = 0;
+static uint64_t ns_mult = 0;
+static uint64_t cyc_mult = 0;
+
+// 1. Calibration
+// Leaf 0x15: TSC = crystal * EBX / EAX (crystal Hz in ECX, 0 if unknown)
+static uint64_t ktime_tsc_hz_cpuid(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, &eax, &edx, &ecx, &ebx);
+    if (eax < 0x15) return 0;
+
+    cpuid(0x15, &eax, &edx, &ecx, &ebx);
+    if (eax == 0 || ebx == 0 || ecx == 0) return 0;
+    return (uint64_t)ecx * ebx / eax;
+}
+
+static uint64_t ktime_tsc_hz_pit(void) {
+    uint64_t best = ~0ULL;
+
+    for (int run = 0; run < KTIME_CAL_RUNS; run++) {
+        uint64_t start = rdtsc();
+        pit_wait_ticks(KTIME_CAL_TICKS);
+        uint64_t cycles = rdtsc() - start;
+        if (cycles < best) best = cycles;
+    }
+    return best * PIT_FREQUENCY / KTIME_CAL_TICKS;
+}
+
+/**
+ * @brief Calibrate the TSC and start the kernel clock.
+ *
+ * Assumes an invariant TSC (constant rate across P-states), which every
+ * CPU with an APIC timer worth using has.
+ */
+void ktime_init(void) {
+    // A. Frequency
+    tsc_hz = ktime_tsc_hz_cpuid();
+    if (tsc_hz == 0) tsc_hz = ktime_tsc_hz_pit();
+
+    // B. Fixed-point factors
+    ns_mult = (NSEC_PER_SEC << KTIME_NS_SHIFT) / tsc_hz;
+    cyc_mult = (tsc_hz << KTIME_CYC_SHIFT) / NSEC_PER_SEC;
+
+    tsc_base = rdtsc();
+
+    terminal_writestring("[TIME] TSC at ");
+    terminal_writedec(tsc_hz / 1000000);
+    terminal_writestring(" MHz.\n");
+}
+
+// 2. Clock
+uint64_t ktime_cycles_to_ns(uint64_t cycles) {
+    return (uint64_t)(((unsigned __int128)cycles * ns_mult) >> KTIME_NS_SHIFT);
+}
+
+uint64_t ktime_ns_to_cycles(uint64_t ns) {
+    return (uint64_t)(((unsigned __int128)ns * cyc_mult) >> KTIME_CYC_SHIFT);
+}
+
+uint64_t ktime_get_ns(void) {
+    return ktime_cycles_to_ns(rdtsc() - tsc_base);
+}
+
+uint64_t ktime_to_tsc(uint64_t ns) {
+    return tsc_base + ktime_ns_to_cycles(ns);
+}
+
+uint64_t ktime_tsc_hz(void) {
+    return tsc_hz;
+}
+
+void ktime_delay_ns(uint64_t ns) {
+    uint64_t end = rdtsc() + ktime_ns_to_cycles(ns);
+    while (rdtsc() < end) {
+        __asm__ volatile("pause");
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include <stdint.h>
+
+// --- Units ---
+#define NSEC_PER_USEC   1000ULL
+#define NSEC_PER_MSEC   1000000ULL
+#define NSEC_PER_SEC    1000000000ULL
+
+// --- Function Prototypes ---
+
+// Calibrate the TSC (CPUID leaf 0x15 when it reports the frequency,
+// otherwise against the PIT) and start the clock at 0
+void ktime_init(void);
+
+// Nanoseconds since ktime_init (monotonic)
+uint64_t ktime_get_ns(void);
+
+// TSC frequency in Hz (0 before ktime_init)
+uint64_t ktime_tsc_hz(void);
+
+// Convert between TSC cycles and nanoseconds
+uint64_t ktime_cycles_to_ns(uint64_t cycles);
+uint64_t ktime_ns_to_cycles(uint64_t ns);
+
+// TSC value at a given ktime (for TSC-deadline programming)
+uint64_t ktime_to_tsc(uint64_t ns);
+
+// Busy-wait (interrupts may stay disabled)
+void ktime_delay_ns(uint64_t ns);
+
+#endif
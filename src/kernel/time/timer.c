@@ -0,0 +1,398 @@
+#include "timer.h"
+#include "ktime.h"
+#include "../drivers/apic.h"
+#include "../drivers/pit.h"
+#include "../drivers/irqchip.h"
+#include "../drivers/vga.h"
+#include "../arch/x86_64/msr.h"
+#include "../arch/x86_64/cpuid.h"
+#include "../arch/x86_64/irq.h"
+
+// --- Local APIC Timer ---
+#define LVT_TIMER_ONESHOT       (0 << 17)
+#define LVT_TIMER_TSC_DEADLINE  (2 << 17)
+#define LAPIC_TIMER_DIV_16      0x3
+#define MSR_TSC_DEADLINE        0x6E0
+#define CPUID_ECX_TSC_DEADLINE  (1 << 24)
+
+#define TIMER_CAL_NS            (10 * NSEC_PER_MSEC)
+
+// --- Event Devices ---
+// There is no periodic tick: the device is programmed for the earliest
+// pending deadline only, so an idle CPU sleeps in hlt until it is due.
+// Devices with a limited range (APIC count, PIT) may fire early; the
+// interrupt then finds nothing expired and programs the rest.
+enum timer_mode {
+    TIMER_MODE_NONE,
+    TIMER_MODE_TSC_DEADLINE,
+    TIMER_MODE_APIC_ONESHOT,
+    TIMER_MODE_PIT_ONESHOT,
+};
+
+static enum timer_mode mode = TIMER_MODE_NONE;
+static uint64_t apic_timer_hz = 0;  // APIC timer ticks per second (divided)
+static struct timer_wheel wheels[MAX_CPUS];
+
+// 1. Device Programming
+static void timer_program(uint64_t deadline) {
+    uint64_t now = ktime_get_ns();
+    uint64_t delta = deadline > now ? deadline - now : 0;
+
+    switch (mode) {
+        case TIMER_MODE_TSC_DEADLINE:
+            // A deadline already in the past fires immediately
+            wrmsr(MSR_TSC_DEADLINE, ktime_to_tsc(deadline));
+            break;
+
+        case TIMER_MODE_APIC_ONESHOT: {
+            uint64_t max_ns = 0xFFFFFFFFULL * NSEC_PER_SEC / apic_timer_hz;
+            uint64_t count = delta >= max_ns ? 0xFFFFFFFF
+                                             : delta * apic_timer_hz / NSEC_PER_SEC;
+            lapic_write(LAPIC_REG_TIMER_INIT, count ? count : 1);
+            break;
+        }
+
+        case TIMER_MODE_PIT_ONESHOT: {
+            uint64_t count = delta * PIT_FREQUENCY / NSEC_PER_SEC;
+            if (delta > NSEC_PER_SEC || count > 0xFFFF) count = 0xFFFF;
+            pit_oneshot(count ? count : 1);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void timer_disarm_device(void) {
+    if (mode == TIMER_MODE_TSC_DEADLINE) {
+        wrmsr(MSR_TSC_DEADLINE, 0);
+    } else if (mode == TIMER_MODE_APIC_ONESHOT) {
+        lapic_write(LAPIC_REG_TIMER_INIT, 0);
+    }
+    // The PIT cannot be stopped: its next interrupt just finds nothing due
+}
+
+// 2. Wheel Placement
+#define WHEEL_MASK      (TIMER_WHEEL_SLOTS - 1)
+#define WHEEL_SPAN      (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)   // Ticks per top lap: 2^24
+#define WHEEL_NONE      (~0ULL)
+#define LEVEL_EXPIRED   (TIMER_WHEEL_LEVELS + 1)                  // On wheel->expired
+
+static void wheel_link(struct timer** head, struct timer* timer) {
+    timer->next = *head;
+    if (*head) (*head)->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+// Queue a timer relative to the wheel clock: on the lowest level whose
+// lap (one slot of the level above) contains the expiry.
+static void wheel_insert(struct timer_wheel* wheel, struct timer* timer) {
+    uint64_t expires = timer->expires;
+    if (expires < wheel->clk) expires = wheel->clk;     // Overdue: next tick
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        int lap_shift = (level + 1) * TIMER_WHEEL_BITS;
+        if ((expires >> lap_shift) == (wheel->clk >> lap_shift)) {
+            int slot = (expires >> (level * TIMER_WHEEL_BITS)) & WHEEL_MASK;
+            timer->level = level;
+            timer->slot = slot;
+            wheel_link(&wheel->slots[level][slot], timer);
+            wheel->occupied[level] |= 1ULL << slot;
+            return;
+        }
+    }
+
+    timer->level = TIMER_WHEEL_LEVELS;
+    wheel_link(&wheel->overflow, timer);
+}
+
+static void wheel_unlink(struct timer_wheel* wheel, struct timer* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+
+    if (timer->level < TIMER_WHEEL_LEVELS &&
+        !wheel->slots[timer->level][timer->slot]) {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+    timer->armed = 0;
+    wheel->pending--;
+}
+
+// Take a whole slot (or the overflow list) off the wheel
+static struct timer* wheel_detach(struct timer_wheel* wheel, int level, int slot) {
+    struct timer* list;
+    if (level == TIMER_WHEEL_LEVELS) {
+        list = wheel->overflow;
+        wheel->overflow = NULL;
+    } else {
+        list = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~(1ULL << slot);
+    }
+    return list;
+}
+
+// 3. Wheel Clock
+// Earliest tick at which the wheel has work: a level-0 slot to expire,
+// a higher slot to cascade, or the overflow list to sort again.
+static uint64_t wheel_next_event(struct timer_wheel* wheel) {
+    uint64_t next = WHEEL_NONE;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        int shift = level * TIMER_WHEEL_BITS;
+        int index = (wheel->clk >> shift) & WHEEL_MASK;
+        uint64_t ahead = wheel->occupied[level] & (~0ULL << index);
+        if (!ahead) continue;
+
+        // Start of that slot within the current lap of this level
+        uint64_t lap = wheel->clk >> (shift + TIMER_WHEEL_BITS) << (shift + TIMER_WHEEL_BITS);
+        uint64_t tick = lap | ((uint64_t)__builtin_ctzll(ahead) << shift);
+        if (tick < wheel->clk) tick = wheel->clk;       // Slot already entered
+        if (tick < next) next = tick;
+    }
+
+    if (wheel->overflow) {
+        uint64_t tick = ((wheel->clk >> WHEEL_SPAN) + 1) << WHEEL_SPAN;
+        if (wheel->overflow_lap != (wheel->clk >> WHEEL_SPAN)) tick = wheel->clk;
+        if (tick < next) next = tick;
+    }
+    return next;
+}
+
+// Re-queue a detached list relative to the (advanced) clock
+static void wheel_requeue(struct timer_wheel* wheel, struct timer* list) {
+    while (list) {
+        struct timer* timer = list;
+        list = timer->next;
+        wheel_insert(wheel, timer);
+    }
+}
+
+/**
+ * @brief Advance the wheel clock up to a tick, running expired timers.
+ *
+ * Jumps from event to event (see wheel_next_event), so idle stretches
+ * cost nothing. At each event tick, slots reached on the upper levels
+ * cascade down first, then the level-0 slot for that tick expires.
+ *
+ * @param[in] wheel This CPU's wheel (locked; dropped around callbacks)
+ * @param[in] now   Current tick
+ */
+static void wheel_advance(struct timer_wheel* wheel, uint64_t now) {
+    while (1) {
+        uint64_t tick = wheel_next_event(wheel);
+        if (tick == WHEEL_NONE || tick > now) break;
+        wheel->clk = tick;
+
+        // A. Overflow timers whose top-level lap has come
+        if (wheel->overflow && wheel->overflow_lap != (tick >> WHEEL_SPAN)) {
+            wheel->overflow_lap = tick >> WHEEL_SPAN;
+            wheel_requeue(wheel, wheel_detach(wheel, TIMER_WHEEL_LEVELS, 0));
+        }
+
+        // B. Cascade, top level first, so timers can fall several levels
+        for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            int slot = (tick >> (level * TIMER_WHEEL_BITS)) & WHEEL_MASK;
+            if (wheel->occupied[level] & (1ULL << slot)) {
+                wheel_requeue(wheel, wheel_detach(wheel, level, slot));
+            }
+        }
+
+        // C. Expire this tick. The clock moves on first, so callbacks that
+        // re-arm for "now" land on the next tick instead of this list.
+        // Due timers stay properly linked on wheel->expired until their
+        // turn, so a callback may cancel or re-arm any of them.
+        struct timer* expired = wheel_detach(wheel, 0, tick & WHEEL_MASK);
+        if (expired) expired->pprev = &wheel->expired;
+        for (struct timer* timer = expired; timer; timer = timer->next) {
+            timer->level = LEVEL_EXPIRED;
+        }
+        wheel->expired = expired;
+        wheel->clk = tick + 1;
+
+        while (wheel->expired) {
+            struct timer* timer = wheel->expired;
+            wheel_unlink(wheel, timer);
+            spin_unlock(&wheel->lock);
+            timer->callback(timer->ctx);
+            spin_lock(&wheel->lock);
+        }
+    }
+}
+
+// Program the device for the wheel's next event (if it changed)
+static void wheel_reprogram(struct timer_wheel* wheel) {
+    uint64_t next = wheel_next_event(wheel);
+    if (next == wheel->next_event) return;
+
+    wheel->next_event = next;
+    if (next == WHEEL_NONE) {
+        timer_disarm_device();
+    } else {
+        timer_program(next << TIMER_TICK_SHIFT);
+    }
+}
+
+// 4. Arming
+// Take a timer off whatever wheel it is queued on. The owning wheel can
+// change until its lock is held, so check again under the lock.
+// Returns 1 if the timer was pending.
+static int timer_unlink(struct timer* timer) {
+    while (__atomic_load_n(&timer->armed, __ATOMIC_ACQUIRE)) {
+        struct timer_wheel* wheel = &wheels[timer->cpu];
+        uint64_t flags = spin_lock_irqsave(&wheel->lock);
+        if (timer->armed && &wheels[timer->cpu] == wheel) {
+            wheel_unlink(wheel, timer);
+            spin_unlock_irqrestore(&wheel->lock, flags);
+            return 1;
+        }
+        spin_unlock_irqrestore(&wheel->lock, flags);
+    }
+    return 0;
+}
+
+/**
+ * @brief Arm a one-shot timer on this CPU's wheel.
+ *
+ * O(1): the timer goes straight into its slot. The event device is only
+ * touched when the new timer is due before everything else. A timer
+ * pending on another CPU's wheel is taken off it first.
+ *
+ * @param[in] timer    Caller-owned timer
+ * @param[in] deadline Absolute expiry in ktime nanoseconds
+ * @param[in] callback Called from the timer interrupt
+ * @param[in] ctx      Passed to callback
+ */
+void timer_arm(struct timer* timer, uint64_t deadline, timer_fn callback, void* ctx) {
+    struct timer_wheel* wheel;
+    uint64_t flags;
+
+    // A. Unlink, then lock our wheel. Someone may arm the timer in between:
+    // go around again rather than queue it twice.
+    while (1) {
+        timer_unlink(timer);
+        flags = irq_save();
+        wheel = &wheels[cpu_id()];
+        spin_lock(&wheel->lock);
+        if (!timer->armed) break;
+        spin_unlock_irqrestore(&wheel->lock, flags);
+    }
+
+    // B. An empty wheel may have slept through many ticks: catch its clock
+    // up so the timer is placed relative to now, not to the last interrupt.
+    if (wheel->pending == 0) {
+        wheel->clk = ktime_get_ns() >> TIMER_TICK_SHIFT;
+        wheel->overflow_lap = wheel->clk >> WHEEL_SPAN;
+    }
+
+    timer->deadline = deadline;
+    timer->expires = (deadline + (1ULL << TIMER_TICK_SHIFT) - 1) >> TIMER_TICK_SHIFT;
+    timer->callback = callback;
+    timer->ctx = ctx;
+    timer->cpu = cpu_id();
+    timer->armed = 1;
+    wheel->pending++;
+    wheel_insert(wheel, timer);
+
+    if (!wheel->expiring && timer->expires < wheel->next_event) wheel_reprogram(wheel);
+    spin_unlock_irqrestore(&wheel->lock, flags);
+}
+
+int timer_cancel(struct timer* timer) {
+    // The device stays programmed: at worst it fires once for nothing
+    return timer_unlink(timer);
+}
+
+uint64_t timer_pending(void) {
+    return wheels[cpu_id()].pending;
+}
+
+// 5. Interrupt
+int timer_interrupt(void* ctx) {
+    struct timer_wheel* wheel = &wheels[cpu_id()];
+    (void)ctx;
+
+    // A. Run everything due. Callbacks may arm timers (even their own).
+    spin_lock(&wheel->lock);
+    wheel->next_event = WHEEL_NONE;
+    wheel->expiring = 1;
+    wheel_advance(wheel, ktime_get_ns() >> TIMER_TICK_SHIFT);
+    wheel->expiring = 0;
+
+    // B. Sleep until the next event
+    wheel_reprogram(wheel);
+    spin_unlock(&wheel->lock);
+    return IRQ_HANDLED;
+}
+
+// 6. Initialization
+// Count how fast the APIC timer runs against the (already calibrated) TSC
+// Returns 0 if the timer did not count at all.
+static int timer_calibrate_apic(void) {
+    lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+    lapic_write(LAPIC_REG_LVT_TIMER, LAPIC_LVT_MASKED);
+    lapic_write(LAPIC_REG_TIMER_INIT, 0xFFFFFFFF);
+    ktime_delay_ns(TIMER_CAL_NS);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_REG_TIMER_CURRENT);
+    lapic_write(LAPIC_REG_TIMER_INIT, 0);
+
+    apic_timer_hz = (uint64_t)elapsed * (NSEC_PER_SEC / TIMER_CAL_NS);
+    return apic_timer_hz != 0;
+}
+
+/**
+ * @brief Select the best available event device.
+ *
+ * TSC-deadline mode needs no calibration and has the TSC's resolution;
+ * the APIC one-shot count is the next best; the PIT is the fallback when
+ * interrupts still go through the 8259.
+ */
+void timer_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &edx, &ecx, &ebx);
+
+    // Empty wheels, nothing programmed yet
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        spin_lock_init(&wheels[cpu].lock, "timer_wheel");
+        wheels[cpu].clk = ktime_get_ns() >> TIMER_TICK_SHIFT;
+        wheels[cpu].overflow_lap = wheels[cpu].clk >> WHEEL_SPAN;
+        wheels[cpu].next_event = WHEEL_NONE;
+    }
+
+    if (irqchip_uses_apic() && (ecx & CPUID_ECX_TSC_DEADLINE)) {
+        irq_register(TIMER_VECTOR, timer_interrupt, NULL);
+        lapic_write(LAPIC_REG_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_TSC_DEADLINE);
+        // Order the LVT write before the first deadline MSR write (xAPIC)
+        __asm__ volatile("mfence" ::: "memory");
+        mode = TIMER_MODE_TSC_DEADLINE;
+        terminal_writestring("[TIMER] APIC timer, TSC-deadline mode.\n");
+    } else if (irqchip_uses_apic() && timer_calibrate_apic()) {
+        irq_register(TIMER_VECTOR, timer_interrupt, NULL);
+        lapic_write(LAPIC_REG_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_ONESHOT);
+        mode = TIMER_MODE_APIC_ONESHOT;
+        terminal_writestring("[TIMER] APIC timer, one-shot mode at ");
+        terminal_writedec(apic_timer_hz / 1000);
+        terminal_writestring(" kHz.\n");
+    } else if (!irqchip_uses_apic()) {
+        irq_register(IRQ_VECTOR_BASE, timer_interrupt, NULL);
+        irqchip_enable_irq(0);
+        mode = TIMER_MODE_PIT_ONESHOT;
+        terminal_writestring("[TIMER] PIT one-shot mode.\n");
+    } else {
+        terminal_writestring("[TIMER] APIC timer not counting, no timer.\n");
+    }
+}
+
+// Application processors reuse the boot CPU's choice (and calibration:
+// all Local APIC timers run from the same clock)
+void timer_init_cpu(void) {
+    if (mode == TIMER_MODE_TSC_DEADLINE) {
+        lapic_write(LAPIC_REG_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_TSC_DEADLINE);
+        __asm__ volatile("mfence" ::: "memory");
+    } else if (mode == TIMER_MODE_APIC_ONESHOT) {
+        lapic_write(LAPIC_REG_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+        lapic_write(LAPIC_REG_LVT_TIMER, TIMER_VECTOR | LVT_TIMER_ONESHOT);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include "../arch/x86_64/cpu.h"
+#include "../core/spinlock.h"
+
+// --- Vectors ---
+#define TIMER_VECTOR 0xEF           // Local APIC timer (IRQ0 on the PIT fallback)
+
+// --- Timing Wheel ---
+// Deadlines are rounded up to wheel ticks of 2^TIMER_TICK_SHIFT ns.
+// Level L has 64 slots of 64^L ticks each, so the 4 levels cover 2^24
+// ticks (~17s); later timers wait on an overflow list.
+#define TIMER_TICK_SHIFT    10      // 1.024us per tick
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS  4
+
+typedef void (*timer_fn)(void* ctx);
+
+// --- Timer ---
+// Owned by the caller (usually embedded in a bigger object), so arming a
+// timer never allocates, even from interrupt context.
+struct timer {
+    uint64_t deadline;              // Expiry, in ktime nanoseconds
+    uint64_t expires;               // Expiry, in wheel ticks (rounded up)
+    timer_fn callback;              // Runs in interrupt context
+    void* ctx;
+    struct timer* next;             // Slot list
+    struct timer** pprev;           // Link pointing at us (O(1) unlink)
+    uint8_t level;                  // Wheel level, TIMER_WHEEL_LEVELS = overflow, +1 = expiring
+    uint8_t slot;
+    uint8_t cpu;                    // Wheel the timer is queued on
+    uint8_t armed;
+};
+
+// --- Per-CPU Wheel ---
+// A slot only holds timers due within the current lap of the level above,
+// so when the wheel reaches a slot of level L, its timers all fall within
+// the next 64^L ticks and cascade down one or more levels. Occupancy
+// bitmaps let the wheel jump straight to the next non-empty slot: work
+// per interrupt depends on the slots reached, not on how many timers wait.
+// Timers are only ever queued on the arming CPU's wheel, but may be
+// unlinked from any CPU, so every wheel has a lock (taken irqsave). It is
+// dropped while a callback runs.
+struct timer_wheel {
+    struct spinlock lock;
+    uint64_t clk;                   // Next tick to process
+    uint64_t next_event;            // Tick the device is programmed for (~0: none)
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    struct timer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    struct timer* overflow;         // Beyond the top level's lap
+    struct timer* expired;          // Due this tick, callbacks still to run
+    uint64_t overflow_lap;          // Top-level lap the overflow list was sorted in
+    uint64_t pending;               // Armed timers
+    int expiring;                   // Inside the interrupt: reprogram once at the end
+};
+
+// --- Function Prototypes ---
+
+// Pick the event device (TSC-deadline, APIC one-shot or PIT one-shot)
+// and register its interrupt. Call after irqchip_init and ktime_init.
+void timer_init(void);
+
+// Program the event device of an application processor (after timer_init)
+void timer_init_cpu(void);
+
+// Run callback(ctx) once ktime_get_ns() >= deadline
+// Re-arming a pending timer moves it to the new deadline.
+void timer_arm(struct timer* timer, uint64_t deadline, timer_fn callback, void* ctx);
+
+// Stop a pending timer. Returns 1 if it was pending, 0 otherwise.
+// Does not wait for a callback already running on another CPU.
+int timer_cancel(struct timer* timer);
+
+// Timers armed on this CPU (for statistics)
+uint64_t timer_pending(void);
+
+// Timer interrupt (irq_register handler): run expired timers, program
+// the next event
+int timer_interrupt(void* ctx);
+
+#endif